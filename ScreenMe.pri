@@ -9,6 +9,14 @@ message("You are running qmake on a generated .pro file. This may not work!")
 
 QT       += core gui widgets
 QT += websockets
+CONFIG += c++20
+
+# Local OCR of saved captures for the capture search, qmake CONFIG+=tesseract.
+# Without it only annotation text is searchable.
+tesseract {
+    DEFINES += SCREENME_TESSERACT
+    LIBS += -ltesseract -lleptonica
+}
 
 HEADERS += ./include/config_manager.h \
     ./include/hotkeymap.h \
@@ -17,7 +25,6 @@ HEADERS += ./include/config_manager.h \
     ./include/utils.h \
     ./include/screenshotdisplay.h \
     ./include/editor.h \
-    ./include/customTextEdit.h \
     ./include/hotkeyEventFilter.h \
     ./include/globalKeyboardHook.h \
     ./include/main_window.h \
@@ -25,9 +32,41 @@ HEADERS += ./include/config_manager.h \
     ./include/login_loader.h \
     ./include/login_server.h \
     ./include/uglobalhotkeys.h \
-    ./include/options_window.h
-SOURCES += ./src/customTextInput.cpp \
-    ./src/editor.cpp \
+    ./include/options_window.h \
+    ./include/layer_stack.h \
+    ./include/blend_kernels.h \
+    ./include/annotation.h \
+    ./include/image_diff.h \
+    ./include/scrolling_capture.h \
+    ./include/tiled_image.h \
+    ./include/lazy_mime_data.h \
+    ./include/vector_export.h \
+    ./include/image_resampler.h \
+    ./include/palette_quantizer.h \
+    ./include/content_classifier.h \
+    ./include/multipart_body.h \
+    ./include/upload_scheduler.h \
+    ./include/mock_api_server.h \
+    ./include/upload_backend.h \
+    ./include/screenme_backend.h \
+    ./include/http_post_backend.h \
+    ./include/s3_backend.h \
+    ./include/privacy_updater.h \
+    ./include/content_hash.h \
+    ./include/publish_index.h \
+    ./include/async_task.h \
+    ./include/job_system.h \
+    ./include/frame_buffer_pool.h \
+    ./include/memory_trimmer.h \
+    ./include/evdev_hotkeys.h \
+    ./include/capture_search.h \
+    ./include/automation_api.h \
+    ./include/metrics_registry.h \
+    ./include/screen_overlay.h \
+    ./include/app_commands.h \
+    ./include/capture_search_window.h \
+    ./include/desktop_layers.h
+SOURCES += ./src/editor.cpp \
     ./src/globalKeyboardHook.cpp \
     ./src/hotkeyEventFilter.cpp \
     ./src/login_loader.cpp \
@@ -40,4 +79,36 @@ SOURCES += ./src/customTextInput.cpp \
     ./src/utils.cpp \
     ./main.cpp \
     ./src/config_manager.cpp \
-    ./src/options_window.cpp
+    ./src/options_window.cpp \
+    ./src/layer_stack.cpp \
+    ./src/annotation.cpp \
+    ./src/image_diff.cpp \
+    ./src/scrolling_capture.cpp \
+    ./src/tiled_image.cpp \
+    ./src/lazy_mime_data.cpp \
+    ./src/vector_export.cpp \
+    ./src/image_resampler.cpp \
+    ./src/palette_quantizer.cpp \
+    ./src/content_classifier.cpp \
+    ./src/multipart_body.cpp \
+    ./src/upload_scheduler.cpp \
+    ./src/mock_api_server.cpp \
+    ./src/upload_backend.cpp \
+    ./src/screenme_backend.cpp \
+    ./src/http_post_backend.cpp \
+    ./src/s3_backend.cpp \
+    ./src/privacy_updater.cpp \
+    ./src/content_hash.cpp \
+    ./src/publish_index.cpp \
+    ./src/async_task.cpp \
+    ./src/job_system.cpp \
+    ./src/frame_buffer_pool.cpp \
+    ./src/memory_trimmer.cpp \
+    ./src/evdev_hotkeys.cpp \
+    ./src/capture_search.cpp \
+    ./src/automation_api.cpp \
+    ./src/metrics_registry.cpp \
+    ./src/screen_overlay.cpp \
+    ./src/app_commands.cpp \
+    ./src/capture_search_window.cpp \
+    ./src/desktop_layers.cpp
@@ -0,0 +1,53 @@
+#ifndef ANNOTATION_H
+#define ANNOTATION_H
+
+#include <QColor>
+#include <QFont>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPolygonF>
+#include <QRect>
+#include <QString>
+#include <QStaticText>
+#include <QVector>
+
+// One editor annotation kept as a vector description. Coordinates are logical
+// (widget) coordinates; whoever paints it sets up the transform to image pixels.
+struct Annotation {
+    enum Kind {
+        Stroke,
+        Rectangle,
+        Ellipse,
+        Line,
+        Arrow,
+        Highlight,
+        Redaction,
+        Text
+    };
+
+    Kind kind = Stroke;
+    QColor color = Qt::black;
+    int penWidth = 1;
+    QRect rect;
+    QPoint start;
+    QPoint end;
+    QPainterPath path;
+    QString text;
+    QFont font;
+
+    QRect bounds() const;
+    void paint(QPainter& painter) const;
+
+    // Laid-out lines of a Text annotation, rebuilt only when the text or font changed
+    const QVector<QStaticText>& textLines() const;
+    int lineHeight() const;
+
+    static QPolygonF arrowHead(const QPointF& start, const QPointF& end, qreal penWidth);
+
+private:
+    mutable QVector<QStaticText> textLayout;
+    mutable QString layoutText;
+    mutable QFont layoutFont;
+};
+
+#endif // ANNOTATION_H
@@ -0,0 +1,22 @@
+#ifndef APP_COMMANDS_H
+#define APP_COMMANDS_H
+
+#include <QStringList>
+
+class QApplication;
+class QSystemTrayIcon;
+class ConfigManager;
+
+// Everything besides taking captures: the command line modes, which run instead of the
+// tray app, and the tray's Compare Captures
+class AppCommands {
+public:
+    // Whether `arguments` ask for a command line mode
+    static bool isCommandLine(const QStringList& arguments);
+    // Runs that mode and returns the process exit code
+    static int runCommandLine(const QStringList& arguments, QApplication& app);
+    // Asks for two captures and saves their comparison to the default save folder
+    static void compareCaptures(ConfigManager& configManager, QSystemTrayIcon& trayIcon);
+};
+
+#endif // APP_COMMANDS_H
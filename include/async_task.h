@@ -0,0 +1,341 @@
+#ifndef ASYNC_TASK_H
+#define ASYNC_TASK_H
+
+#include <QObject>
+#include <QPointer>
+#include <QCoreApplication>
+#include <QDebug>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Coroutines on the Qt event loop. A function returning Async::Task<T> can co_await
+// job system work, signals, callbacks and other tasks, and always resumes on the
+// GUI thread, so between awaits it may touch widgets like any slot.
+// A task starts when it is awaited, the outermost one through Async::spawn(). Awaited
+// tasks share the cancellation state of the task awaiting them: cancelling the outermost
+// one aborts whatever the chain is waiting on, and every coroutine still runs to its
+// end, so whatever it owns is released on the way out.
+namespace Async {
+    class CancelState {
+    public:
+        bool isCanceled() const { return canceled; }
+        void cancel();
+        // `handler` runs once on cancel(). Returns an id for unsubscribe(), or -1 without
+        // registering when already cancelled, callers check isCanceled() first.
+        int subscribe(std::function<void()> handler);
+        void unsubscribe(int id);
+
+    private:
+        bool canceled = false;
+        int nextId = 0;
+        std::vector<std::pair<int, std::function<void()>>> handlers;
+    };
+
+    template<typename T = void>
+    class Task;
+
+    namespace detail {
+        struct Runner;
+
+        struct PromiseBase {
+            std::shared_ptr<CancelState> cancelState = std::make_shared<CancelState>();
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+            // Spawned tasks have no owner and free their frame when done
+            bool detached = false;
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+                template<typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> finished) noexcept {
+                    PromiseBase& promise = finished.promise();
+                    if (promise.continuation) {
+                        return promise.continuation;
+                    }
+                    if (promise.detached) {
+                        finished.destroy();
+                    }
+                    return std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+            void unhandled_exception() { exception = std::current_exception(); }
+        };
+
+        template<typename T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+
+            Task<T> get_return_object();
+            template<typename U>
+            void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+            T result() {
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+                return std::move(*value);
+            }
+        };
+
+        template<>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object();
+            void return_void() const noexcept {}
+            void result() {
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+
+        struct DeleteLater {
+            void operator()(QObject* object) const {
+                if (object) {
+                    object->deleteLater();
+                }
+            }
+        };
+    }
+
+    template<typename T>
+    class Task {
+    public:
+        using promise_type = detail::Promise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        // Cancellation of the task and everything it awaits
+        std::shared_ptr<CancelState> cancelState() const { return handle.promise().cancelState; }
+
+        bool await_ready() const noexcept { return false; }
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> awaiting) {
+            handle.promise().cancelState = awaiting.promise().cancelState;
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().result(); }
+
+    private:
+        friend struct detail::Promise<T>;
+        friend struct detail::Runner;
+
+        explicit Task(Handle handle) : handle(handle) {}
+
+        void startDetached() {
+            Handle started = std::exchange(handle, {});
+            started.promise().detached = true;
+            started.resume();
+        }
+
+        Handle handle;
+    };
+
+    namespace detail {
+        template<typename T>
+        Task<T> Promise<T>::get_return_object() {
+            return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+        }
+
+        inline Task<void> Promise<void>::get_return_object() {
+            return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+        }
+
+        template<typename T>
+        Task<> drive(Task<T> task, QPointer<QObject> context, std::function<void(T)> done) {
+            try {
+                T result = co_await std::move(task);
+                if (done && context) {
+                    done(std::move(result));
+                }
+            }
+            catch (const std::exception& error) {
+                qWarning() << "Async task failed:" << error.what();
+            }
+        }
+
+        inline Task<> drive(Task<> task, QPointer<QObject> context, std::function<void()> done) {
+            try {
+                co_await std::move(task);
+                if (done && context) {
+                    done();
+                }
+            }
+            catch (const std::exception& error) {
+                qWarning() << "Async task failed:" << error.what();
+            }
+        }
+
+        struct Runner {
+            static std::shared_ptr<CancelState> start(Task<> runner, QObject* context) {
+                std::shared_ptr<CancelState> state = runner.cancelState();
+                if (context) {
+                    QObject::connect(context, &QObject::destroyed, [state]() { state->cancel(); });
+                }
+                runner.startDetached();
+                return state;
+            }
+        };
+    }
+
+    // Runs `task` as an outermost coroutine, up to its first suspension right away.
+    // Destroying `context` cancels it, and `done` is then skipped.
+    template<typename T>
+    std::shared_ptr<CancelState> spawn(Task<T> task, QObject* context,
+        std::type_identity_t<std::function<void(T)>> done = {}) {
+        return detail::Runner::start(detail::drive(std::move(task), context, std::move(done)), context);
+    }
+
+    inline std::shared_ptr<CancelState> spawn(Task<> task, QObject* context, std::function<void()> done = {}) {
+        return detail::Runner::start(detail::drive(std::move(task), context, std::move(done)), context);
+    }
+
+    // Deletes from the event loop, for objects that may still be emitting when the
+    // coroutine owning them returns
+    template<typename T>
+    using Owned = std::unique_ptr<T, detail::DeleteLater>;
+
+    // Waits for one emission of a signal and returns its arguments: nothing, the single
+    // argument or a std::tuple. Resumes with default values if the sender is destroyed
+    // first. `onCancel` runs on cancellation and should make the sender emit.
+    template<typename Sender, typename... Args>
+    class SignalAwaiter {
+    public:
+        using Signal = void (Sender::*)(Args...);
+        using Values = std::tuple<std::decay_t<Args>...>;
+
+        SignalAwaiter(Sender* sender, Signal signal, std::function<void()> onCancel)
+            : sender(sender), signal(signal), onCancel(std::move(onCancel)) {}
+
+        bool await_ready() const noexcept { return !sender; }
+        template<typename P>
+        void await_suspend(std::coroutine_handle<P> awaiting) {
+            cancelState = awaiting.promise().cancelState;
+            emitted = QObject::connect(sender.data(), signal, [this, awaiting](Args... args) {
+                values.emplace(args...);
+                resume(awaiting);
+            });
+            destroyed = QObject::connect(sender.data(), &QObject::destroyed, [this, awaiting]() { resume(awaiting); });
+            if (!onCancel) {
+                return;
+            }
+            if (cancelState->isCanceled()) {
+                // Queued, the sender may answer synchronously and we are still suspending
+                QMetaObject::invokeMethod(sender.data(), onCancel, Qt::QueuedConnection);
+            }
+            else {
+                subscription = cancelState->subscribe(onCancel);
+            }
+        }
+        auto await_resume() {
+            QObject::disconnect(emitted);
+            QObject::disconnect(destroyed);
+            if (cancelState) {
+                cancelState->unsubscribe(subscription);
+            }
+            if constexpr (sizeof...(Args) == 1) {
+                return std::get<0>(values ? std::move(*values) : Values());
+            }
+            else if constexpr (sizeof...(Args) > 1) {
+                return values ? std::move(*values) : Values();
+            }
+        }
+
+    private:
+        void resume(std::coroutine_handle<> awaiting) {
+            if (!resumed) {
+                resumed = true;
+                awaiting.resume();
+            }
+        }
+
+        QPointer<Sender> sender;
+        Signal signal;
+        std::function<void()> onCancel;
+        std::shared_ptr<CancelState> cancelState;
+        std::optional<Values> values;
+        QMetaObject::Connection emitted;
+        QMetaObject::Connection destroyed;
+        int subscription = -1;
+        bool resumed = false;
+    };
+
+    template<typename Sender, typename Class, typename... Args>
+    SignalAwaiter<Class, Args...> signal(Sender* sender, void (Class::*signal)(Args...), std::function<void()> onCancel = {}) {
+        return SignalAwaiter<Class, Args...>(sender, signal, std::move(onCancel));
+    }
+
+    // Adapts a callback-style API: `start` gets the completion callback, which may also
+    // be called before `start` returns
+    template<typename T>
+    class CallbackAwaiter {
+    public:
+        using Start = std::function<void(std::function<void(T)>)>;
+
+        explicit CallbackAwaiter(Start start) : start(std::move(start)) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> awaiting) {
+            starting = true;
+            start([this, awaiting](T result) {
+                value.emplace(std::move(result));
+                if (!starting) {
+                    awaiting.resume();
+                }
+            });
+            starting = false;
+            return !value;
+        }
+        T await_resume() { return std::move(*value); }
+
+    private:
+        Start start;
+        std::optional<T> value;
+        bool starting = false;
+    };
+
+    template<typename T>
+    CallbackAwaiter<T> callback(typename CallbackAwaiter<T>::Start start) {
+        return CallbackAwaiter<T>(std::move(start));
+    }
+
+    // co_await Async::canceled() tells whether the running task chain was cancelled
+    class CanceledCheck {
+    public:
+        bool await_ready() const noexcept { return false; }
+        template<typename P>
+        bool await_suspend(std::coroutine_handle<P> awaiting) noexcept {
+            cancelState = awaiting.promise().cancelState;
+            return false;
+        }
+        bool await_resume() const noexcept { return cancelState->isCanceled(); }
+
+    private:
+        std::shared_ptr<CancelState> cancelState;
+    };
+
+    inline CanceledCheck canceled() {
+        return CanceledCheck();
+    }
+}
+
+#endif // ASYNC_TASK_H
@@ -0,0 +1,78 @@
+#ifndef AUTOMATION_API_H
+#define AUTOMATION_API_H
+
+#include <QObject>
+#include <QHash>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QSet>
+#include <QWebSocket>
+#include "async_task.h"
+
+// JSON-RPC 2.0 over the local WebSocket of the login server, for scripts and tooling.
+// A client authenticates with the per-install token from the "automation_token" file
+// next to the config, either as ?token= on the socket URL or through "auth.login".
+// Requests may be batched. Responses that carry bytes ("capture.last") go out as their
+// own binary frame: a 4-byte big-endian length, the JSON-RPC response, then the bytes.
+//
+// Methods: auth.login {token}, capture.interactive, capture.fullscreen,
+// capture.last {format: png|jpg|webp|raw, quality}, queue.status,
+// metrics.get {format: json|prometheus}, events.subscribe {events}, events.unsubscribe {events}.
+// Events arrive as "event" notifications: capture.saved, capture.indexed, queue.changed.
+class AutomationApi : public QObject {
+    Q_OBJECT
+public:
+    explicit AutomationApi(QObject* parent = nullptr);
+
+    void addClient(QWebSocket* client);
+    void removeClient(QWebSocket* client);
+    // A JSON-RPC request or batch from `client`
+    void handleMessage(QWebSocket* client, const QJsonDocument& message);
+
+    static bool isRpcMessage(const QJsonDocument& document);
+
+public slots:
+    void onCaptureSaved(const QString& filePath, const QImage& image);
+
+signals:
+    // Connected directly, the capture is saved by the time the signal returns
+    void fullscreenCaptureRequested();
+    void interactiveCaptureRequested();
+
+private:
+    struct Response {
+        QJsonObject message;
+        // Whole binary frame, response included, when the result carries bytes
+        QByteArray frame;
+    };
+
+    struct Client {
+        bool authenticated = false;
+        QSet<QString> events;
+    };
+
+    Async::Task<> handle(QPointer<QWebSocket> client, QJsonDocument message);
+    Async::Task<Response> dispatch(QPointer<QWebSocket> client, QJsonObject request);
+    Async::Task<Response> lastCapture(QJsonValue id, QJsonObject params);
+    QJsonObject queueStatus() const;
+    QJsonObject captureInfo() const;
+    void send(QWebSocket* client, const Response& response);
+    bool isSubscribed(const QString& event) const;
+    bool hasAuthenticatedClient() const;
+    void publish(const QString& event, const QJsonObject& data);
+
+    static QString loadToken();
+
+    QString token;
+    QHash<QWebSocket*, Client> clients;
+    QString lastCapturePath;
+    QSize lastCaptureSize;
+    // Kept only while an authenticated client is connected
+    QImage lastCaptureImage;
+    quint64 captureCount;
+};
+
+#endif // AUTOMATION_API_H
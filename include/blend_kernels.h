@@ -0,0 +1,95 @@
+#ifndef BLEND_KERNELS_H
+#define BLEND_KERNELS_H
+
+#include <QImage>
+#include <QtGlobal>
+#include <QRgb>
+
+// Span blenders used by the layer compositor. Sources are always premultiplied
+// ARGB32; each (blend mode, destination format) pair is its own instantiation so
+// the per-pixel loop carries no format or mode branches.
+enum class BlendMode {
+    SourceOver,
+    Multiply
+};
+
+namespace BlendKernels {
+    using SpanFunction = void (*)(const quint32* src, quint32* dst, int count);
+
+    // Multiplies each 8-bit channel of x by a / 255, two channels per multiply
+    inline quint32 byteMul(quint32 x, uint a) {
+        quint32 t = (x & 0xff00ff) * a;
+        t = (t + ((t >> 8) & 0xff00ff) + 0x800080) >> 8;
+        t &= 0xff00ff;
+
+        x = ((x >> 8) & 0xff00ff) * a;
+        x = (x + ((x >> 8) & 0xff00ff) + 0x800080);
+        x &= 0xff00ff00;
+        return x | t;
+    }
+
+    inline uint mul255(uint a, uint b) {
+        uint t = a * b + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    template <BlendMode Mode, QImage::Format DstFormat>
+    void blendSpan(const quint32* src, quint32* dst, int count) {
+        static_assert(DstFormat == QImage::Format_RGB32 || DstFormat == QImage::Format_ARGB32_Premultiplied,
+            "Unsupported destination format");
+        constexpr bool opaqueDst = DstFormat == QImage::Format_RGB32;
+
+        for (int i = 0; i < count; ++i) {
+            const quint32 s = src[i];
+            const uint sa = qAlpha(s);
+            if (sa == 0) {
+                continue;
+            }
+
+            if constexpr (Mode == BlendMode::SourceOver) {
+                if (sa == 255) {
+                    dst[i] = s;
+                }
+                else {
+                    quint32 blended = s + byteMul(dst[i], 255 - sa);
+                    dst[i] = opaqueDst ? (blended | 0xff000000) : blended;
+                }
+            }
+            else if constexpr (Mode == BlendMode::Multiply) {
+                const quint32 d = dst[i];
+                if constexpr (opaqueDst) {
+                    // With an opaque destination s*d + d*(1 - sa) folds into a single factor
+                    dst[i] = 0xff000000
+                        | (mul255(qRed(d), qRed(s) + 255 - sa) << 16)
+                        | (mul255(qGreen(d), qGreen(s) + 255 - sa) << 8)
+                        | mul255(qBlue(d), qBlue(s) + 255 - sa);
+                }
+                else {
+                    const uint da = qAlpha(d);
+                    auto channel = [sa, da](uint sc, uint dc) {
+                        return qMin(255u, mul255(sc, dc) + mul255(sc, 255 - da) + mul255(dc, 255 - sa));
+                    };
+                    dst[i] = ((sa + da - mul255(sa, da)) << 24)
+                        | (channel(qRed(s), qRed(d)) << 16)
+                        | (channel(qGreen(s), qGreen(d)) << 8)
+                        | channel(qBlue(s), qBlue(d));
+                }
+            }
+        }
+    }
+
+    inline SpanFunction spanFunction(BlendMode mode, QImage::Format dstFormat) {
+        const bool opaqueDst = dstFormat == QImage::Format_RGB32;
+        switch (mode) {
+        case BlendMode::Multiply:
+            return opaqueDst ? &blendSpan<BlendMode::Multiply, QImage::Format_RGB32>
+                : &blendSpan<BlendMode::Multiply, QImage::Format_ARGB32_Premultiplied>;
+        case BlendMode::SourceOver:
+        default:
+            return opaqueDst ? &blendSpan<BlendMode::SourceOver, QImage::Format_RGB32>
+                : &blendSpan<BlendMode::SourceOver, QImage::Format_ARGB32_Premultiplied>;
+        }
+    }
+}
+
+#endif // BLEND_KERNELS_H
@@ -0,0 +1,87 @@
+#ifndef CAPTURE_SEARCH_H
+#define CAPTURE_SEARCH_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonObject>
+#include <QMap>
+#include <QStringList>
+#include <QVector>
+#include "async_task.h"
+
+// Full-text search over saved captures. After a save, the capture is read back and run
+// through OCR on the background lane of the job system, so neither saving nor publishing
+// ever waits for it. Captures go through one at a time, so a single OCR engine serves
+// them all and the idle trim can free it. Its words and the text of its annotations go into an inverted index:
+// a sorted word list pointing at ascending capture ids, where a query intersects the
+// lists of its words and matches the last word as a prefix. The index lives in memory and
+// in an append-only file next to the config, compacted like the publish index.
+class CaptureSearch : public QObject {
+    Q_OBJECT
+public:
+    struct Hit {
+        QString filePath;
+        QDateTime captured;
+    };
+
+    static CaptureSearch* instance();
+
+    // "ocr_enabled" turns OCR off, leaving annotation text only; "ocr_language" takes
+    // Tesseract language names such as "eng" or "eng+fra"
+    void applyConfig(const QJsonObject& config);
+
+    // Indexes the capture just saved to `filePath`, replacing an older entry for it
+    void addCapture(const QString& filePath, const QStringList& annotationText = QStringList());
+    // Frees the OCR engine, now or once the queued captures are indexed; the next capture
+    // loads it again
+    void releaseOcrEngine();
+    // Captures holding every word of `query`, newest first
+    QVector<Hit> search(const QString& query, int limit = 50);
+    int captureCount() const { return int(documents.size()) - deadCount; }
+
+    // Lowercased words of `text`, without duplicates
+    static QStringList tokenize(const QString& text);
+
+signals:
+    void captureIndexed(const QString& filePath);
+
+private:
+    struct Document {
+        QString filePath;
+        qint64 capturedMs = 0;
+        bool alive = true;
+    };
+
+    struct PendingCapture {
+        QString filePath;
+        QStringList annotationText;
+    };
+
+    explicit CaptureSearch(QObject* parent = nullptr);
+
+    Async::Task<> indexPending();
+    Async::Task<> indexCapture(QString filePath, QStringList annotationText);
+    void insert(const QString& filePath, qint64 capturedMs, const QStringList& words);
+    void remove(int id);
+    void load();
+    void append(const Document& document, const QStringList& words);
+    void compact();
+    // Ascending ids of the captures holding a word starting with `prefix`
+    QVector<quint32> prefixPostings(const QString& prefix) const;
+
+    QString indexPath;
+    QVector<Document> documents;
+    QHash<QString, int> documentByPath;
+    // Capture ids by word, ascending since ids only grow
+    QMap<QString, QVector<quint32>> postings;
+    int deadCount;
+    int lineCount;
+    QList<PendingCapture> pending;
+    bool indexing;
+    bool releaseEngineWhenIdle;
+    bool ocrEnabled;
+    QString ocrLanguage;
+};
+
+#endif // CAPTURE_SEARCH_H
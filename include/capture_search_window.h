@@ -0,0 +1,27 @@
+#ifndef CAPTURE_SEARCH_WINDOW_H
+#define CAPTURE_SEARCH_WINDOW_H
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QLabel>
+
+// Searches the saved captures while typing, refreshed as new captures get indexed;
+// activating a result opens the file
+class CaptureSearchWindow : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit CaptureSearchWindow(QWidget* parent = nullptr);
+
+private slots:
+    void updateResults();
+    void openResult(QListWidgetItem* item);
+
+private:
+    QLineEdit* queryEdit;
+    QListWidget* resultList;
+    QLabel* statusLabel;
+};
+
+#endif // CAPTURE_SEARCH_WINDOW_H
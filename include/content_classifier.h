@@ -0,0 +1,31 @@
+#ifndef CONTENT_CLASSIFIER_H
+#define CONTENT_CLASSIFIER_H
+
+#include <QImage>
+#include <QString>
+
+// Cheap statistics over a subsampled grid of the capture
+struct ContentAnalysis {
+    int sampledColors = 0;         // distinct colours among the samples, capped at ContentClassifier::ColorCap
+    double gradientEntropy = 0.0;  // entropy of the luma gradient histogram, in bits
+    double edgeDensity = 0.0;      // share of samples on a strong edge
+    double flatFraction = 0.0;     // share of samples with no gradient at all
+    double elapsedMs = 0.0;
+
+    bool isPhotographic() const;
+};
+
+// Tells interface content (flat areas, few colours, hard edges) from photographic
+// content, to pick a lossless or a lossy format for it.
+class ContentClassifier {
+public:
+    static const int ColorCap = 1024;
+
+    static ContentAnalysis analyze(const QImage& image);
+
+    // `configured` unless it is "auto", in which case png for interface content and
+    // webp (when the image plugin is there) or jpg for photographic content
+    static QString chooseExtension(const QImage& image, const QString& configured);
+};
+
+#endif // CONTENT_CLASSIFIER_H
@@ -0,0 +1,21 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <QString>
+#include <QtGlobal>
+
+// XXH3 (64-bit, seed 0, default secret) of encoded capture bytes, bit-compatible with
+// the reference xxHash so a server can compute the same value. Inputs above 240 bytes
+// run the striped accumulator loop with SSE2.
+class ContentHash {
+public:
+    static quint64 xxh3(const void* data, qsizetype length);
+
+    // Hash of a file's bytes, read through a memory map. Sets *ok to false when the
+    // file cannot be read.
+    static quint64 ofFile(const QString& filePath, bool* ok = nullptr);
+
+    static QString toHex(quint64 hash);
+};
+
+#endif // CONTENT_HASH_H
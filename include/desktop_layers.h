@@ -0,0 +1,44 @@
+#ifndef DESKTOP_LAYERS_H
+#define DESKTOP_LAYERS_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include "layer_stack.h"
+
+// Annotation layers over a capture that spans screens. Each screen keeps its own
+// LayerStack over its own grab, at that screen's ratio, so nothing is resampled while
+// editing. Annotations are in desktop coordinates and go to every stack; reads and undo
+// follow the first one, which the others mirror.
+class DesktopLayers {
+public:
+    // `area` is the screen's part of the desktop, `scale` maps it to `background`'s pixels
+    void addScreen(const QImage& background, const QRect& area, qreal scale);
+
+    int screenCount() const { return int(screens.size()); }
+    LayerStack& screen(int index) { return screens[index].layers; }
+
+    void addAnnotation(LayerStack::LayerId layer, const Annotation& annotation);
+    void updateAnnotation(LayerStack::LayerId layer, int index, const Annotation& annotation, bool recordUndo);
+    bool undo();
+    void removeAnnotation(LayerStack::LayerId layer, int index);
+    bool isEmpty() const { return screens.isEmpty() || screens.first().layers.isEmpty(); }
+    const QVector<Annotation>& annotations(LayerStack::LayerId layer) const;
+
+    // Highest ratio among the screens `area` touches
+    qreal scale(const QRect& area) const;
+    // `area` of `layer` and everything below it, composed at scale(area). An area on one
+    // screen is a plain copy of that screen's pixels; only areas across screens of
+    // different ratios resample the lower ones.
+    QImage render(const QRect& area, LayerStack::LayerId layer = LayerStack::Text);
+
+private:
+    struct Screen {
+        QRect area;
+        LayerStack layers;
+    };
+
+    QVector<Screen> screens;
+};
+
+#endif // DESKTOP_LAYERS_H
@@ -18,7 +18,9 @@ public:
         Rectangle,
         Ellipse,
         Line,
-        Arrow
+        Arrow,
+        Highlight,
+        Redact
     };
     QColor currentColor;
 
@@ -33,6 +35,7 @@ signals:
     void saveRequested();
     void copyRequested();
     void publishRequested();
+    void scrollCaptureRequested();
     void closeRequested();
 
 public slots:
@@ -0,0 +1,97 @@
+#ifndef EVDEV_HOTKEYS_H
+#define EVDEV_HOTKEYS_H
+
+#include <QtGlobal>
+
+#if defined(Q_OS_LINUX)
+#include <QHash>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "ukeysequence.h"
+
+class QSocketNotifier;
+
+// Global hotkeys read straight from the keyboards under /dev/input, for sessions where
+// X11 key grabs are unavailable (Wayland, no X connection) or lose to another grabber.
+// Needs read access to the event devices, usually membership of the "input" group.
+// A reader thread waits on every keyboard with epoll and keeps each keyboard's modifier
+// state from its own key events, so a press is one lookup in a table indexed by key code
+// and modifier set. Hits reach the GUI thread through a lock-free single-producer queue
+// and an eventfd, without a lock on the input path.
+class EvdevHotkeys {
+public:
+    enum Modifier {
+        Control = 1,
+        Shift = 2,
+        Alt = 4,
+        Meta = 8
+    };
+
+    // `activated` runs on the thread that called start()
+    explicit EvdevHotkeys(std::function<void(size_t)> activated);
+    ~EvdevHotkeys();
+
+    // Opens the keyboards and starts the reader. Keyboards plugged in later, including
+    // uinput devices, are picked up while it runs. False when /dev/input is unusable.
+    bool start();
+    bool registerHotkey(const UKeySequence& keySeq, size_t id);
+    void unregisterHotkey(size_t id);
+
+    // Linux key code for a Qt key, 0 when it has none
+    static int keyCode(int qtKey);
+
+    // Drives the backend with a uinput virtual keyboard: activation through a hotplugged
+    // device, modifier tracking and the resync after the kernel drops events. Needs
+    // write access to /dev/uinput. 0 when every check passes, 1 on a failure, 2 when the
+    // keyboard cannot be created.
+    static int selfTest();
+
+private:
+    struct Device {
+        int fd = -1;
+        QString path;
+        // Pressed modifier keys, one bit per key in ModifierKeys order
+        quint8 pressed = 0;
+        // The kernel dropped events, skip to the next report and ask for the key state
+        bool dropped = false;
+    };
+
+    static const int ModifierSets = 16;
+    static const int QueueSize = 64;
+
+    void run();
+    void openDevice(const QString& path);
+    void closeDevice(Device* device);
+    void readDevice(Device* device);
+    void readHotplug();
+    void syncModifiers(Device* device);
+    void handleKey(Device* device, int code, int value);
+    void post(quint32 id);
+    void drain();
+
+    std::function<void(size_t)> activated;
+    // Hotkey id by key code * ModifierSets + modifier set, 0 when unused
+    std::unique_ptr<std::atomic<quint32>[]> table;
+    // Table slot by hotkey id, GUI thread only
+    QHash<size_t, int> slots;
+
+    int epollFd;
+    int inotifyFd;
+    int stopFd;
+    int wakeFd;
+    std::thread reader;
+    QSocketNotifier* notifier;
+    // Reader thread only
+    QHash<QString, Device*> devices;
+
+    // Single-producer queue from the reader to the GUI thread
+    quint32 queue[QueueSize];
+    std::atomic<quint32> queueHead;
+    std::atomic<quint32> queueTail;
+};
+#endif
+
+#endif // EVDEV_HOTKEYS_H
@@ -0,0 +1,72 @@
+#ifndef FRAME_BUFFER_POOL_H
+#define FRAME_BUFFER_POOL_H
+
+#include <QImage>
+#include <QJsonObject>
+#include <QHash>
+#include <QVector>
+#include <mutex>
+
+// Page-aligned pixel buffers for full-size frames, reused across captures instead of
+// going through the heap each time. Buffers are grouped in size classes a quarter of a
+// power of two apart, so every capture of the same screen lands in the same class.
+// Buffers come straight from the OS, optionally backed by huge pages, and never touch
+// the CRT heap of the long-running tray process.
+class FrameBufferPool {
+public:
+    struct Stats {
+        qint64 requests = 0;
+        qint64 hits = 0;
+        qint64 bytesInUse = 0;
+        qint64 peakBytesInUse = 0;
+        qint64 bytesCached = 0;
+        bool hugePages = false;
+
+        double hitRate() const { return requests > 0 ? double(hits) / requests : 0.0; }
+    };
+
+    static FrameBufferPool* instance();
+
+    // Image over a pooled buffer, with undefined contents. The buffer returns to the pool
+    // once the image and every copy sharing it are gone, from any thread. Small images
+    // are allocated normally.
+    QImage image(const QSize& size, QImage::Format format);
+    // Pooled copy of `source`
+    QImage copy(const QImage& source, const QRect& area);
+
+    // "frame_pool_limit_mb" caps the bytes kept for reuse, "frame_pool_huge_pages"
+    // asks for huge/large pages where the OS grants them
+    void applyConfig(const QJsonObject& config);
+    // Returns cached buffers to the OS, keeping up to `keepBytes` of the largest classes
+    // for the next capture
+    void trim(qint64 keepBytes = 0);
+    Stats stats() const;
+
+private:
+    struct Buffer {
+        void* data = nullptr;
+        size_t size = 0;
+        // Allocated while huge pages were in use, sized in huge page steps
+        bool hugePages = false;
+    };
+
+    FrameBufferPool();
+
+    static void release(void* info);
+    static size_t classSize(size_t bytes, size_t pageSize);
+    Buffer allocate(size_t bytes);
+    static void unmap(const Buffer& buffer);
+    void recycle(Buffer* buffer);
+
+    mutable std::mutex mutex;
+    // Free buffers by class size
+    QHash<size_t, QVector<Buffer>> cached;
+    qint64 cacheLimit;
+    bool wantHugePages;
+    // Huge page size once the OS granted them, 0 when unavailable
+    size_t hugePageSize;
+    bool hugePagesTried;
+    Stats counters;
+};
+
+#endif // FRAME_BUFFER_POOL_H
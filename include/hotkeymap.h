@@ -7,6 +7,9 @@ inline size_t QtKeyToWin(size_t key) {
     if (key >= 0x01000030 && key <= 0x01000047) {
         return VK_F1 + (key - Qt::Key_F1);
     }
+    if (key == Qt::Key_Print) {
+        return VK_SNAPSHOT;
+    }
 
     return key;
 }
@@ -36,6 +39,8 @@ inline UKeyData QtKeyToLinux(const UKeySequence &keySeq)
     if (data.key >= Qt::Key_F1 && data.key <= Qt::Key_F35) {
         const size_t DIFF = Qt::Key_F1 - XK_F1;
         data.key -= DIFF;
+    } else if (data.key == Qt::Key_Print) {
+        data.key = XK_Print;
     } else if (data.key >= Qt::Key_Space && data.key <= Qt::Key_QuoteLeft) {
         // conversion is not necessary, if the value in the range Qt::Key_Space - Qt::Key_QuoteLeft
     } else {
@@ -0,0 +1,24 @@
+#ifndef HTTP_POST_BACKEND_H
+#define HTTP_POST_BACKEND_H
+
+#include "upload_backend.h"
+
+// Any endpoint that takes a multipart/form-data POST. The link is read from a JSON
+// field of the response, then the Location header, then a plain-text body.
+class HttpPostBackend : public UploadBackend {
+    Q_OBJECT
+public:
+    explicit HttpPostBackend(const QJsonObject& config, QObject* parent = nullptr);
+
+    QString name() const override { return "HTTP"; }
+    QString target() const override { return url.toString(); }
+    UploadTask* upload(const UploadSource& source, UploadPriority priority) override;
+
+private:
+    QUrl url;
+    QByteArray fieldName;
+    QString linkField;
+    QByteArray authorization;
+};
+
+#endif // HTTP_POST_BACKEND_H
@@ -0,0 +1,30 @@
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include <QImage>
+#include <QVector>
+#include <QRect>
+#include <QJsonObject>
+
+struct ImageDiffResult {
+    QSize size;
+    int tolerance = 0;
+    qint64 changedPixels = 0;
+    double elapsedMs = 0.0;
+    QVector<QRect> regions;
+    QImage highlighted;
+
+    bool isIdentical() const { return changedPixels == 0 && regions.isEmpty(); }
+    QJsonObject toJson() const;
+};
+
+// Before/after comparison of two captures. A pixel counts as changed when any channel
+// differs by more than `tolerance`; changed pixels are then grouped into bounding boxes.
+// When the sizes differ, the area only one of them covers counts as changed.
+class ImageDiff {
+public:
+    static ImageDiffResult compare(const QImage& before, const QImage& after, int tolerance = 0);
+    static bool exportResult(const ImageDiffResult& result, const QString& imagePath, int quality = -1);
+};
+
+#endif // IMAGE_DIFF_H
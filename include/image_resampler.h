@@ -0,0 +1,22 @@
+#ifndef IMAGE_RESAMPLER_H
+#define IMAGE_RESAMPLER_H
+
+#include <QImage>
+#include <QSize>
+
+// Separable Lanczos-3 downscaler used on the save and publish paths. Weights are
+// precomputed once per axis in 14-bit fixed point and applied two taps at a time
+// with SSE2 multiply-add, horizontally first and then vertically.
+class ImageResampler {
+public:
+    static QImage downscale(const QImage& source, const QSize& size);
+
+    // Size an export should be written at: the longest side capped to `maxDimension`
+    // (0 disables the cap) after scaling by `scalePercent`. Never upscales.
+    static QSize exportSize(const QSize& source, int maxDimension, int scalePercent = 100);
+
+    // Peak signal-to-noise ratio over the colour channels, in dB
+    static double psnr(const QImage& reference, const QImage& image);
+};
+
+#endif // IMAGE_RESAMPLER_H
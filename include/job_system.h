@@ -0,0 +1,186 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <QObject>
+#include <QCoreApplication>
+#include <QThread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "async_task.h"
+
+// Cancels one job. A job dropped before it started never runs; a running one is
+// expected to poll isCanceled() between steps.
+class JobToken {
+public:
+    bool isCanceled() const { return canceled.load(std::memory_order_relaxed); }
+    void cancel() { canceled.store(true, std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> canceled{ false };
+};
+
+// Worker threads for image work, one per core, with two priority lanes. Every worker
+// owns a deque per lane: it pops its own newest job and steals the oldest of another
+// worker when it runs dry. Interactive jobs are always taken first, and background jobs
+// never occupy the last free worker, so an interactive job starts without waiting for
+// one to finish.
+class JobSystem : public QObject {
+    Q_OBJECT
+public:
+    enum class Lane {
+        // Someone is waiting: flattening, encoding for the clipboard or an upload
+        Interactive,
+        // Thumbnails, re-optimization, dedupe hashing, queued uploads
+        Background
+    };
+
+    struct LaneStats {
+        int queued = 0;
+        int running = 0;
+        qint64 completed = 0;
+        qint64 canceled = 0;
+        // Time between submit and start, over the last WaitSamples jobs
+        double meanWaitMs = 0.0;
+        double p95WaitMs = 0.0;
+        double maxWaitMs = 0.0;
+    };
+
+    explicit JobSystem(int workerCount = QThread::idealThreadCount(), QObject* parent = nullptr);
+    ~JobSystem() override;
+
+    static JobSystem* instance();
+
+    // Queues `job` on `lane`. Destroying `owner` cancels it like the returned token.
+    std::shared_ptr<JobToken> submit(Lane lane, std::function<void(const JobToken&)> job, QObject* owner = nullptr);
+
+    LaneStats stats(Lane lane) const;
+    int workerCount() const { return int(workers.size()); }
+
+    template<typename F>
+    class Awaiter;
+
+    // co_await JobSystem::instance()->run(lane, fn): `fn(const JobToken&)` on a worker,
+    // resuming on the GUI thread. Cancelling the awaiting task cancels the job.
+    template<typename F>
+    Awaiter<std::decay_t<F>> run(Lane lane, F&& fn) {
+        return Awaiter<std::decay_t<F>>(this, lane, std::forward<F>(fn));
+    }
+
+private:
+    static const int LaneCount = 2;
+    static const int WaitSamples = 256;
+
+    struct Job {
+        std::function<void(const JobToken&)> run;
+        std::shared_ptr<JobToken> token;
+        QMetaObject::Connection ownerConnection;
+        Lane lane = Lane::Interactive;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> lanes[LaneCount];
+        std::thread thread;
+    };
+
+    struct Metrics {
+        qint64 completed = 0;
+        qint64 canceled = 0;
+        std::vector<double> waits;
+        int nextWait = 0;
+        double maxWait = 0.0;
+    };
+
+    void work(int index);
+    bool take(int index, Job* job);
+    bool takeFrom(int index, Lane lane, Job* job);
+    bool hasRunnable() const;
+    void execute(Job& job);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<int> queued[LaneCount];
+    std::atomic<int> running[LaneCount];
+    std::atomic<unsigned> nextWorker;
+    int maxBackground;
+    bool stopping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    mutable std::mutex metricsMutex;
+    Metrics metrics[LaneCount];
+};
+
+template<typename F>
+class JobSystem::Awaiter {
+public:
+    using Result = std::invoke_result_t<F&, const JobToken&>;
+
+    Awaiter(JobSystem* system, Lane lane, F fn) : system(system), lane(lane), fn(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+    template<typename P>
+    void await_suspend(std::coroutine_handle<P> awaiting) {
+        cancelState = awaiting.promise().cancelState;
+        // Resumes once the job is gone, whether it ran or was dropped unstarted
+        auto completion = std::make_shared<Completion>(awaiting);
+        token = system->submit(lane, [this, completion](const JobToken& jobToken) {
+            try {
+                if constexpr (std::is_void_v<Result>) {
+                    fn(jobToken);
+                    value.emplace();
+                }
+                else {
+                    value.emplace(fn(jobToken));
+                }
+            }
+            catch (...) {
+                exception = std::current_exception();
+            }
+        });
+        if (cancelState->isCanceled()) {
+            token->cancel();
+        }
+        else {
+            subscription = cancelState->subscribe([jobToken = token]() { jobToken->cancel(); });
+        }
+    }
+    // Empty when the job was cancelled before it ran
+    std::optional<std::conditional_t<std::is_void_v<Result>, std::monostate, Result>> await_resume() {
+        cancelState->unsubscribe(subscription);
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(value);
+    }
+
+private:
+    struct Completion {
+        explicit Completion(std::coroutine_handle<> awaiting) : awaiting(awaiting) {}
+        ~Completion() {
+            // Gone during shutdown, there is no loop left to resume on
+            if (QCoreApplication* app = QCoreApplication::instance()) {
+                std::coroutine_handle<> handle = awaiting;
+                QMetaObject::invokeMethod(app, [handle]() { handle.resume(); }, Qt::QueuedConnection);
+            }
+        }
+        std::coroutine_handle<> awaiting;
+    };
+
+    JobSystem* system;
+    Lane lane;
+    F fn;
+    std::shared_ptr<JobToken> token;
+    std::shared_ptr<Async::CancelState> cancelState;
+    std::optional<std::conditional_t<std::is_void_v<Result>, std::monostate, Result>> value;
+    std::exception_ptr exception;
+    int subscription = -1;
+};
+
+#endif // JOB_SYSTEM_H
@@ -0,0 +1,83 @@
+#ifndef LAYER_STACK_H
+#define LAYER_STACK_H
+
+#include <QImage>
+#include <QVector>
+#include <QRect>
+#include "annotation.h"
+#include "blend_kernels.h"
+
+// Capture plus annotation layers, bottom to top. Every layer keeps its own raster and
+// a cached composite of itself over everything below it. Changes mark fixed-size tiles
+// dirty from the changed layer upward, so editing one layer only recomposites the
+// tiles it touched, and only from that layer up.
+class LayerStack {
+public:
+    enum LayerId {
+        Background,
+        Redactions,
+        Highlights,
+        Shapes,
+        Text,
+        LayerCount
+    };
+
+    // `origin` is where the background's top left sits in the logical coordinates the
+    // annotations use, for a stack that holds only part of them
+    explicit LayerStack(const QImage& background = QImage(), qreal scale = 1.0, const QPoint& origin = QPoint());
+
+    void addAnnotation(LayerId layer, const Annotation& annotation);
+    void updateAnnotation(LayerId layer, int index, const Annotation& annotation, bool recordUndo);
+    bool undo();
+    // Drops the annotation along with the undo steps that refer to it, leaving the rest of
+    // the history usable
+    void removeAnnotation(LayerId layer, int index);
+    bool isEmpty() const { return history.isEmpty(); }
+    const QVector<Annotation>& annotations(LayerId layer) const { return layers[layer].annotations; }
+
+    const QImage& background() const { return layers[Background].composite; }
+    const QImage& composite();
+    // Composite of `layer` and everything below it, for exporters that write the layers above separately
+    const QImage& flattened(LayerId layer);
+    QImage render(const QRect& imageArea);
+
+    qreal scale() const { return scaleFactor; }
+    QRect mapToImage(const QRectF& logicalRect) const;
+
+    static LayerId layerFor(Annotation::Kind kind);
+    static BlendMode blendMode(LayerId layer);
+
+private:
+    struct Layer {
+        QImage raster;
+        QImage composite;
+        QVector<Annotation> annotations;
+        bool used = false;
+    };
+
+    void ensureLayer(LayerId layer);
+    void paintAnnotation(QPainter& painter, const Annotation& annotation);
+    void repaintArea(LayerId layer, const QRect& imageArea);
+    void markDirty(LayerId layer, const QRect& imageArea);
+    void compositeTile(int tile);
+    int topLayer() const;
+
+    struct HistoryEntry {
+        LayerId layer;
+        int index;
+        bool replaced;
+        Annotation previous;
+    };
+
+    Layer layers[LayerCount];
+    QVector<HistoryEntry> history;
+    // Lowest layer that has to be recomposited for each tile, LayerCount when clean
+    QVector<quint8> dirtyFrom;
+    int tilesWide;
+    int tilesHigh;
+    bool anyDirty;
+    qreal scaleFactor;
+    QPoint originPoint;
+};
+
+#endif // LAYER_STACK_H
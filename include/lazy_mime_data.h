@@ -0,0 +1,29 @@
+#ifndef LAZY_MIME_DATA_H
+#define LAZY_MIME_DATA_H
+
+#include <QMimeData>
+#include <QImage>
+#include <QHash>
+#include <QStringList>
+
+// Clipboard payload that only advertises image formats. Each format is encoded
+// the first time a consumer asks for it and then kept for subsequent pastes.
+class LazyImageMimeData : public QMimeData {
+    Q_OBJECT
+public:
+    explicit LazyImageMimeData(const QImage& image);
+
+    bool hasFormat(const QString& mimeType) const override;
+    QStringList formats() const override;
+
+protected:
+    QVariant retrieveData(const QString& mimeType, QMetaType type) const override;
+
+private:
+    QByteArray encode(const QString& mimeType) const;
+
+    QImage image;
+    mutable QHash<QString, QByteArray> encodedCache;
+};
+
+#endif // LAZY_MIME_DATA_H
@@ -6,22 +6,29 @@
 #include <QWebSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include "automation_api.h"
 
 class LoginServer : public QObject {
     Q_OBJECT
 public:
     explicit LoginServer(QObject* parent = nullptr);
 
+    AutomationApi* automation() const { return automationApi; }
+
 signals:
     void userLoggedIn(const QString& id, const QString& email, const QString& nickname, const QString& token);
 
 public slots:
     void onNewConnection();
     void processTextMessage(QString message);
+    void processBinaryMessage(QByteArray message);
     void socketDisconnected();
 
 private:
+    void processMessage(QWebSocket* client, const QByteArray& message);
+
     QWebSocketServer* webSocketServer;
+    AutomationApi* automationApi;
     QList<QWebSocket*> clients;
 };
 
@@ -7,6 +7,7 @@
 #include "screenshotdisplay.h"
 #include "config_manager.h"
 #include "UGlobalHotkeys.h"
+#include "memory_trimmer.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -22,10 +23,12 @@ public slots:
 
 signals:
     void screenshotClosed();
+    void captureSaved(const QString& filePath, const QImage& image);
 
 private:
     QPointer<ScreenshotDisplay> screenshotDisplay;
     ConfigManager* configManager;
     UGlobalHotkeys* hotkeyManager;
+    MemoryTrimmer* memoryTrimmer;
     bool isScreenshotDisplayed;
 };
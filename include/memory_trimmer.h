@@ -0,0 +1,42 @@
+#ifndef MEMORY_TRIMMER_H
+#define MEMORY_TRIMMER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QTimer>
+
+// Returns memory to the OS once a capture session is over. The overlay, its layers and
+// the encoders leave freed heap and cached frames behind that a tray app idling all day
+// has no use for. Runs a few seconds after the editor closes, unless a new capture
+// starts first.
+class MemoryTrimmer : public QObject {
+    Q_OBJECT
+public:
+    struct Result {
+        qint64 residentBefore = -1;
+        qint64 residentAfter = -1;
+        qint64 elapsedMs = 0;
+    };
+
+    explicit MemoryTrimmer(QObject* parent = nullptr);
+
+    // "idle_pool_keep_mb" is the low-water mark of pooled frame buffers kept for the
+    // next capture
+    void applyConfig(const QJsonObject& config);
+    // (Re)starts the delay before trimming
+    void schedule();
+    void cancel();
+    Result trim();
+
+    // Resident set (working set on Windows) of this process, -1 when unknown
+    static qint64 residentBytes();
+
+signals:
+    void trimmed(const MemoryTrimmer::Result& result);
+
+private:
+    QTimer delay;
+    qint64 poolKeepBytes;
+};
+
+#endif // MEMORY_TRIMMER_H
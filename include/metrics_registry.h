@@ -0,0 +1,101 @@
+#ifndef METRICS_REGISTRY_H
+#define METRICS_REGISTRY_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QMap>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Counters, latency histograms and gauges describing capture health. Counters and
+// histograms are lock-free to update from any thread; call sites look theirs up once
+// and keep the pointer. Gauges are read through a callback when exporting, on the GUI
+// thread. The registry writes the Prometheus text format to "metrics.prom" next to the
+// config at a fixed interval, for a textfile collector to scrape, and the automation
+// API serves the same values on request.
+class MetricsRegistry : public QObject {
+    Q_OBJECT
+public:
+    class Counter {
+    public:
+        void add(qint64 amount = 1) { count.fetch_add(amount, std::memory_order_relaxed); }
+        qint64 value() const { return count.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<qint64> count{ 0 };
+    };
+
+    class Histogram {
+    public:
+        explicit Histogram(const QVector<double>& bounds);
+
+        void observe(double seconds);
+        // Non-cumulative count per bucket, the last one past every bound
+        QVector<qint64> bucketCounts() const;
+        qint64 count() const { return total.load(std::memory_order_relaxed); }
+        double sum() const { return sumMicros.load(std::memory_order_relaxed) / 1e6; }
+        const QVector<double>& bounds() const { return upperBounds; }
+
+    private:
+        QVector<double> upperBounds;
+        std::unique_ptr<std::atomic<qint64>[]> buckets;
+        std::atomic<qint64> total{ 0 };
+        std::atomic<qint64> sumMicros{ 0 };
+    };
+
+    // Seconds, from a quick grab to a slow upload
+    static const QVector<double>& latencyBuckets();
+
+    explicit MetricsRegistry(QObject* parent = nullptr);
+
+    static MetricsRegistry* instance();
+
+    // `labels` is the inside of the braces, e.g. lane="interactive". Asking again for
+    // the same name and labels returns the same metric.
+    Counter* counter(const QString& name, const QString& help, const QString& labels = QString());
+    Histogram* histogram(const QString& name, const QString& help, const QString& labels = QString(),
+        const QVector<double>& bounds = latencyBuckets());
+    // `read` runs on the exporting thread under the registry lock, it must not register metrics
+    void gauge(const QString& name, const QString& help, std::function<double()> read, const QString& labels = QString());
+
+    QString prometheusText() const;
+    QJsonObject toJson() const;
+
+    // "metrics_export_interval_s" sets how often metrics.prom is rewritten, 0 stops it
+    void applyConfig(const QJsonObject& config);
+    bool exportFile();
+
+private:
+    enum class Type {
+        Counter,
+        Histogram,
+        Gauge
+    };
+
+    struct Metric {
+        QString name;
+        QString labels;
+        QString help;
+        Type type = Type::Counter;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> read;
+    };
+
+    Metric* find(const QString& name, const QString& labels, Type type);
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Metric>> metrics;
+    // Metrics by name, in registration order within one name
+    QMap<QString, QVector<Metric*>> families;
+    QString filePath;
+    QTimer exportTimer;
+};
+
+#endif // METRICS_REGISTRY_H
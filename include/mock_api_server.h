@@ -0,0 +1,86 @@
+#ifndef MOCK_API_SERVER_H
+#define MOCK_API_SERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+// Local stand-in for the ScreenMe API used to exercise the upload path offline. It also
+// answers the S3 object and multipart calls and plain POSTs, for the other upload backends,
+// and implements the reservation and preview replacement protocol used for link-first
+// and progressive publishing.
+// Request bodies are drained at a capped rate, so client-side throttling and
+// scheduling can be observed against a slow link, and responses can be delayed,
+// failed at random or refused for authentication.
+class MockApiServer : public QObject {
+    Q_OBJECT
+public:
+    explicit MockApiServer(QObject* parent = nullptr);
+
+    bool listen(quint16 port = 0);
+    quint16 port() const { return server.serverPort(); }
+
+    // Bytes per second read from each connection, 0 for unlimited
+    void setBandwidth(qint64 bytesPerSecond);
+    // Delay before every response, plus up to `jitterMs` more
+    void setLatency(int latencyMs, int jitterMs = 0);
+    // Share of requests answered with 503, from 0 to 1
+    void setErrorRate(double rate);
+    // When set, /api/ requests without "Bearer <token>" get 403, and `failureRate` of
+    // the ones with it do too, as an expired session would
+    void setRequiredToken(const QByteArray& token, double failureRate = 0.0);
+    // When off, the bulk PATCH /api/screenshots answers 404 as a host without it would,
+    // so clients fall back to one PATCH per screenshot
+    void setBulkPrivacy(bool supported);
+
+signals:
+    void requestReceived(const QByteArray& method, const QByteArray& path, qint64 bodySize);
+
+private:
+    enum ContentStage {
+        Reserved,
+        Preview,
+        FullImage
+    };
+
+    struct Connection {
+        QByteArray header;
+        QByteArray method;
+        QByteArray path;
+        qint64 contentLength = -1;
+        qint64 received = 0;
+        // Only kept for PATCH, upload bodies are counted and dropped
+        QByteArray body;
+    };
+
+    void onNewConnection();
+    void drain(QTcpSocket* socket);
+    void drainAll();
+    void respond(QTcpSocket* socket, Connection& connection);
+    QByteArray route(const Connection& connection);
+    bool chance(double rate);
+    static QByteArray headerValue(const Connection& connection, const QByteArray& name);
+
+    QTcpServer server;
+    QHash<QTcpSocket*, Connection> connections;
+    QTimer pacer;
+    qint64 bandwidth;
+    int latency;
+    int jitter;
+    double errorRate;
+    QByteArray requiredToken;
+    double authFailureRate;
+    bool bulkPrivacy;
+    int nextId;
+    // What each id handed out by /api/screenshot/reserve currently serves
+    QHash<int, ContentStage> contentStage;
+    // Content hashes of full uploads, for /api/screenshot/lookup
+    QHash<QByteArray, int> publishedHashes;
+    // S3 side: stored object sizes by path, and bytes received per open multipart upload
+    QHash<QByteArray, qint64> objectSizes;
+    QHash<QByteArray, qint64> multipartBytes;
+};
+
+#endif // MOCK_API_SERVER_H
@@ -0,0 +1,33 @@
+#ifndef MULTIPART_BODY_H
+#define MULTIPART_BODY_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+
+// multipart/form-data request body with a single file part, streamed from `file`
+// instead of being assembled in memory. Takes ownership of the file device.
+class MultipartBody : public QIODevice {
+public:
+    MultipartBody(const QByteArray& fieldName, const QString& fileName, const QByteArray& mimeType, QIODevice* file, QObject* parent = nullptr);
+
+    QByteArray contentType() const;
+
+    bool isSequential() const override { return true; }
+    qint64 size() const override;
+    qint64 bytesAvailable() const override;
+    bool atEnd() const override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    QByteArray boundary;
+    QByteArray head;
+    QByteArray tail;
+    QIODevice* file;
+    qint64 position;
+};
+
+#endif // MULTIPART_BODY_H
@@ -43,6 +43,12 @@ private:
     QSpinBox* qualitySpinbox;
     QLineEdit* folderEdit;
     QCheckBox* startWithSystemCheckbox;
+    QSpinBox* maxDimensionSpinbox;
+    QSpinBox* scaleSpinbox;
+    QCheckBox* quantizeCheckbox;
+    QSpinBox* uploadLimitSpinbox;
+    QSpinBox* uploadConcurrencySpinbox;
+    QComboBox* uploadBackendCombo;
     QString currentKeys;
     QSet<int> pressedKeys;
 };
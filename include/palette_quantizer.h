@@ -0,0 +1,21 @@
+#ifndef PALETTE_QUANTIZER_H
+#define PALETTE_QUANTIZER_H
+
+#include <QImage>
+
+// Turns a capture into an 8-bit indexed image for small PNGs. Captures that already use
+// at most `maxColors` colours are converted losslessly; anything else goes through a
+// median-cut palette with optional ordered dithering. Work is split into horizontal
+// bands processed on all cores.
+class PaletteQuantizer {
+public:
+    // Returns a null image when the capture cannot be indexed (translucent and too many colours)
+    static QImage quantize(const QImage& image, int maxColors = 256, bool dither = true);
+    // Lossless conversion only, null when the image uses more than `maxColors` colours
+    static QImage quantizeExact(const QImage& image, int maxColors = 256);
+
+    // Exact palette of the image, empty when it uses more than `maxColors` colours
+    static QVector<QRgb> exactPalette(const QImage& image, int maxColors = 256);
+};
+
+#endif // PALETTE_QUANTIZER_H
@@ -0,0 +1,54 @@
+#ifndef PRIVACY_UPDATER_H
+#define PRIVACY_UPDATER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QNetworkReply>
+
+// Sends screenshot privacy changes to the ScreenMe API. Changes are debounced and
+// coalesced per id, so rapid toggling ends in one request carrying the final state,
+// and a newer state aborts the request still in flight for that id. Pending changes
+// that share a state go out as one bulk PATCH unless the server does not support it.
+class PrivacyUpdater : public QObject {
+    Q_OBJECT
+public:
+    explicit PrivacyUpdater(QObject* parent = nullptr);
+
+    static PrivacyUpdater* instance();
+
+    void setPrivacy(const QString& host, const QByteArray& token, const QString& id, bool isPrivate);
+    void setPrivacy(const QString& host, const QByteArray& token, const QStringList& ids, bool isPrivate);
+    // Sends pending changes now instead of after the debounce delay
+    void flush();
+
+signals:
+    void updated(const QString& id, bool isPrivate);
+    void failed(const QString& id, const QString& error);
+
+private:
+    struct Change {
+        QString host;
+        QByteArray token;
+        bool isPrivate = false;
+    };
+    struct Request {
+        Change change;
+        QStringList ids;
+    };
+
+    void send(const Change& change, const QStringList& ids);
+    void supersede(const QString& id, const QHash<QString, Change>& sending);
+    void onFinished(QNetworkReply* reply);
+
+    QHash<QString, Change> pending;
+    QHash<QString, QNetworkReply*> inFlight;
+    QHash<QNetworkReply*, Request> requests;
+    // Hosts that answered the bulk endpoint with 404/405, they get one PATCH per id
+    QSet<QString> noBulkHosts;
+    QTimer debounce;
+};
+
+#endif // PRIVACY_UPDATER_H
@@ -0,0 +1,36 @@
+#ifndef PUBLISH_INDEX_H
+#define PUBLISH_INDEX_H
+
+#include <QHash>
+#include <QString>
+
+// Content hashes of published captures and the link each one got, per upload target.
+// Stored as an append-only tab-separated file next to the config and compacted when
+// superseded lines pile up. A line with an empty id removes the entry.
+class PublishIndex {
+public:
+    struct Entry {
+        QString id;
+        QString link;
+    };
+
+    static PublishIndex* instance();
+
+    bool find(const QString& contentHash, const QString& target, Entry* entry) const;
+    void insert(const QString& contentHash, const QString& target, const Entry& entry);
+    // For links the target no longer serves
+    void remove(const QString& contentHash, const QString& target);
+
+private:
+    PublishIndex();
+
+    void load();
+    void append(const QString& contentHash, const QString& target, const Entry& entry);
+    void compact();
+
+    QString filePath;
+    QHash<QString, Entry> entries;
+    int lineCount;
+};
+
+#endif // PUBLISH_INDEX_H
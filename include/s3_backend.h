@@ -0,0 +1,56 @@
+#ifndef S3_BACKEND_H
+#define S3_BACKEND_H
+
+#include <QList>
+#include <QPair>
+#include <QSharedPointer>
+#include <QUrl>
+#include "upload_backend.h"
+
+// S3-compatible object store (AWS, MinIO, Ceph...) addressed path-style and signed with
+// AWS Signature V4. Small captures are a single PUT; larger ones use a multipart upload
+// whose parts are streamed from disk a few at a time and aborted again on failure.
+// A preview is PUT to the same key first and simply overwritten by the full image.
+// Keys are content-addressed when the source carries a content hash.
+class S3Backend : public UploadBackend {
+    Q_OBJECT
+public:
+    explicit S3Backend(const QJsonObject& config, QObject* parent = nullptr);
+
+    QString name() const override { return "S3"; }
+    QString target() const override { return endpoint.toString() + "/" + bucket; }
+    UploadTask* upload(const UploadSource& source, UploadPriority priority) override;
+
+protected:
+    // Published objects are keyed by content hash, so the check is a HEAD of that key
+    void lookup(UploadTask* task, const UploadSource& source, const std::function<void(const UploadResult&)>& done) override;
+    bool hasLookup() const override { return true; }
+
+private:
+    using QueryItems = QList<QPair<QByteArray, QByteArray>>;
+    struct Multipart;
+
+    QNetworkRequest signedRequest(const QByteArray& verb, const QString& key, const QueryItems& query, const QByteArray& payloadHash) const;
+    ScheduledUpload* send(const QByteArray& verb, const QString& key, const QueryItems& query, QIODevice* body,
+        const QByteArray& payloadHash, UploadPriority priority, const QByteArray& contentType = QByteArray());
+    QString objectKey(const UploadSource& source) const;
+    QString link(const QString& key) const;
+
+    void uploadObject(UploadTask* task, const UploadSource& source, const QString& key, UploadPriority priority);
+    void putObject(UploadTask* task, const UploadSource& source, const QString& key, UploadPriority priority);
+    void startMultipart(UploadTask* task, const UploadSource& source, const QString& key, qint64 size, UploadPriority priority);
+    void sendNextPart(UploadTask* task, QSharedPointer<Multipart> state);
+    void completeMultipart(UploadTask* task, QSharedPointer<Multipart> state);
+    void abortMultipart(const QString& key, const QByteArray& uploadId);
+
+    QUrl endpoint;
+    QString bucket;
+    QByteArray region;
+    QByteArray accessKey;
+    QByteArray secretKey;
+    QString prefix;
+    QString publicUrl;
+    qint64 partSize;
+};
+
+#endif // S3_BACKEND_H
@@ -0,0 +1,38 @@
+#ifndef SCREEN_OVERLAY_H
+#define SCREEN_OVERLAY_H
+
+#include <QWidget>
+
+class QScreen;
+class ScreenshotDisplay;
+
+// Frameless window over one screen while a capture is open. It keeps no state of its own:
+// input is handed to the display in desktop coordinates, and painting draws this screen's
+// own grab from the display, at the screen's own device pixel ratio.
+class ScreenOverlay : public QWidget {
+    Q_OBJECT
+public:
+    ScreenOverlay(ScreenshotDisplay* display, QScreen* screen, const QPoint& desktopOrigin);
+
+    // The screen's part of the desktop, in the display's coordinates
+    QRect area() const { return desktopArea; }
+
+protected:
+    void closeEvent(QCloseEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void inputMethodEvent(QInputMethodEvent* event) override;
+    QVariant inputMethodQuery(Qt::InputMethodQuery query) const override;
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    void forwardMouse(QMouseEvent* event, void (ScreenshotDisplay::*handler)(QMouseEvent*));
+
+    ScreenshotDisplay* display;
+    QRect desktopArea;
+};
+
+#endif // SCREEN_OVERLAY_H
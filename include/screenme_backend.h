@@ -0,0 +1,44 @@
+#ifndef SCREENME_BACKEND_H
+#define SCREENME_BACKEND_H
+
+#include "upload_backend.h"
+
+// The ScreenMe API. Publishing is link-first: a small POST to /api/screenshot/reserve
+// returns the id and share URL, which the task reports right away, and the image is
+// then PUT to /api/screenshot/{id}/content. With a preview the content is PUT twice,
+// preview first and the full image after it at background priority. Servers without
+// the reservation endpoint get the single multipart POST to /api/screenshot.
+class ScreenMeBackend : public UploadBackend {
+    Q_OBJECT
+public:
+    explicit ScreenMeBackend(const QJsonObject& config, QObject* parent = nullptr);
+
+    QString name() const override { return "ScreenMe"; }
+    QString target() const override { return baseUrl; }
+    bool supportsPrivacy() const override { return !token.isEmpty(); }
+    // A digest of the login token, the token itself never reaches the publish index
+    QString account() const override;
+    UploadTask* upload(const UploadSource& source, UploadPriority priority) override;
+
+    QString host() const { return baseUrl; }
+
+protected:
+    // GET /api/screenshot/lookup?xxh3=<hash>, answered with the existing id and url or
+    // 404 {"found": false}. Hosts answering a plain 404 have no lookup.
+    void lookup(UploadTask* task, const UploadSource& source, const std::function<void(const UploadResult&)>& done) override;
+    bool hasLookup() const override;
+
+private:
+    QNetworkRequest request(const QString& path) const;
+    void reserve(UploadTask* task, const UploadSource& source, UploadPriority priority);
+    void putContent(UploadTask* task, const UploadSource& source, const QString& id, const QString& link,
+        UploadPriority priority, bool preview, bool previewOnline = false);
+    void postScreenshot(UploadTask* task, const UploadSource& source, UploadPriority priority);
+    void release(const QString& id);
+
+    QString baseUrl;
+    QByteArray token;
+    bool linkFirst;
+};
+
+#endif // SCREENME_BACKEND_H
@@ -1,7 +1,6 @@
 #ifndef SCREENSHOTDISPLAY_H
 #define SCREENSHOTDISPLAY_H
 
-#include <stack> 
 #include <QWidget>
 #include <QPixmap>
 #include <QLabel>
@@ -9,15 +8,28 @@
 #include <QWheelEvent>
 #include <QPainterPath>
 #include <QGraphicsOpacityEffect>
-#include <QTextEdit>
+#include <QPointer>
+#include <QElapsedTimer>
 #include "editor.h"
 #include "config_manager.h"
-#include "customTextEdit.h"
+#include "scrolling_capture.h"
+#include "desktop_layers.h"
+#include "utils.h"
+#include "async_task.h"
 
+class ScreenOverlay;
+
+// Owns a capture session: the shared capture, the selection and the annotations, in
+// coordinates relative to the top left of the captured desktop. The widget itself is
+// never shown, it opens one ScreenOverlay per screen the capture covers, which forward
+// their input here and paint their own slice. Closing it closes every overlay.
 class ScreenshotDisplay : public QWidget {
     Q_OBJECT
 public:
-    explicit ScreenshotDisplay(const QPixmap& pixmap, QWidget* parent = nullptr, ConfigManager* configManager = nullptr);
+    // `capture` holds one grab per screen, each at its screen's ratio, and together they
+    // cover `desktop`, in logical coordinates
+    ScreenshotDisplay(const QVector<ScreenGrab>& capture, const QRect& desktop, QWidget* parent = nullptr,
+        ConfigManager* configManager = nullptr);
 
     enum HandlePosition {
         None,
@@ -31,44 +43,75 @@ public:
         Right
     };
 
+    // Export size policy from the config, applied to saves and uploads
+    static QImage applyExportSize(const QImage& image, const QJsonObject& config);
+
 signals:
     void screenshotClosed();
+    void captureSaved(const QString& filePath, const QImage& image);
 
 protected:
     void closeEvent(QCloseEvent* event) override;
+    // Forwarded by the overlays, positions in desktop coordinates
     void mousePressEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
     void mouseReleaseEvent(QMouseEvent* event) override;
     void keyPressEvent(QKeyEvent* event) override;
-    void paintEvent(QPaintEvent* event) override;
     void wheelEvent(QWheelEvent* event) override;
+    // Composed text from input methods, committed into the text being edited
+    void inputMethodEvent(QInputMethodEvent* event) override;
+    QVariant inputMethodQuery(Qt::InputMethodQuery query) const override;
 
 private slots:
     void onToolSelected(Editor::Tool tool);
     void onSaveRequested();
     void onPublishRequested();
+    void onScrollCaptureRequested();
     void onCloseRequested();
     void copySelectionToClipboard();
     void undo();
 
 private:
+    friend class ScreenOverlay;
+
     void initializeEditor();
     void configureShortcuts();
+    // Paints `area` of the desktop from `overlay`'s screen, `painter` is already in desktop coordinates
+    void paintArea(QPainter& painter, const QRect& area, const ScreenOverlay* overlay);
+    // Repaints `area` on the overlays it touches, everything when null
+    void updateOverlays(const QRect& area = QRect());
+    void hideOverlays();
+    void setOverlayCursor(Qt::CursorShape shape);
+    // Overlay of the screen containing `point`, the first one for points between screens
+    ScreenOverlay* overlayAt(const QPoint& point) const;
     void updateTooltip();
     void updateEditorPosition();
     void drawHandles(QPainter& painter);
-    void drawArrow(QPainter& painter, const QPoint& start, const QPoint& end);
     void drawBorderCircle(QPainter& painter, const QPoint& position);
-    void saveStateForUndo();
-    void finalizeTextEdit();
-    void adjustTextEditSize();
+    int textAnnotationAt(const QPoint& point) const;
+    void beginTextEditing(int index, bool isNew);
+    void applyTextEdit(const Annotation& edited);
+    bool editTextWithKey(QKeyEvent* event);
+    void finishTextEditing();
+    QRect textCaretRect() const;
+    void drawTextCursor(QPainter& painter);
+    QImage renderSelection();
+    bool exportVector(const QString& filePath);
+    Annotation currentShapeAnnotation() const;
+    QStringList annotationText() const;
+    void finishScrollCapture();
+    Async::Task<> publishSelection(QImage selectedImage);
     HandlePosition handleAtPoint(const QPoint& point);
     void resizeSelection(const QPoint& point);
     Qt::CursorShape cursorForHandle(HandlePosition handle);
 
-    std::stack<QPixmap> undoStack;
-    QPixmap originalPixmap;
-    QPixmap drawingPixmap;
+    DesktopLayers layers;
+    // Top left of the captured desktop in global coordinates
+    QPoint desktopOrigin;
+    // The captured desktop in the display's own coordinates
+    QRect desktopRect;
+    // One per screen, in the order of the screens in `layers`
+    QVector<ScreenOverlay*> overlays;
     QPoint origin;
     QPoint drawingEnd;
     QRect selectionRect;
@@ -77,8 +120,6 @@ private:
     QPoint lastPoint;
     QPoint handleOffset;
     QPoint cursorPosition;
-    QPoint textEditPosition;
-    QRect textBoundingRect;
     QPoint endPoint;
 
     bool selectionStarted;
@@ -95,13 +136,28 @@ private:
     Editor::Tool currentTool;
     QFont currentFont;
 
-    QString text;
-    CustomTextEdit* textEdit;
+    // Index into the text layer of the annotation being typed into, -1 when none
+    int editingText;
+    bool editingNewText;
+    bool editSnapshotTaken;
+    int textCursor;
+    int draggingText;
+    bool textDragMoved;
+    QPoint textDragOrigin;
+    // Uncommitted input method composition, drawn at the caret
+    QString preeditText;
+
     QScopedPointer<Editor> editor;
     ConfigManager* configManager;
 
     HandlePosition currentHandle;
     QPainterPath drawingPath;
+
+    QScopedPointer<ScrollingCapture> scrollCapture;
+    QPointer<QWidget> scrollCaptureBar;
+
+    QElapsedTimer openedTimer;
+    bool firstPainted;
 };
 
 #endif // SCREENSHOTDISPLAY_H
@@ -0,0 +1,49 @@
+#ifndef SCROLLING_CAPTURE_H
+#define SCROLLING_CAPTURE_H
+
+#include <QObject>
+#include <QImage>
+#include <QRect>
+#include <QTimer>
+#include <QVector>
+#include <QPointer>
+#include <QScreen>
+#include "tiled_image.h"
+
+// Repeatedly grabs a screen region while the user scrolls the window under it and
+// stitches the frames into one tall image. Consecutive frames are registered by
+// comparing per-row hashes, so a 4K-wide frame costs one hash pass rather than a
+// pixel-by-pixel search over every candidate offset.
+class ScrollingCapture : public QObject {
+    Q_OBJECT
+public:
+    ScrollingCapture(QScreen* screen, const QRect& region, QObject* parent = nullptr);
+
+    void start();
+    QImage finish();
+    void cancel();
+
+    int capturedHeight() const { return stitched.height(); }
+
+    // Returns how many rows the content moved up between previous and next, 0 when
+    // nothing scrolled and -1 when the frames could not be registered.
+    static int findScrollOffset(const QVector<quint64>& previous, const QVector<quint64>& next);
+    static QVector<quint64> rowHashes(const QImage& image);
+
+signals:
+    void progress(int capturedHeight);
+    void frameLost();
+    void limitReached();
+
+private slots:
+    void grabFrame();
+
+private:
+    QPointer<QScreen> screen;
+    QRect region;
+    QTimer timer;
+    TiledImage stitched;
+    QVector<quint64> lastHashes;
+};
+
+#endif // SCROLLING_CAPTURE_H
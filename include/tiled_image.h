@@ -0,0 +1,30 @@
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include <QImage>
+#include <QList>
+
+// Fixed-width image that grows downward one row band at a time. Rows are stored
+// in independent tiles so appending never reallocates what was already captured.
+class TiledImage {
+public:
+    explicit TiledImage(int width = 0, QImage::Format format = QImage::Format_ARGB32, int tileHeight = 512);
+
+    void appendRows(const QImage& source, int firstRow, int rowCount);
+    // The rows as one image, each tile is freed once its rows are copied, leaving this empty
+    QImage takeImage();
+    void clear();
+
+    int width() const { return imageWidth; }
+    int height() const { return totalRows; }
+    bool isEmpty() const { return totalRows == 0; }
+
+private:
+    int imageWidth;
+    int tileHeight;
+    int totalRows;
+    QImage::Format format;
+    QList<QImage> tiles;
+};
+
+#endif // TILED_IMAGE_H
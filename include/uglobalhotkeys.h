@@ -14,6 +14,10 @@
 #include "uexception.h"
 #include "uglobal.h"
 
+#if defined(Q_OS_LINUX)
+class EvdevHotkeys;
+#endif
+
 #if defined(Q_OS_LINUX)
 struct UHotkeyData {
     xcb_keycode_t keyCode;
@@ -58,6 +62,8 @@ private:
     QSet<size_t> Registered;
     #elif defined(Q_OS_LINUX)
     QHash<size_t, UHotkeyData> Registered;
+    // Set when keys come from /dev/input instead of X11 grabs
+    EvdevHotkeys* Evdev;
     xcb_connection_t* X11Connection;
     xcb_window_t X11Wid;
     xcb_key_symbols_t* X11KeySymbs;
@@ -0,0 +1,120 @@
+#ifndef UPLOAD_BACKEND_H
+#define UPLOAD_BACKEND_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QPointer>
+#include <QString>
+#include <functional>
+#include "upload_scheduler.h"
+#include "async_task.h"
+
+// File to publish. The backend streams it from disk, it is never read into memory.
+struct UploadSource {
+    QString filePath;
+    QString fileName;
+    QByteArray mimeType;
+    // Optional small rendition published first and replaced by the full image,
+    // for backends whose targets can be overwritten
+    QString previewPath;
+    QByteArray previewMimeType;
+    // XXH3 of the file as 16 hex digits, set by UploadBackend::publish
+    QString contentHash;
+};
+
+struct UploadResult {
+    bool success = false;
+    bool canceled = false;
+    // Public link to the uploaded capture
+    QString link;
+    // Backend-specific identifier, empty when the target has none
+    QString id;
+    QString error;
+    int httpStatus = 0;
+    // The target already had these bytes, nothing was uploaded
+    bool deduplicated = false;
+};
+
+// One running upload. Every network step goes through the UploadScheduler, so the
+// bandwidth cap and priorities apply to all backends. Deletes itself after finished().
+class UploadTask : public QObject {
+    Q_OBJECT
+public:
+    explicit UploadTask(QObject* parent = nullptr);
+
+    bool isCanceled() const { return canceled; }
+
+    // Registers a network step so cancel() aborts it
+    void track(ScheduledUpload* upload);
+    // Forwards the progress of a nested task and passes cancel() on to it
+    void follow(UploadTask* inner);
+    void finish(const UploadResult& result);
+    // Finishes from the event loop, for failures found before the caller could connect
+    void fail(const QString& error);
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(qint64 bytesSent, qint64 bytesTotal);
+    // The share link is known, possibly long before the upload itself is done
+    void linkReady(const QString& link, const QString& id);
+    // The preview is online, the link shows it until the full image replaces it
+    void previewPublished();
+    void finished(const UploadResult& result);
+
+private:
+    QList<QPointer<ScheduledUpload>> steps;
+    QPointer<UploadTask> innerTask;
+    bool canceled;
+    bool done;
+};
+
+// Target that captures are published to, selected with the "upload_backend" config key
+class UploadBackend : public QObject {
+    Q_OBJECT
+public:
+    explicit UploadBackend(QObject* parent = nullptr) : QObject(parent) {}
+
+    virtual QString name() const = 0;
+    // Where uploads land, identifies the target in the publish index
+    virtual QString target() const = 0;
+    // Who uploads, for targets where links belong to an account. Published links are
+    // only reused for the same account.
+    virtual QString account() const { return QString(); }
+    // Whether the published capture can be switched between public and private afterwards
+    virtual bool supportsPrivacy() const { return false; }
+    virtual UploadTask* upload(const UploadSource& source, UploadPriority priority) = 0;
+
+    // upload() unless the same bytes were published to this target before. Targets with
+    // a remote lookup are always asked, the local publish index only answers for the
+    // others, and its entries the target says it no longer has are dropped.
+    UploadTask* publish(const UploadSource& source, UploadPriority priority);
+    // Opens the connection to the target ahead of the first request, so TCP and TLS
+    // setup overlap with encoding the capture
+    void preconnect();
+
+    // "screenme" (default), "s3" or "http"
+    static UploadBackend* create(const QJsonObject& config, QObject* parent = nullptr);
+
+protected:
+    // Existence check by content hash before any byte is sent. Calls `done` with a
+    // successful result carrying the existing link, or an unsuccessful one to upload.
+    // The default has no remote check.
+    virtual void lookup(UploadTask* task, const UploadSource& source, const std::function<void(const UploadResult&)>& done);
+    // Can turn false after a lookup, when the target turns out not to have one
+    virtual bool hasLookup() const { return false; }
+
+    static int httpStatus(QNetworkReply* reply);
+    // Failure result for a finished reply, or a cancelled one when `reply` is null
+    static UploadResult failure(QNetworkReply* reply);
+
+private:
+    // target() qualified by account(), the publish index key
+    QString indexTarget() const;
+    Async::Task<> publishSteps(QPointer<UploadTask> task, UploadSource source, UploadPriority priority);
+};
+
+#endif // UPLOAD_BACKEND_H
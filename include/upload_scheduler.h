@@ -0,0 +1,107 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+// Highest first. Interactive uploads have someone waiting on them and are never queued
+// behind the concurrency limit.
+enum class UploadPriority {
+    Interactive,
+    Background,
+    Migration,
+    AutoUpload
+};
+
+class ThrottledBody;
+
+// One upload handed to the scheduler. Deletes itself after finished().
+class ScheduledUpload : public QObject {
+    Q_OBJECT
+public:
+    UploadPriority priority() const { return uploadPriority; }
+    QNetworkReply* reply() const { return networkReply; }
+
+public slots:
+    void cancel();
+
+signals:
+    void started();
+    void uploadProgress(qint64 bytesSent, qint64 bytesTotal);
+    // `reply` is null when the upload was cancelled before it started
+    void finished(QNetworkReply* reply);
+
+private:
+    friend class UploadScheduler;
+    ScheduledUpload(const QNetworkRequest& request, const QByteArray& verb, ThrottledBody* body, UploadPriority priority, QObject* parent);
+
+    QNetworkRequest request;
+    QByteArray verb;
+    ThrottledBody* body;
+    UploadPriority uploadPriority;
+    QNetworkReply* networkReply;
+};
+
+// Runs uploads with a shared token-bucket bandwidth cap, a concurrency limit and priority
+// classes. Request bodies are read through the scheduler, so a capped upload simply stalls
+// on an empty bucket instead of sleeping in the network stack.
+class UploadScheduler : public QObject {
+    Q_OBJECT
+public:
+    struct Stats {
+        double bytesPerSecond = 0.0;
+        qint64 bytesSent = 0;
+        int active = 0;
+        int queued = 0;
+    };
+
+    explicit UploadScheduler(QObject* parent = nullptr);
+
+    static UploadScheduler* instance();
+
+    // Takes ownership of `body`, which must know its size up front. A null body sends the
+    // request without one, a "HEAD" verb goes out as a real HEAD.
+    ScheduledUpload* enqueue(const QNetworkRequest& request, QIODevice* body, UploadPriority priority, const QByteArray& verb = "POST");
+
+    void setBandwidthLimit(qint64 bytesPerSecond);
+    void setMaxConcurrent(int count);
+    void applyConfig(const QJsonObject& config);
+
+    Stats stats() const { return currentStats; }
+    QNetworkAccessManager* network() { return &manager; }
+
+signals:
+    void statsChanged(const UploadScheduler::Stats& stats);
+
+private:
+    friend class ThrottledBody;
+    friend class ScheduledUpload;
+
+    qint64 takeTokens(ThrottledBody* body, qint64 wanted);
+    void tick();
+    void dispatch();
+    void start(ScheduledUpload* upload);
+    void remove(ScheduledUpload* upload);
+    void updateCounts();
+
+    QNetworkAccessManager manager;
+    QList<ScheduledUpload*> queued;
+    QList<ScheduledUpload*> active;
+    QList<ThrottledBody*> waiting;
+    QTimer ticker;
+    QElapsedTimer clock;
+    qint64 lastTick;
+    qint64 bandwidthLimit;
+    double tokens;
+    int maxConcurrent;
+    qint64 bytesSinceTick;
+    Stats currentStats;
+};
+
+#endif // UPLOAD_SCHEDULER_H
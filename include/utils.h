@@ -2,11 +2,32 @@
 
 #include <QString>
 #include <QPixmap>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+
+class QScreen;
+class QJsonObject;
 
 QString getUniqueFilePath(const QString& folder, const QString& baseName, const QString& extension);
 void CaptureScreenshot(const QString& savePath);
 void displayScreenshotOnScreen(const QPixmap& pixmap);
 QString getConfigFilePath(const QString& file);
+bool saveCapture(const QImage& image, const QString& filePath, int quality = -1);
+// Whole screen in device pixels, with a device pixel ratio of 1. The pixels live in the
+// frame buffer pool.
+QImage grabScreen(QScreen* screen);
+// One screen's part of a desktop capture: `image` in device pixels at the screen's own
+// ratio, covering `geometry` in logical coordinates
+struct ScreenGrab {
+    QScreen* screen = nullptr;
+    QRect geometry;
+    qreal devicePixelRatio = 1.0;
+    QImage image;
+};
+// Every screen, each at its own ratio. `geometry` receives the union of the screens'
+// geometries in logical coordinates.
+QVector<ScreenGrab> grabDesktop(QRect* geometry);
 
 void saveLoginInfo(const QString& id, const QString& email, const QString& nickname, const QString& token);
 QString loadLoginInfo();
@@ -15,4 +36,10 @@ void setAutoStart(bool enable);
 
 
 //const QString SCREEN_ME_HOST = "http://127.0.0.1:3001";
-const QString SCREEN_ME_HOST = "https://screen-me.cloud";
\ No newline at end of file
+const QString SCREEN_ME_HOST = "https://screen-me.cloud";
+
+// SCREEN_ME_HOST unless overridden by the SCREENME_HOST environment variable or the
+// "screenme_host" config key, e.g. to run against a local mock server
+QString screenMeHost();
+// Takes "screenme_host" from `config`, applied again whenever the options are saved
+void applyScreenMeHost(const QJsonObject& config);
\ No newline at end of file
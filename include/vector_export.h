@@ -0,0 +1,22 @@
+#ifndef VECTOR_EXPORT_H
+#define VECTOR_EXPORT_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include "annotation.h"
+
+// Writes a capture as one embedded raster with the annotations on top as real vector
+// primitives, so the result can be scaled or edited afterwards. `area` is the exported
+// region in logical coordinates, `raster` holds the pixels of that region.
+class VectorExport {
+public:
+    static bool write(const QString& filePath, const QImage& raster, const QVector<Annotation>& annotations, const QRect& area);
+    static bool writeSvg(const QString& filePath, const QImage& raster, const QVector<Annotation>& annotations, const QRect& area);
+    static bool writePdf(const QString& filePath, const QImage& raster, const QVector<Annotation>& annotations, const QRect& area);
+
+    static bool isVectorFormat(const QString& filePath);
+};
+
+#endif // VECTOR_EXPORT_H
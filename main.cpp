@@ -10,6 +10,9 @@
 #include <QTextStream>
 #include <QMessageBox>
 #include <QSharedMemory>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
 #include <include/options_window.h>
 #include <include/config_manager.h>
 #include "include/login_loader.h"
@@ -18,6 +21,8 @@
 #include <include/utils.h>
 #include "include/hotkeyEventFilter.h"
 #include "include/globalKeyboardHook.h"
+#include "include/capture_search_window.h"
+#include "include/app_commands.h"
 
 
 using namespace std;
@@ -37,7 +42,7 @@ static void showAboutDialog() {
         "<span style=\"color: green\">Contribute on GitHub ! </span> : <a href=\"https://github.com/Sorok-Dva/ScreenMe\">Github Repository</a><br><br>"
     );
     aboutBox.setInformativeText(
-        "Terms of use of ScreenMe : <a href=\"" + SCREEN_ME_HOST + "/terms-of-use\">" + SCREEN_ME_HOST + "/terms-of-use</a><br><br>"
+        "Terms of use of ScreenMe : <a href=\"" + screenMeHost() + "/terms-of-use\">" + screenMeHost() + "/terms-of-use</a><br><br>"
         "© 2024 Developed by <a href=\"https://github.com/Sorok-Dva\">Сорок два</a>. <b>All rights reserved.</b>"
     );
     aboutBox.setIconPixmap(QPixmap(":/resources/icon.png"));
@@ -46,8 +51,14 @@ static void showAboutDialog() {
 
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
 {
-    int argc = 0;
-    QApplication app(argc, 0);
+    // The CRT's parsed command line, an empty argv hides the command line modes
+    QApplication app(__argc, __argv);
+
+    const QStringList arguments = QCoreApplication::arguments();
+    if (AppCommands::isCommandLine(arguments)) {
+        return AppCommands::runCommandLine(arguments, app);
+    }
+
     #ifdef _WIN32
         // Ensure the console window does not appear on Windows
         FreeConsole();
@@ -82,6 +93,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
     QAction loginAction("Login to ScreenMe", &trayMenu);
     QAction takeScreenshotAction("Take Screenshot", &trayMenu);
     QAction takeFullscreenScreenshotAction("Take Fullscreen Screenshot", &trayMenu);
+    QAction compareCapturesAction("Compare Captures...", &trayMenu);
+    QAction searchCapturesAction("Search Captures...", &trayMenu);
     QAction aboutAction("About...", &trayMenu);
     QAction helpAction("❓Help", &trayMenu);
     QAction reportBugAction("🛠️ Report a bug", &trayMenu);
@@ -105,6 +118,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
 
     trayMenu.addAction(&takeScreenshotAction);
     trayMenu.addAction(&takeFullscreenScreenshotAction);
+    trayMenu.addAction(&compareCapturesAction);
+    trayMenu.addAction(&searchCapturesAction);
     trayMenu.addSeparator();
     trayMenu.addAction(&aboutAction);
     trayMenu.addAction(&helpAction);
@@ -119,7 +134,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
     LoginLoader loginLoader;
 
     QObject::connect(&loginAction, &QAction::triggered, [&]() {
-        QDesktopServices::openUrl(QUrl(SCREEN_ME_HOST + "/login"));
+        QDesktopServices::openUrl(QUrl(screenMeHost() + "/login"));
         loginLoader.show();
     });
 
@@ -142,7 +157,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
             QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonStr.toUtf8());
             QJsonObject loginInfo = jsonDoc.object();
             QString nickname = loginInfo["nickname"].toString();
-            QDesktopServices::openUrl(QUrl(SCREEN_ME_HOST + "/gallery"));
+            QDesktopServices::openUrl(QUrl(screenMeHost() + "/gallery"));
         }
     });
 
@@ -159,6 +174,11 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
     MainWindow mainWindow(&configManager);
     mainWindow.hide();
 
+    // Scripts drive the same captures as the tray and the hotkeys
+    QObject::connect(loginServer.automation(), &AutomationApi::interactiveCaptureRequested, &mainWindow, &MainWindow::takeScreenshot);
+    QObject::connect(loginServer.automation(), &AutomationApi::fullscreenCaptureRequested, &mainWindow, &MainWindow::takeFullscreenScreenshot);
+    QObject::connect(&mainWindow, &MainWindow::captureSaved, loginServer.automation(), &AutomationApi::onCaptureSaved);
+
     QObject::connect(&takeScreenshotAction, &QAction::triggered, [&]() {
         mainWindow.takeScreenshot();
     });
@@ -167,12 +187,27 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, char*, int nShowCmd)
         mainWindow.takeFullscreenScreenshot();
     });
 
+    QObject::connect(&compareCapturesAction, &QAction::triggered, [&]() {
+        AppCommands::compareCaptures(configManager, trayIcon);
+    });
+
+    // One search window, brought back to the front when asked for again
+    QPointer<CaptureSearchWindow> captureSearchWindow;
+    QObject::connect(&searchCapturesAction, &QAction::triggered, [&]() {
+        if (!captureSearchWindow) {
+            captureSearchWindow = new CaptureSearchWindow();
+            captureSearchWindow->show();
+        }
+        captureSearchWindow->raise();
+        captureSearchWindow->activateWindow();
+    });
+
     QObject::connect(&aboutAction, &QAction::triggered, [&]() {
         showAboutDialog();
     });
 
     QObject::connect(&helpAction, &QAction::triggered, [&]() {
-        QDesktopServices::openUrl(QUrl(SCREEN_ME_HOST + "/help"));
+        QDesktopServices::openUrl(QUrl(screenMeHost() + "/help"));
     });
 
     QObject::connect(&reportBugAction, &QAction::triggered, [&]() {
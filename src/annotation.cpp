@@ -0,0 +1,115 @@
+#include "include/annotation.h"
+#include <QFontMetrics>
+#include <QStringList>
+#include <QtMath>
+#include <cmath>
+
+QRect Annotation::bounds() const {
+    // Pen width plus a pixel of slack for the cap and antialiasing
+    const int margin = penWidth / 2 + 2;
+
+    switch (kind) {
+    case Stroke:
+        return path.boundingRect().toAlignedRect().adjusted(-margin, -margin, margin, margin);
+    case Rectangle:
+    case Ellipse:
+        return rect.normalized().adjusted(-margin, -margin, margin, margin);
+    case Highlight:
+    case Redaction:
+        return rect.normalized();
+    case Line:
+        return QRect(start, end).normalized().adjusted(-margin, -margin, margin, margin);
+    case Arrow: {
+        QRectF head = arrowHead(start, end, penWidth).boundingRect();
+        return QRect(start, end).normalized().united(head.toAlignedRect()).adjusted(-margin, -margin, margin, margin);
+    }
+    case Text: {
+        const QVector<QStaticText>& lines = textLines();
+        qreal width = 0;
+        for (const QStaticText& line : lines) {
+            width = qMax(width, line.size().width());
+        }
+        return QRect(start, QSize(qCeil(width), lineHeight() * lines.size())).adjusted(-2, -2, 2, 2);
+    }
+    }
+    return QRect();
+}
+
+void Annotation::paint(QPainter& painter) const {
+    painter.save();
+    painter.setPen(QPen(color, penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+    painter.setBrush(Qt::NoBrush);
+
+    switch (kind) {
+    case Stroke:
+        painter.drawPath(path);
+        break;
+    case Rectangle:
+        painter.drawRect(rect);
+        break;
+    case Ellipse:
+        painter.drawEllipse(rect);
+        break;
+    case Line:
+        painter.drawLine(start, end);
+        break;
+    case Arrow:
+        painter.drawLine(start, end);
+        painter.setBrush(color);
+        painter.drawPolygon(arrowHead(start, end, penWidth));
+        break;
+    case Highlight:
+        painter.fillRect(rect, color);
+        break;
+    case Redaction:
+        // Only used for previews, the layer stack pixelates the capture itself
+        painter.fillRect(rect, QColor(0, 0, 0, 160));
+        break;
+    case Text: {
+        painter.setFont(font);
+        painter.setPen(QPen(color));
+        const QVector<QStaticText>& lines = textLines();
+        const int height = lineHeight();
+        for (int i = 0; i < lines.size(); ++i) {
+            painter.drawStaticText(QPointF(start.x(), start.y() + i * height), lines.at(i));
+        }
+        break;
+    }
+    }
+    painter.restore();
+}
+
+const QVector<QStaticText>& Annotation::textLines() const {
+    if (textLayout.isEmpty() || layoutText != text || layoutFont != font) {
+        textLayout.clear();
+        for (const QString& line : text.split('\n')) {
+            QStaticText staticText(line);
+            staticText.setTextFormat(Qt::PlainText);
+            staticText.setPerformanceHint(QStaticText::AggressiveCaching);
+            staticText.prepare(QTransform(), font);
+            textLayout.append(staticText);
+        }
+        layoutText = text;
+        layoutFont = font;
+    }
+    return textLayout;
+}
+
+int Annotation::lineHeight() const {
+    return QFontMetrics(font).height();
+}
+
+QPolygonF Annotation::arrowHead(const QPointF& start, const QPointF& end, qreal penWidth) {
+    const double angle = std::atan2(start.y() - end.y(), start.x() - end.x());
+    const double arrowHeadLength = penWidth * 2;
+    const double arrowHeadAngle = M_PI / 6;
+
+    QPointF arrowP1 = end + QPointF(std::cos(angle + arrowHeadAngle) * arrowHeadLength,
+        std::sin(angle + arrowHeadAngle) * arrowHeadLength);
+    QPointF arrowP2 = end + QPointF(std::cos(angle - arrowHeadAngle) * arrowHeadLength,
+        std::sin(angle - arrowHeadAngle) * arrowHeadLength);
+
+    QPolygonF arrow;
+    arrow << end << arrowP1 << arrowP2;
+    return arrow;
+}
@@ -0,0 +1,509 @@
+#include "include/app_commands.h"
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#endif
+#include <QApplication>
+#include <QSystemTrayIcon>
+#include <QMessageBox>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QMap>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include "include/config_manager.h"
+#include "include/utils.h"
+#include "include/image_diff.h"
+#include "include/image_resampler.h"
+#include "include/upload_scheduler.h"
+#include "include/multipart_body.h"
+#include "include/mock_api_server.h"
+#include "include/upload_backend.h"
+#include "include/evdev_hotkeys.h"
+
+namespace {
+    const int DefaultDiffTolerance = 8;
+    const int DefaultBenchmarkDimension = 1920;
+}
+
+// The GUI subsystem has no console, borrow the one of the shell that started us
+static void attachParentConsole() {
+    #ifdef _WIN32
+    if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+        FILE* stream = nullptr;
+        freopen_s(&stream, "CONOUT$", "w", stdout);
+        freopen_s(&stream, "CONOUT$", "w", stderr);
+    }
+    #endif
+}
+
+static QString argumentValue(const QStringList& arguments, const QString& name, const QString& defaultValue = QString()) {
+    int index = arguments.indexOf(name);
+    if (index < 0 || index + 1 >= arguments.size()) {
+        return defaultValue;
+    }
+    return arguments.at(index + 1);
+}
+
+// ScreenMe --compare <before> <after> [--tolerance N] [--output diff.png]
+static int runCompareCommand(const QStringList& arguments) {
+    attachParentConsole();
+
+    int index = arguments.indexOf("--compare");
+    if (index + 2 >= arguments.size()) {
+        std::cerr << "Usage: ScreenMe --compare <before> <after> [--tolerance N] [--output diff.png]" << std::endl;
+        return 2;
+    }
+
+    QImage before(arguments.at(index + 1));
+    QImage after(arguments.at(index + 2));
+    if (before.isNull() || after.isNull()) {
+        std::cerr << "Failed to load one of the captures" << std::endl;
+        return 2;
+    }
+
+    int tolerance = argumentValue(arguments, "--tolerance", QString::number(DefaultDiffTolerance)).toInt();
+    QString outputPath = argumentValue(arguments, "--output", QFileInfo(arguments.at(index + 2)).dir().filePath("diff.png"));
+
+    ImageDiffResult result = ImageDiff::compare(before, after, tolerance);
+    if (!ImageDiff::exportResult(result, outputPath)) {
+        std::cerr << "Failed to write " << outputPath.toStdString() << std::endl;
+        return 2;
+    }
+
+    std::cout << QJsonDocument(result.toJson()).toJson().constData();
+    return result.isIdentical() ? 0 : 1;
+}
+
+// ScreenMe --benchmark-resample <image> [--max-dimension N] [--runs N]
+// Both results are scaled back up to the source size with the same filter and compared
+// against it, so neither downscaler is judged by its own idea of the reference.
+static int runResampleBenchmark(const QStringList& arguments) {
+    attachParentConsole();
+
+    QImage source(argumentValue(arguments, "--benchmark-resample"));
+    if (source.isNull()) {
+        std::cerr << "Usage: ScreenMe --benchmark-resample <image> [--max-dimension N] [--runs N]" << std::endl;
+        return 2;
+    }
+    source = source.convertToFormat(source.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    const int maxDimension = argumentValue(arguments, "--max-dimension", QString::number(DefaultBenchmarkDimension)).toInt();
+    const int runs = qMax(1, argumentValue(arguments, "--runs", "5").toInt());
+    const QSize target = ImageResampler::exportSize(source.size(), maxDimension);
+
+    QImage qtResult;
+    QImage ownResult;
+    QElapsedTimer timer;
+    qint64 qtBest = std::numeric_limits<qint64>::max();
+    qint64 ownBest = std::numeric_limits<qint64>::max();
+    for (int run = 0; run < runs; ++run) {
+        timer.start();
+        qtResult = source.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        qtBest = qMin(qtBest, timer.nsecsElapsed());
+
+        timer.start();
+        ownResult = ImageResampler::downscale(source, target);
+        ownBest = qMin(ownBest, timer.nsecsElapsed());
+    }
+
+    auto roundTrip = [&source](const QImage& image) {
+        return ImageResampler::psnr(source, image.scaled(source.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    };
+
+    QJsonObject report;
+    report["source"] = QString("%1x%2").arg(source.width()).arg(source.height());
+    report["target"] = QString("%1x%2").arg(target.width()).arg(target.height());
+    report["qt_ms"] = qtBest / 1e6;
+    report["screenme_ms"] = ownBest / 1e6;
+    report["qt_psnr_db"] = roundTrip(qtResult);
+    report["screenme_psnr_db"] = roundTrip(ownResult);
+    std::cout << QJsonDocument(report).toJson().constData();
+    return 0;
+}
+
+// Applies the mock server switches shared by --mock-server and --load-test
+static void configureMockServer(MockApiServer& server, const QStringList& arguments) {
+    server.setBandwidth(argumentValue(arguments, "--bandwidth", "0").toLongLong() * 1024);
+    server.setLatency(argumentValue(arguments, "--latency", "0").toInt(), argumentValue(arguments, "--jitter", "0").toInt());
+    server.setErrorRate(argumentValue(arguments, "--error-rate", "0").toDouble() / 100.0);
+    server.setRequiredToken(argumentValue(arguments, "--token", QString()).toUtf8(),
+        argumentValue(arguments, "--auth-failure-rate", "0").toDouble() / 100.0);
+    server.setBulkPrivacy(!arguments.contains("--no-bulk-privacy"));
+}
+
+// Peak and current working set of this process, in bytes
+static void memoryUsage(qint64* peak, qint64* current) {
+    *peak = *current = -1;
+    #ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    counters.cb = sizeof(counters);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        *peak = qint64(counters.PeakWorkingSetSize);
+        *current = qint64(counters.WorkingSetSize);
+    }
+    #endif
+}
+
+// ScreenMe --mock-server [--port N] [--bandwidth KB/s] [--latency ms] [--jitter ms]
+//                        [--error-rate %] [--token T] [--auth-failure-rate %] [--no-bulk-privacy]
+static int runMockServer(const QStringList& arguments, QApplication& app) {
+    attachParentConsole();
+
+    MockApiServer server;
+    configureMockServer(server, arguments);
+    if (!server.listen(quint16(argumentValue(arguments, "--port", "0").toUInt()))) {
+        std::cerr << "Failed to listen" << std::endl;
+        return 2;
+    }
+    std::cout << "Mock ScreenMe API on http://127.0.0.1:" << server.port() << std::endl;
+    QObject::connect(&server, &MockApiServer::requestReceived, [](const QByteArray& method, const QByteArray& path, qint64 bodySize) {
+        std::cout << method.constData() << " " << path.constData() << " " << bodySize << " bytes" << std::endl;
+    });
+    return app.exec();
+}
+
+// ScreenMe --upload-benchmark <url> <file> [--count N] [--limit KB/s] [--concurrency N]
+static int runUploadBenchmark(const QStringList& arguments, QApplication& app) {
+    attachParentConsole();
+
+    int index = arguments.indexOf("--upload-benchmark");
+    if (index + 2 >= arguments.size()) {
+        std::cerr << "Usage: ScreenMe --upload-benchmark <url> <file> [--count N] [--limit KB/s] [--concurrency N]" << std::endl;
+        return 2;
+    }
+    const QUrl url(arguments.at(index + 1));
+    const QString filePath = arguments.at(index + 2);
+    const int count = qMax(1, argumentValue(arguments, "--count", "10").toInt());
+
+    UploadScheduler* scheduler = UploadScheduler::instance();
+    scheduler->setBandwidthLimit(argumentValue(arguments, "--limit", "0").toLongLong() * 1024);
+    scheduler->setMaxConcurrent(argumentValue(arguments, "--concurrency", "2").toInt());
+
+    QElapsedTimer clock;
+    clock.start();
+    QVector<qint64> latencies;
+    int failures = 0;
+    int remaining = count;
+
+    for (int i = 0; i < count; ++i) {
+        QFile* file = new QFile(filePath);
+        if (!file->open(QIODevice::ReadOnly)) {
+            std::cerr << "Failed to open " << filePath.toStdString() << std::endl;
+            delete file;
+            return 2;
+        }
+        MultipartBody* body = new MultipartBody("screenshot", QFileInfo(filePath).fileName(), "application/octet-stream", file);
+        QNetworkRequest request(url);
+        request.setHeader(QNetworkRequest::ContentTypeHeader, body->contentType());
+
+        const qint64 queuedAt = clock.elapsed();
+        ScheduledUpload* upload = scheduler->enqueue(request, body, UploadPriority::Background);
+        QObject::connect(upload, &ScheduledUpload::finished, [&, queuedAt](QNetworkReply* reply) {
+            latencies.append(clock.elapsed() - queuedAt);
+            if (!reply || reply->error() != QNetworkReply::NoError) {
+                ++failures;
+            }
+            if (--remaining == 0) {
+                app.quit();
+            }
+        });
+    }
+
+    QTimer progress;
+    QObject::connect(&progress, &QTimer::timeout, [scheduler]() {
+        UploadScheduler::Stats stats = scheduler->stats();
+        std::cout << qRound(stats.bytesPerSecond / 1024) << " KB/s, " << stats.active << " active, " << stats.queued << " queued" << std::endl;
+    });
+    progress.start(1000);
+    app.exec();
+
+    std::sort(latencies.begin(), latencies.end());
+    const double seconds = clock.elapsed() / 1000.0;
+    QJsonObject report;
+    report["uploads"] = count;
+    report["failures"] = failures;
+    report["seconds"] = seconds;
+    report["average_kb_per_s"] = scheduler->stats().bytesSent / 1024.0 / qMax(0.001, seconds);
+    report["p50_ms"] = double(latencies.at(latencies.size() / 2));
+    report["p95_ms"] = double(latencies.at(qMin(int(latencies.size()) - 1, int(latencies.size() * 95 / 100))));
+    std::cout << QJsonDocument(report).toJson().constData();
+    return failures == 0 ? 0 : 1;
+}
+
+// ScreenMe --upload <file> [--backend screenme|s3|http] [--endpoint URL] [--preview preview.jpg]
+// Publishes one file through the configured backend; --endpoint points it at a local stand-in
+static int runUpload(const QStringList& arguments, QApplication& app) {
+    attachParentConsole();
+
+    int index = arguments.indexOf("--upload");
+    if (index + 1 >= arguments.size()) {
+        std::cerr << "Usage: ScreenMe --upload <file> [--backend screenme|s3|http] [--endpoint URL] [--preview preview.jpg]" << std::endl;
+        return 2;
+    }
+    const QString filePath = arguments.at(index + 1);
+
+    ConfigManager configManager("config.json");
+    QJsonObject config = configManager.loadConfig();
+    config["upload_backend"] = argumentValue(arguments, "--backend", config["upload_backend"].toString("screenme"));
+    const QString endpoint = argumentValue(arguments, "--endpoint", QString());
+    if (!endpoint.isEmpty()) {
+        const QString backendName = config["upload_backend"].toString();
+        const char* key = backendName == "s3" ? "s3_endpoint" : backendName == "http" ? "http_upload_url" : "screenme_host";
+        config[key] = endpoint;
+        if (backendName == "s3" && config["s3_bucket"].toString().isEmpty()) {
+            config["s3_bucket"] = "screenme";
+        }
+    }
+    UploadScheduler::instance()->applyConfig(config);
+
+    UploadBackend* backend = UploadBackend::create(config, &app);
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    const QByteArray mimeType = suffix == "png" ? "image/png" : suffix == "jpg" || suffix == "jpeg" ? "image/jpeg" : "application/octet-stream";
+    UploadSource source{ filePath, QFileInfo(filePath).fileName(), mimeType };
+    source.previewPath = argumentValue(arguments, "--preview", QString());
+    source.previewMimeType = "image/jpeg";
+    UploadTask* task = backend->publish(source, UploadPriority::Interactive);
+
+    QElapsedTimer clock;
+    clock.start();
+    UploadResult result;
+    qint64 linkMs = -1;
+    QObject::connect(task, &UploadTask::linkReady, [&](const QString& link) {
+        linkMs = clock.elapsed();
+        std::cout << "Link ready: " << link.toStdString() << std::endl;
+    });
+    qint64 previewMs = -1;
+    QObject::connect(task, &UploadTask::previewPublished, [&]() {
+        previewMs = clock.elapsed();
+        std::cout << "Preview online" << std::endl;
+    });
+    QObject::connect(task, &UploadTask::progress, [](qint64 bytesSent, qint64 bytesTotal) {
+        std::cout << bytesSent << " / " << bytesTotal << " bytes" << std::endl;
+    });
+    QObject::connect(task, &UploadTask::finished, [&](const UploadResult& finished) {
+        result = finished;
+        app.quit();
+    });
+    app.exec();
+
+    QJsonObject report;
+    report["backend"] = backend->name();
+    report["success"] = result.success;
+    report["link"] = result.link;
+    report["id"] = result.id;
+    report["error"] = result.error;
+    report["http_status"] = result.httpStatus;
+    report["deduplicated"] = result.deduplicated;
+    report["seconds"] = clock.elapsed() / 1000.0;
+    // Time until the link could be shared, -1 when it only came with the finished upload
+    report["link_ms"] = double(linkMs);
+    report["preview_ms"] = double(previewMs);
+    std::cout << QJsonDocument(report).toJson().constData();
+    return result.success ? 0 : 1;
+}
+
+// ScreenMe --load-test [--endpoint URL] [--count N] [--concurrency N] [--size KB | --file F]
+//                      plus the --mock-server switches when no endpoint is given
+// Drives the real ScreenMe upload client with N concurrent publishes against a local mock
+// server (started in-process unless --endpoint is given) and reports throughput, latency
+// percentiles and memory.
+static int runLoadTest(const QStringList& arguments, QApplication& app) {
+    attachParentConsole();
+
+    const int count = qMax(1, argumentValue(arguments, "--count", "100").toInt());
+    const int concurrency = qMax(1, argumentValue(arguments, "--concurrency", "8").toInt());
+    const QByteArray token = argumentValue(arguments, "--token", "load-test").toUtf8();
+
+    MockApiServer server;
+    QString endpoint = argumentValue(arguments, "--endpoint", QString());
+    if (endpoint.isEmpty()) {
+        configureMockServer(server, arguments);
+        server.setRequiredToken(token, argumentValue(arguments, "--auth-failure-rate", "0").toDouble() / 100.0);
+        if (!server.listen()) {
+            std::cerr << "Failed to start the mock server" << std::endl;
+            return 2;
+        }
+        endpoint = QString("http://127.0.0.1:%1").arg(server.port());
+    }
+
+    QString filePath = argumentValue(arguments, "--file", QString());
+    if (filePath.isEmpty()) {
+        // Random bytes, so nothing on the path can compress or dedupe them
+        filePath = QDir::temp().filePath("screenme-load-test.bin");
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            std::cerr << "Failed to write " << filePath.toStdString() << std::endl;
+            return 2;
+        }
+        QByteArray chunk(1024, Qt::Uninitialized);
+        for (int i = 0; i < argumentValue(arguments, "--size", "512").toInt(); ++i) {
+            for (char& byte : chunk) {
+                byte = char(QRandomGenerator::global()->generate());
+            }
+            file.write(chunk);
+        }
+    }
+
+    QJsonObject config;
+    config["upload_backend"] = "screenme";
+    config["screenme_host"] = endpoint;
+    config["screenme_token"] = QString::fromUtf8(token);
+    config["upload_concurrency"] = concurrency;
+    config["upload_limit_kb_per_s"] = argumentValue(arguments, "--limit", "0").toInt();
+    UploadScheduler* scheduler = UploadScheduler::instance();
+    scheduler->applyConfig(config);
+    UploadBackend* backend = UploadBackend::create(config, &app);
+
+    qint64 peakBefore = 0;
+    qint64 workingSetBefore = 0;
+    memoryUsage(&peakBefore, &workingSetBefore);
+
+    QElapsedTimer clock;
+    clock.start();
+    QVector<qint64> latencies;
+    QMap<int, int> failures;
+    int remaining = count;
+    const UploadSource source{ filePath, QFileInfo(filePath).fileName(), "application/octet-stream" };
+    for (int i = 0; i < count; ++i) {
+        // Background priority, so the scheduler's concurrency limit applies
+        UploadTask* task = backend->upload(source, UploadPriority::Background);
+        const qint64 startedAt = clock.elapsed();
+        QObject::connect(task, &UploadTask::finished, [&, startedAt](const UploadResult& result) {
+            latencies.append(clock.elapsed() - startedAt);
+            if (!result.success) {
+                ++failures[result.httpStatus];
+            }
+            if (--remaining == 0) {
+                app.quit();
+            }
+        });
+    }
+
+    QTimer progress;
+    QObject::connect(&progress, &QTimer::timeout, [&]() {
+        UploadScheduler::Stats stats = scheduler->stats();
+        std::cout << count - remaining << "/" << count << " done, " << qRound(stats.bytesPerSecond / 1024) << " KB/s, "
+            << stats.active << " active" << std::endl;
+    });
+    progress.start(1000);
+    app.exec();
+
+    const double seconds = clock.elapsed() / 1000.0;
+    qint64 peakAfter = 0;
+    qint64 workingSetAfter = 0;
+    memoryUsage(&peakAfter, &workingSetAfter);
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](int percent) {
+        return double(latencies.at(qMin(int(latencies.size()) - 1, int(latencies.size() * percent / 100))));
+    };
+
+    QJsonObject failureCounts;
+    int failed = 0;
+    for (auto it = failures.constBegin(); it != failures.constEnd(); ++it) {
+        // Status 0 covers transport errors
+        failureCounts[QString::number(it.key())] = it.value();
+        failed += it.value();
+    }
+
+    QJsonObject report;
+    report["endpoint"] = endpoint;
+    report["publishes"] = count;
+    report["concurrency"] = concurrency;
+    report["failed"] = failed;
+    report["failures_by_status"] = failureCounts;
+    report["seconds"] = seconds;
+    report["publishes_per_s"] = count / qMax(0.001, seconds);
+    report["kb_per_s"] = scheduler->stats().bytesSent / 1024.0 / qMax(0.001, seconds);
+    report["p50_ms"] = percentile(50);
+    report["p95_ms"] = percentile(95);
+    report["p99_ms"] = percentile(99);
+    report["max_ms"] = double(latencies.last());
+    report["working_set_before_mb"] = workingSetBefore / 1048576.0;
+    report["working_set_after_mb"] = workingSetAfter / 1048576.0;
+    report["peak_working_set_mb"] = peakAfter / 1048576.0;
+    std::cout << QJsonDocument(report).toJson().constData();
+    return failed == 0 ? 0 : 1;
+}
+
+void AppCommands::compareCaptures(ConfigManager& configManager, QSystemTrayIcon& trayIcon) {
+    QString folder = configManager.loadConfig()["default_save_folder"].toString();
+    QStringList files = QFileDialog::getOpenFileNames(nullptr, "Select the two captures to compare", folder,
+        "Images (*.png *.jpg *.jpeg *.bmp)");
+    if (files.isEmpty()) {
+        return;
+    }
+    if (files.size() != 2) {
+        QMessageBox::warning(nullptr, "Compare Captures", "Please select exactly two captures.");
+        return;
+    }
+
+    // The older file is the "before" state
+    if (QFileInfo(files[0]).lastModified() > QFileInfo(files[1]).lastModified()) {
+        files.swapItemsAt(0, 1);
+    }
+
+    const QImage before(files[0]);
+    const QImage after(files[1]);
+    if (before.isNull() || after.isNull()) {
+        QMessageBox::warning(nullptr, "Compare Captures", "Failed to load " + (before.isNull() ? files[0] : files[1]));
+        return;
+    }
+    ImageDiffResult result = ImageDiff::compare(before, after, DefaultDiffTolerance);
+    QString outputPath = getUniqueFilePath(folder, "diff", "png");
+    if (!ImageDiff::exportResult(result, outputPath)) {
+        QMessageBox::critical(nullptr, "Compare Captures", "Failed to save the comparison to " + outputPath);
+        return;
+    }
+
+    QString summary = result.isIdentical()
+        ? QString("The captures are identical.")
+        : QString("%1 changed region(s), saved to %2").arg(result.regions.size()).arg(outputPath);
+    trayIcon.showMessage("Compare Captures", summary, QSystemTrayIcon::Information, 5000);
+}
+
+
+bool AppCommands::isCommandLine(const QStringList& arguments) {
+    for (const char* mode : { "--compare", "--benchmark-resample", "--mock-server", "--upload-benchmark", "--load-test",
+        "--upload", "--hotkey-self-test" }) {
+        if (arguments.contains(mode)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int AppCommands::runCommandLine(const QStringList& arguments, QApplication& app) {
+    if (arguments.contains("--compare")) {
+        return runCompareCommand(arguments);
+    }
+    if (arguments.contains("--benchmark-resample")) {
+        return runResampleBenchmark(arguments);
+    }
+    if (arguments.contains("--mock-server")) {
+        return runMockServer(arguments, app);
+    }
+    if (arguments.contains("--upload-benchmark")) {
+        return runUploadBenchmark(arguments, app);
+    }
+    if (arguments.contains("--load-test")) {
+        return runLoadTest(arguments, app);
+    }
+    if (arguments.contains("--upload")) {
+        return runUpload(arguments, app);
+    }
+    #if defined(Q_OS_LINUX)
+    // ScreenMe --hotkey-self-test
+    if (arguments.contains("--hotkey-self-test")) {
+        return EvdevHotkeys::selfTest();
+    }
+    #endif
+    return 2;
+}
@@ -0,0 +1,33 @@
+#include "include/async_task.h"
+
+namespace Async {
+    void CancelState::cancel() {
+        if (canceled) {
+            return;
+        }
+        canceled = true;
+        // One at a time: a handler can resume a coroutine that unsubscribes the others
+        while (!handlers.empty()) {
+            std::function<void()> handler = std::move(handlers.front().second);
+            handlers.erase(handlers.begin());
+            handler();
+        }
+    }
+
+    int CancelState::subscribe(std::function<void()> handler) {
+        if (canceled) {
+            return -1;
+        }
+        handlers.emplace_back(nextId, std::move(handler));
+        return nextId++;
+    }
+
+    void CancelState::unsubscribe(int id) {
+        for (auto it = handlers.begin(); it != handlers.end(); ++it) {
+            if (it->first == id) {
+                handlers.erase(it);
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,384 @@
+#include "include/automation_api.h"
+#include "include/capture_search.h"
+#include "include/job_system.h"
+#include "include/metrics_registry.h"
+#include "include/upload_scheduler.h"
+#include "include/utils.h"
+#include <QBuffer>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QUrlQuery>
+#include <QtEndian>
+#include <QDebug>
+
+namespace {
+    // JSON-RPC 2.0 error codes, the last two in the range left to servers
+    const int InvalidRequest = -32600;
+    const int MethodNotFound = -32601;
+    const int InvalidParams = -32602;
+    const int Unauthorized = -32001;
+    const int Failed = -32000;
+
+    const int MaxBatch = 64;
+    const int TokenBytes = 32;
+    const QStringList KnownEvents = { "capture.saved", "capture.indexed", "queue.changed" };
+    const QStringList EncodedFormats = { "png", "jpg", "jpeg", "webp" };
+
+    QJsonObject success(const QJsonValue& id, const QJsonObject& result) {
+        return QJsonObject{ { "jsonrpc", "2.0" }, { "id", id }, { "result", result } };
+    }
+
+    QJsonObject failure(const QJsonValue& id, int code, const QString& message) {
+        return QJsonObject{ { "jsonrpc", "2.0" }, { "id", id },
+            { "error", QJsonObject{ { "code", code }, { "message", message } } } };
+    }
+
+    // Compares in time independent of where the strings differ
+    bool tokensMatch(const QString& given, const QString& expected) {
+        const QByteArray a = given.toUtf8();
+        const QByteArray b = expected.toUtf8();
+        if (a.size() != b.size()) {
+            return false;
+        }
+        char difference = 0;
+        for (qsizetype i = 0; i < a.size(); ++i) {
+            difference |= a[i] ^ b[i];
+        }
+        return difference == 0;
+    }
+
+    // Length prefix and response of a binary frame, the payload follows
+    QByteArray frameHeader(const QJsonObject& response, qsizetype payloadBytes) {
+        const QByteArray json = QJsonDocument(response).toJson(QJsonDocument::Compact);
+        QByteArray frame;
+        frame.reserve(4 + json.size() + payloadBytes);
+        frame.resize(4);
+        qToBigEndian(quint32(json.size()), frame.data());
+        frame.append(json);
+        return frame;
+    }
+
+    QJsonObject laneStatus(JobSystem::Lane lane) {
+        const JobSystem::LaneStats stats = JobSystem::instance()->stats(lane);
+        return QJsonObject{
+            { "queued", stats.queued },
+            { "running", stats.running },
+            { "completed", stats.completed },
+            { "canceled", stats.canceled },
+            { "mean_wait_ms", stats.meanWaitMs },
+            { "p95_wait_ms", stats.p95WaitMs }
+        };
+    }
+}
+
+AutomationApi::AutomationApi(QObject* parent)
+    : QObject(parent), token(loadToken()), captureCount(0) {
+    connect(CaptureSearch::instance(), &CaptureSearch::captureIndexed, this, [this](const QString& filePath) {
+        publish("capture.indexed", QJsonObject{ { "path", filePath } });
+    });
+    connect(UploadScheduler::instance(), &UploadScheduler::statsChanged, this, [this]() {
+        // Ticks several times a second while uploading, only build the status for listeners
+        if (isSubscribed("queue.changed")) {
+            publish("queue.changed", queueStatus());
+        }
+    });
+}
+
+QString AutomationApi::loadToken() {
+    const QString path = getConfigFilePath("automation_token");
+    QFile existing(path);
+    if (existing.open(QIODevice::ReadOnly)) {
+        const QString saved = QString::fromUtf8(existing.readAll()).trimmed();
+        if (!saved.isEmpty()) {
+            return saved;
+        }
+    }
+
+    QByteArray random(TokenBytes, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(random.data()), TokenBytes / sizeof(quint32));
+    const QString created = QString::fromLatin1(random.toHex());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(created.toUtf8()) < 0 || !file.commit()) {
+        qWarning() << "Failed to save the automation token" << path;
+    }
+    QFile::setPermissions(path, QFile::ReadOwner | QFile::WriteOwner);
+    return created;
+}
+
+bool AutomationApi::isRpcMessage(const QJsonDocument& document) {
+    return document.isArray() || document.object().contains("jsonrpc");
+}
+
+void AutomationApi::addClient(QWebSocket* client) {
+    Client state;
+    const QString given = QUrlQuery(client->requestUrl()).queryItemValue("token");
+    state.authenticated = !given.isEmpty() && tokensMatch(given, token);
+    clients.insert(client, state);
+}
+
+void AutomationApi::removeClient(QWebSocket* client) {
+    clients.remove(client);
+    if (!hasAuthenticatedClient()) {
+        // Nobody left to ask for it, the frame goes back to the pool
+        lastCaptureImage = QImage();
+    }
+}
+
+bool AutomationApi::hasAuthenticatedClient() const {
+    for (const Client& state : clients) {
+        if (state.authenticated) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AutomationApi::handleMessage(QWebSocket* client, const QJsonDocument& message) {
+    // Cancelled with the socket, a closed client gets no late replies
+    Async::spawn(handle(client, message), client);
+}
+
+Async::Task<> AutomationApi::handle(QPointer<QWebSocket> client, QJsonDocument message) {
+    if (message.isObject()) {
+        Response response = co_await dispatch(client, message.object());
+        if (client) {
+            send(client, response);
+        }
+        co_return;
+    }
+
+    const QJsonArray batch = message.array();
+    if (batch.isEmpty() || batch.size() > MaxBatch) {
+        send(client, { failure(QJsonValue(), InvalidRequest, QString("A batch holds 1 to %1 requests").arg(MaxBatch)), QByteArray() });
+        co_return;
+    }
+    QJsonArray replies;
+    for (const QJsonValue& request : batch) {
+        Response response;
+        if (request.isObject()) {
+            response = co_await dispatch(client, request.toObject());
+        }
+        else {
+            response.message = failure(QJsonValue(), InvalidRequest, "Invalid request");
+        }
+        if (co_await Async::canceled() || !client) {
+            co_return;
+        }
+        // Bytes cannot go in a text array, they go out as their own frames
+        if (!response.frame.isEmpty()) {
+            send(client, response);
+        }
+        else if (!response.message.isEmpty()) {
+            replies.append(response.message);
+        }
+    }
+    if (!replies.isEmpty()) {
+        client->sendTextMessage(QString::fromUtf8(QJsonDocument(replies).toJson(QJsonDocument::Compact)));
+    }
+}
+
+Async::Task<AutomationApi::Response> AutomationApi::dispatch(QPointer<QWebSocket> client, QJsonObject request) {
+    const QJsonValue id = request.value("id");
+    const QString method = request["method"].toString();
+    const QJsonObject params = request["params"].toObject();
+    Client& state = clients[client.data()];
+
+    Response response;
+    if (request["jsonrpc"].toString() != "2.0" || method.isEmpty()) {
+        response.message = failure(id, InvalidRequest, "Invalid request");
+    }
+    else if (method == "auth.login") {
+        state.authenticated = tokensMatch(params["token"].toString(), token);
+        response.message = state.authenticated
+            ? success(id, QJsonObject{ { "authenticated", true } })
+            : failure(id, Unauthorized, "Wrong token");
+    }
+    else if (!state.authenticated) {
+        response.message = failure(id, Unauthorized, "Call auth.login with the automation token first");
+    }
+    else if (method == "capture.fullscreen") {
+        const quint64 before = captureCount;
+        emit fullscreenCaptureRequested();
+        response.message = captureCount != before
+            ? success(id, captureInfo())
+            : failure(id, Failed, "The capture was not saved");
+    }
+    else if (method == "capture.interactive") {
+        // Finishes when the user saves, which subscribers see as capture.saved
+        emit interactiveCaptureRequested();
+        response.message = success(id, QJsonObject{ { "started", true } });
+    }
+    else if (method == "capture.last") {
+        response = co_await lastCapture(id, params);
+    }
+    else if (method == "queue.status") {
+        response.message = success(id, queueStatus());
+    }
+    else if (method == "metrics.get") {
+        const QString format = params["format"].toString("json");
+        if (format == "prometheus") {
+            response.message = success(id, QJsonObject{ { "text", MetricsRegistry::instance()->prometheusText() } });
+        }
+        else if (format == "json") {
+            response.message = success(id, MetricsRegistry::instance()->toJson());
+        }
+        else {
+            response.message = failure(id, InvalidParams, "Formats: json, prometheus");
+        }
+    }
+    else if (method == "events.subscribe" || method == "events.unsubscribe") {
+        const QJsonArray events = params["events"].toArray();
+        bool valid = !events.isEmpty();
+        for (const QJsonValue& event : events) {
+            valid = valid && KnownEvents.contains(event.toString());
+        }
+        if (!valid) {
+            response.message = failure(id, InvalidParams, "Known events: " + KnownEvents.join(", "));
+        }
+        else {
+            for (const QJsonValue& event : events) {
+                if (method == "events.subscribe") {
+                    state.events.insert(event.toString());
+                }
+                else {
+                    state.events.remove(event.toString());
+                }
+            }
+            QStringList subscribed(state.events.begin(), state.events.end());
+            subscribed.sort();
+            response.message = success(id, QJsonObject{ { "events", QJsonArray::fromStringList(subscribed) } });
+        }
+    }
+    else {
+        response.message = failure(id, MethodNotFound, "Unknown method " + method);
+    }
+
+    // Notifications get no reply
+    if (!request.contains("id")) {
+        response = Response();
+    }
+    co_return response;
+}
+
+Async::Task<AutomationApi::Response> AutomationApi::lastCapture(QJsonValue id, QJsonObject params) {
+    Response response;
+    const QString format = params["format"].toString("png").toLower();
+    const int quality = params["quality"].toInt(-1);
+    if (format != "raw" && !EncodedFormats.contains(format)) {
+        response.message = failure(id, InvalidParams, "Formats: raw, " + EncodedFormats.join(", "));
+        co_return response;
+    }
+    if (lastCapturePath.isEmpty()) {
+        response.message = failure(id, Failed, "Nothing was captured yet");
+        co_return response;
+    }
+
+    QJsonObject result = captureInfo();
+    result["format"] = format;
+    if (format == "raw") {
+        // 32 bits per pixel rows are never padded
+        result["pixel_format"] = "bgra8";
+        result["bytes_per_line"] = lastCaptureSize.width() * 4;
+    }
+    const QJsonObject header = success(id, result);
+    const QImage kept = lastCaptureImage;
+    const QString path = lastCapturePath;
+
+    // Encoded straight into the frame that goes out, behind the response
+    auto frame = co_await JobSystem::instance()->run(JobSystem::Lane::Interactive,
+        [kept, path, format, quality, header](const JobToken&) {
+            // Read back from the saved file unless a client was connected when it was taken
+            const QImage image = kept.isNull() ? QImage(path) : kept;
+            if (image.isNull()) {
+                return QByteArray();
+            }
+            if (format == "raw") {
+                const QImage pixels = image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32
+                    ? image : image.convertToFormat(QImage::Format_ARGB32);
+                QByteArray bytes = frameHeader(header, pixels.sizeInBytes());
+                bytes.append(reinterpret_cast<const char*>(pixels.constBits()), pixels.sizeInBytes());
+                return bytes;
+            }
+            QByteArray bytes = frameHeader(header, image.sizeInBytes() / 4);
+            const qsizetype headerBytes = bytes.size();
+            QBuffer buffer(&bytes);
+            buffer.open(QIODevice::Append);
+            if (!image.save(&buffer, format.toLatin1().constData(), quality)) {
+                bytes.truncate(headerBytes);
+            }
+            return bytes;
+        });
+    const qsizetype headerBytes = frameHeader(header, 0).size();
+    if (!frame || frame->size() <= headerBytes) {
+        response.message = failure(id, Failed, "Failed to read or encode the capture as " + format);
+        co_return response;
+    }
+    response.message = header;
+    response.frame = std::move(*frame);
+    co_return response;
+}
+
+QJsonObject AutomationApi::captureInfo() const {
+    return QJsonObject{
+        { "path", lastCapturePath },
+        { "width", lastCaptureSize.width() },
+        { "height", lastCaptureSize.height() }
+    };
+}
+
+QJsonObject AutomationApi::queueStatus() const {
+    const UploadScheduler::Stats uploads = UploadScheduler::instance()->stats();
+    return QJsonObject{
+        { "uploads", QJsonObject{
+            { "active", uploads.active },
+            { "queued", uploads.queued },
+            { "bytes_per_s", uploads.bytesPerSecond },
+            { "bytes_sent", uploads.bytesSent } } },
+        { "jobs", QJsonObject{
+            { "interactive", laneStatus(JobSystem::Lane::Interactive) },
+            { "background", laneStatus(JobSystem::Lane::Background) } } }
+    };
+}
+
+void AutomationApi::send(QWebSocket* client, const Response& response) {
+    if (!response.frame.isEmpty()) {
+        client->sendBinaryMessage(response.frame);
+    }
+    else if (!response.message.isEmpty()) {
+        client->sendTextMessage(QString::fromUtf8(QJsonDocument(response.message).toJson(QJsonDocument::Compact)));
+    }
+}
+
+bool AutomationApi::isSubscribed(const QString& event) const {
+    for (const Client& state : clients) {
+        if (state.authenticated && state.events.contains(event)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AutomationApi::publish(const QString& event, const QJsonObject& data) {
+    const QJsonObject notification{
+        { "jsonrpc", "2.0" },
+        { "method", "event" },
+        { "params", QJsonObject{ { "event", event }, { "data", data } } }
+    };
+    const QString text = QString::fromUtf8(QJsonDocument(notification).toJson(QJsonDocument::Compact));
+    for (auto it = clients.constBegin(); it != clients.constEnd(); ++it) {
+        if (it.value().authenticated && it.value().events.contains(event)) {
+            it.key()->sendTextMessage(text);
+        }
+    }
+}
+
+void AutomationApi::onCaptureSaved(const QString& filePath, const QImage& image) {
+    lastCapturePath = filePath;
+    lastCaptureSize = image.size();
+    // Only held for connected clients, otherwise it would pin a pooled frame for the life
+    // of the tray process; capture.last reads the file back instead
+    lastCaptureImage = hasAuthenticatedClient() ? image : QImage();
+    ++captureCount;
+    publish("capture.saved", captureInfo());
+}
@@ -0,0 +1,353 @@
+#include "include/capture_search.h"
+#include "include/job_system.h"
+#include "include/utils.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSaveFile>
+#include <QSet>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+#include <memory>
+#ifdef SCREENME_TESSERACT
+#include <tesseract/baseapi.h>
+#endif
+
+namespace {
+    // Compact once more than half of the file is superseded lines
+    const int CompactMinLines = 256;
+    // Longer runs are OCR noise, hashes or URLs nobody types back
+    const int MaxWordLength = 32;
+    // Screen text is around 96 dpi, Tesseract reads best at twice that
+    const int UpscaleMaxWidth = 2560;
+    const int UpscaledDpi = 192;
+
+#ifdef SCREENME_TESSERACT
+    // Used by one job at a time, CaptureSearch indexes captures one after the other
+    std::unique_ptr<tesseract::TessBaseAPI> engine;
+    QString engineLanguage;
+#endif
+
+    QString recognizeText(const QString& filePath, const QString& language, const JobToken& token) {
+#ifdef SCREENME_TESSERACT
+        if (!engine || engineLanguage != language) {
+            engine = std::make_unique<tesseract::TessBaseAPI>();
+            if (engine->Init(nullptr, language.toUtf8().constData()) != 0) {
+                qWarning() << "Failed to load the OCR language" << language;
+                engine.reset();
+                return QString();
+            }
+            engineLanguage = language;
+        }
+
+        QImage image(filePath);
+        if (image.isNull() || token.isCanceled()) {
+            return QString();
+        }
+        image = image.convertToFormat(QImage::Format_Grayscale8);
+        int dpi = 96;
+        if (image.width() <= UpscaleMaxWidth) {
+            image = image.scaled(image.size() * 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            dpi = UpscaledDpi;
+        }
+        if (token.isCanceled()) {
+            return QString();
+        }
+        engine->SetImage(image.constBits(), image.width(), image.height(), 1, int(image.bytesPerLine()));
+        engine->SetSourceResolution(dpi);
+        std::unique_ptr<char[]> text(engine->GetUTF8Text());
+        engine->Clear();
+        return text ? QString::fromUtf8(text.get()) : QString();
+#else
+        Q_UNUSED(filePath);
+        Q_UNUSED(language);
+        Q_UNUSED(token);
+        return QString();
+#endif
+    }
+}
+
+CaptureSearch::CaptureSearch(QObject* parent)
+    : QObject(parent), indexPath(getConfigFilePath("capture_index.tsv")), deadCount(0), lineCount(0),
+      indexing(false), releaseEngineWhenIdle(false), ocrEnabled(true), ocrLanguage("eng") {
+    load();
+}
+
+CaptureSearch* CaptureSearch::instance() {
+    static CaptureSearch* search = new CaptureSearch(QCoreApplication::instance());
+    return search;
+}
+
+void CaptureSearch::applyConfig(const QJsonObject& config) {
+    ocrEnabled = config["ocr_enabled"].toBool(true);
+    ocrLanguage = config["ocr_language"].toString("eng");
+}
+
+QStringList CaptureSearch::tokenize(const QString& text) {
+    QStringList words;
+    QSet<QString> seen;
+    const QString folded = text.toCaseFolded();
+    qsizetype start = -1;
+    for (qsizetype i = 0; i <= folded.size(); ++i) {
+        if (i < folded.size() && folded[i].isLetterOrNumber()) {
+            if (start < 0) {
+                start = i;
+            }
+            continue;
+        }
+        if (start >= 0) {
+            const qsizetype length = i - start;
+            // Single characters are mostly OCR debris
+            if (length >= 2 && length <= MaxWordLength) {
+                const QString word = folded.mid(start, length);
+                if (!seen.contains(word)) {
+                    seen.insert(word);
+                    words.append(word);
+                }
+            }
+            start = -1;
+        }
+    }
+    return words;
+}
+
+void CaptureSearch::addCapture(const QString& filePath, const QStringList& annotationText) {
+    pending.append({ filePath, annotationText });
+    if (!indexing) {
+        indexing = true;
+        Async::spawn(indexPending(), this);
+    }
+}
+
+void CaptureSearch::releaseOcrEngine() {
+    if (indexing) {
+        releaseEngineWhenIdle = true;
+        return;
+    }
+    releaseEngineWhenIdle = false;
+#ifdef SCREENME_TESSERACT
+    // No job holds it between captures
+    engine.reset();
+    engineLanguage.clear();
+#endif
+}
+
+Async::Task<> CaptureSearch::indexPending() {
+    while (!pending.isEmpty()) {
+        const PendingCapture capture = pending.takeFirst();
+        co_await indexCapture(capture.filePath, capture.annotationText);
+    }
+    indexing = false;
+    if (releaseEngineWhenIdle) {
+        releaseOcrEngine();
+    }
+}
+
+Async::Task<> CaptureSearch::indexCapture(QString filePath, QStringList annotationText) {
+    const bool ocr = ocrEnabled;
+    const QString language = ocrLanguage;
+    auto words = co_await JobSystem::instance()->run(JobSystem::Lane::Background,
+        [filePath, annotationText, ocr, language](const JobToken& token) {
+            const QString text = ocr ? recognizeText(filePath, language, token) : QString();
+            return tokenize(text + '\n' + annotationText.join('\n'));
+        });
+    const QFileInfo info(filePath);
+    if (!words || !info.exists()) {
+        co_return;
+    }
+    insert(filePath, info.lastModified().toMSecsSinceEpoch(), *words);
+    append(documents.last(), *words);
+    emit captureIndexed(filePath);
+}
+
+QVector<CaptureSearch::Hit> CaptureSearch::search(const QString& query, int limit) {
+    QVector<Hit> hits;
+    const QStringList words = tokenize(query);
+    if (words.isEmpty()) {
+        return hits;
+    }
+    // The last word may still be being typed, unless a space follows it
+    const bool lastIsPrefix = query.back().isLetterOrNumber();
+    QVector<QVector<quint32>> lists;
+    for (int i = 0; i < words.size(); ++i) {
+        if (i == words.size() - 1 && lastIsPrefix) {
+            lists.append(prefixPostings(words[i]));
+            continue;
+        }
+        auto found = postings.constFind(words[i]);
+        if (found == postings.constEnd()) {
+            return hits;
+        }
+        lists.append(found.value());
+    }
+
+    // Walk the shortest list and look its ids up in the others
+    std::sort(lists.begin(), lists.end(), [](const QVector<quint32>& a, const QVector<quint32>& b) {
+        return a.size() < b.size();
+    });
+    QVector<quint32> matches = lists.first();
+    for (int i = 1; i < lists.size() && !matches.isEmpty(); ++i) {
+        const QVector<quint32>& list = lists[i];
+        auto from = list.constBegin();
+        QVector<quint32> kept;
+        for (quint32 id : matches) {
+            from = std::lower_bound(from, list.constEnd(), id);
+            if (from == list.constEnd()) {
+                break;
+            }
+            if (*from == id) {
+                kept.append(id);
+            }
+        }
+        matches = kept;
+    }
+
+    bool removed = false;
+    for (auto it = matches.crbegin(); it != matches.crend() && hits.size() < limit; ++it) {
+        const Document& document = documents[*it];
+        if (!document.alive) {
+            continue;
+        }
+        // Deleted or moved since it was indexed
+        if (!QFileInfo::exists(document.filePath)) {
+            remove(int(*it));
+            removed = true;
+            continue;
+        }
+        hits.append({ document.filePath, QDateTime::fromMSecsSinceEpoch(document.capturedMs) });
+    }
+    if (removed && lineCount > CompactMinLines && lineCount > 2 * captureCount()) {
+        compact();
+    }
+    return hits;
+}
+
+QVector<quint32> CaptureSearch::prefixPostings(const QString& prefix) const {
+    QVector<quint32> merged;
+    int listCount = 0;
+    for (auto it = postings.lowerBound(prefix); it != postings.constEnd() && it.key().startsWith(prefix); ++it) {
+        if (listCount++ == 0) {
+            merged = it.value();
+        }
+        else {
+            merged += it.value();
+        }
+    }
+    if (listCount > 1) {
+        std::sort(merged.begin(), merged.end());
+        merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    }
+    return merged;
+}
+
+void CaptureSearch::insert(const QString& filePath, qint64 capturedMs, const QStringList& words) {
+    auto previous = documentByPath.constFind(filePath);
+    if (previous != documentByPath.constEnd()) {
+        remove(previous.value());
+    }
+    const quint32 id = quint32(documents.size());
+    Document document;
+    document.filePath = filePath;
+    document.capturedMs = capturedMs;
+    documents.append(document);
+    documentByPath.insert(filePath, int(id));
+    for (const QString& word : words) {
+        postings[word].append(id);
+    }
+}
+
+void CaptureSearch::remove(int id) {
+    Document& document = documents[id];
+    if (!document.alive) {
+        return;
+    }
+    // Its ids stay in the postings and are skipped until the next compaction
+    document.alive = false;
+    ++deadCount;
+    if (documentByPath.value(document.filePath, -1) == id) {
+        documentByPath.remove(document.filePath);
+    }
+}
+
+void CaptureSearch::load() {
+    QFile file(indexPath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QStringList fields = in.readLine().split('\t');
+        ++lineCount;
+        if (fields.size() != 3) {
+            continue;
+        }
+        // Later lines win, a capture saved again over the same file replaces the older words
+        insert(fields[1], fields[0].toLongLong(), fields[2].split(' ', Qt::SkipEmptyParts));
+    }
+    file.close();
+    if (lineCount > CompactMinLines && lineCount > 2 * captureCount()) {
+        compact();
+    }
+}
+
+void CaptureSearch::append(const Document& document, const QStringList& words) {
+    QFile file(indexPath);
+    if (!file.open(QIODevice::Append | QIODevice::Text)) {
+        qWarning() << "Failed to write the capture index" << indexPath;
+        return;
+    }
+    QTextStream out(&file);
+    out << document.capturedMs << '\t' << document.filePath << '\t' << words.join(' ') << '\n';
+    ++lineCount;
+    file.close();
+
+    if (lineCount > CompactMinLines && lineCount > 2 * captureCount()) {
+        compact();
+    }
+}
+
+void CaptureSearch::compact() {
+    // Words per live capture, back out of the postings
+    QVector<QStringList> words(documents.size());
+    for (auto it = postings.constBegin(); it != postings.constEnd(); ++it) {
+        for (quint32 id : it.value()) {
+            if (documents[id].alive) {
+                words[id].append(it.key());
+            }
+        }
+    }
+    QVector<Document> live;
+    QVector<QStringList> liveWords;
+    for (int id = 0; id < documents.size(); ++id) {
+        if (documents[id].alive) {
+            live.append(documents[id]);
+            liveWords.append(words[id]);
+        }
+    }
+
+    QSaveFile file(indexPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream out(&file);
+    for (int i = 0; i < live.size(); ++i) {
+        out << live[i].capturedMs << '\t' << live[i].filePath << '\t' << liveWords[i].join(' ') << '\n';
+    }
+    out.flush();
+    if (!file.commit()) {
+        qWarning() << "Failed to compact the capture index" << indexPath;
+        return;
+    }
+
+    // Renumber the live captures so the postings drop the dead ids too
+    documents.clear();
+    documentByPath.clear();
+    postings.clear();
+    deadCount = 0;
+    for (int i = 0; i < live.size(); ++i) {
+        insert(live[i].filePath, live[i].capturedMs, liveWords[i]);
+    }
+    lineCount = live.size();
+}
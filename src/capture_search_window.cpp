@@ -0,0 +1,51 @@
+#include "include/capture_search_window.h"
+#include <QVBoxLayout>
+#include <QDesktopServices>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QUrl>
+#include "include/capture_search.h"
+
+CaptureSearchWindow::CaptureSearchWindow(QWidget* parent)
+    : QDialog(parent) {
+    setWindowTitle("Search Captures");
+    setAttribute(Qt::WA_DeleteOnClose);
+    setAttribute(Qt::WA_QuitOnClose, false);
+    resize(520, 420);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    queryEdit = new QLineEdit(this);
+    queryEdit->setPlaceholderText("Text shown in the capture or written on it");
+    resultList = new QListWidget(this);
+    statusLabel = new QLabel(this);
+    layout->addWidget(queryEdit);
+    layout->addWidget(resultList);
+    layout->addWidget(statusLabel);
+
+    connect(queryEdit, &QLineEdit::textChanged, this, &CaptureSearchWindow::updateResults);
+    connect(CaptureSearch::instance(), &CaptureSearch::captureIndexed, this, &CaptureSearchWindow::updateResults);
+    connect(resultList, &QListWidget::itemActivated, this, &CaptureSearchWindow::openResult);
+    updateResults();
+}
+
+void CaptureSearchWindow::updateResults() {
+    CaptureSearch* search = CaptureSearch::instance();
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<CaptureSearch::Hit> hits = search->search(queryEdit->text());
+    const double elapsedMs = timer.nsecsElapsed() / 1e6;
+
+    resultList->clear();
+    for (const CaptureSearch::Hit& hit : hits) {
+        QListWidgetItem* item = new QListWidgetItem(
+            QFileInfo(hit.filePath).fileName() + "  (" + hit.captured.toString("yyyy-MM-dd hh:mm") + ")", resultList);
+        item->setData(Qt::UserRole, hit.filePath);
+        item->setToolTip(hit.filePath);
+    }
+    statusLabel->setText(QString("%1 match(es) in %2 captures, %3 ms")
+        .arg(hits.size()).arg(search->captureCount()).arg(elapsedMs, 0, 'f', 2));
+}
+
+void CaptureSearchWindow::openResult(QListWidgetItem* item) {
+    QDesktopServices::openUrl(QUrl::fromLocalFile(item->data(Qt::UserRole).toString()));
+}
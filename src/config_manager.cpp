@@ -12,10 +12,23 @@ ConfigManager::ConfigManager(const QString& configPath) : configPath(configPath)
         QJsonObject defaultConfig;
         defaultConfig["screenshot_hotkey"] = "Print";
         defaultConfig["fullscreen_hotkey"] = "Ctrl+Shift+Print";
-        defaultConfig["file_extension"] = "png";
+        defaultConfig["file_extension"] = "auto";
         defaultConfig["image_quality"] = 90;
         defaultConfig["default_save_folder"] = QDir::homePath() + "/Pictures/ScreenMe";
         defaultConfig["start_with_system"] = true;
+        defaultConfig["export_max_dimension"] = 0;
+        defaultConfig["export_scale_percent"] = 100;
+        defaultConfig["quantize_uploads"] = false;
+        defaultConfig["upload_limit_kb_per_s"] = 0;
+        defaultConfig["upload_concurrency"] = 2;
+        defaultConfig["upload_backend"] = "screenme";
+        defaultConfig["progressive_publish"] = true;
+        defaultConfig["frame_pool_limit_mb"] = 256;
+        defaultConfig["frame_pool_huge_pages"] = false;
+        defaultConfig["idle_pool_keep_mb"] = 64;
+        defaultConfig["ocr_enabled"] = true;
+        defaultConfig["ocr_language"] = "eng";
+        defaultConfig["metrics_export_interval_s"] = 15;
         saveConfig(defaultConfig);
     }
 }
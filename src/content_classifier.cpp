@@ -0,0 +1,154 @@
+#include "include/content_classifier.h"
+#include <QElapsedTimer>
+#include <QImageWriter>
+#include <QVector>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCREENME_CLASSIFY_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Roughly 64k samples whatever the capture size: 256 rows of 64 groups of 4 pixels
+    const int SampleRows = 256;
+    const int SampleGroups = 64;
+    const int GradientBins = 32;
+    const int EdgeThreshold = 96;
+
+    const int PhotoMinColors = 512;
+    const double PhotoMinEntropy = 3.0;
+    const double PhotoMaxFlat = 0.35;
+    const double PhotoMaxEdges = 0.2;
+
+    // Luma of four pixels, BT.601 weights in 8-bit fixed point
+    inline void luma4(const quint32* pixels, int* out) {
+#ifdef SCREENME_CLASSIFY_SSE2
+        const __m128i mask = _mm_set1_epi32(0xff);
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+        const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+        const __m128i b = _mm_and_si128(p, mask);
+        // Products stay below 2^16, so the 16-bit multiply is exact in the low half of each lane
+        __m128i sum = _mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(77)), _mm_mullo_epi16(g, _mm_set1_epi32(150)));
+        sum = _mm_add_epi32(sum, _mm_mullo_epi16(b, _mm_set1_epi32(29)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_srli_epi32(sum, 8));
+#else
+        for (int i = 0; i < 4; ++i) {
+            out[i] = (qRed(pixels[i]) * 77 + qGreen(pixels[i]) * 150 + qBlue(pixels[i]) * 29) >> 8;
+        }
+#endif
+    }
+
+    class ColorSet {
+    public:
+        ColorSet() : table(ContentClassifier::ColorCap * 2, 0), used(ContentClassifier::ColorCap * 2, false), count(0) {}
+
+        void insert(quint32 color) {
+            if (count >= ContentClassifier::ColorCap) {
+                return;
+            }
+            const int mask = table.size() - 1;
+            int slot = int((color * 2654435761u) >> 16) & mask;
+            while (used[slot]) {
+                if (table[slot] == color) {
+                    return;
+                }
+                slot = (slot + 1) & mask;
+            }
+            used[slot] = true;
+            table[slot] = color;
+            ++count;
+        }
+
+        int size() const { return count; }
+
+    private:
+        QVector<quint32> table;
+        QVector<bool> used;
+        int count;
+    };
+}
+
+bool ContentAnalysis::isPhotographic() const {
+    // Photos have many colours and gradients spread over every strength; dense hard edges
+    // on top of that (code, spreadsheets on a gradient background) still favour png
+    return sampledColors >= PhotoMinColors
+        && gradientEntropy >= PhotoMinEntropy
+        && flatFraction <= PhotoMaxFlat
+        && edgeDensity <= PhotoMaxEdges;
+}
+
+ContentAnalysis ContentClassifier::analyze(const QImage& image) {
+    ContentAnalysis analysis;
+    if (image.width() < 5 || image.height() < 2) {
+        return analysis;
+    }
+    QElapsedTimer timer;
+    timer.start();
+
+    const QImage source = (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32
+        || image.format() == QImage::Format_ARGB32_Premultiplied) ? image : image.convertToFormat(QImage::Format_RGB32);
+
+    const int rows = qMin(SampleRows, source.height() - 1);
+    const int groupsPerRow = qMin(SampleGroups, (source.width() - 1) / 4);
+    // Groups are spread over the row, the last one still needs the pixel to its right
+    const int groupStride = qMax(4, ((source.width() - 5) / qMax(1, groupsPerRow - 1)) & ~3);
+
+    quint32 histogram[GradientBins] = {};
+    int samples = 0;
+    int edges = 0;
+    int flat = 0;
+    ColorSet colors;
+
+    int luma[4], right[4], below[4];
+    for (int row = 0; row < rows; ++row) {
+        const int y = int(qint64(row) * (source.height() - 1) / rows);
+        const quint32* line = reinterpret_cast<const quint32*>(source.constScanLine(y));
+        const quint32* next = reinterpret_cast<const quint32*>(source.constScanLine(y + 1));
+        for (int group = 0; group < groupsPerRow; ++group) {
+            const int x = group * groupStride;
+            if (x + 5 > source.width()) {
+                break;
+            }
+            luma4(line + x, luma);
+            luma4(line + x + 1, right);
+            luma4(next + x, below);
+            for (int i = 0; i < 4; ++i) {
+                const int gradient = std::abs(luma[i] - right[i]) + std::abs(luma[i] - below[i]);
+                histogram[qMin(GradientBins - 1, gradient / 8)]++;
+                edges += gradient >= EdgeThreshold;
+                flat += gradient == 0;
+                colors.insert(line[x + i] & 0xffffff);
+            }
+            samples += 4;
+        }
+    }
+
+    if (samples > 0) {
+        double entropy = 0.0;
+        for (quint32 count : histogram) {
+            if (count > 0) {
+                const double p = double(count) / samples;
+                entropy -= p * std::log2(p);
+            }
+        }
+        analysis.gradientEntropy = entropy;
+        analysis.edgeDensity = double(edges) / samples;
+        analysis.flatFraction = double(flat) / samples;
+    }
+    analysis.sampledColors = colors.size();
+    analysis.elapsedMs = timer.nsecsElapsed() / 1e6;
+    return analysis;
+}
+
+QString ContentClassifier::chooseExtension(const QImage& image, const QString& configured) {
+    if (configured != "auto") {
+        return configured;
+    }
+    if (!analyze(image).isPhotographic()) {
+        return "png";
+    }
+    static const bool hasWebp = QImageWriter::supportedImageFormats().contains("webp");
+    return hasWebp ? "webp" : "jpg";
+}
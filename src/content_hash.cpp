@@ -0,0 +1,297 @@
+#include "include/content_hash.h"
+#include <QFile>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCREENME_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace {
+    const quint32 Prime32_1 = 0x9E3779B1U;
+    const quint32 Prime32_2 = 0x85EBCA77U;
+    const quint32 Prime32_3 = 0xC2B2AE3DU;
+    const quint64 Prime64_1 = 0x9E3779B185EBCA87ULL;
+    const quint64 Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const quint64 Prime64_3 = 0x165667B19E3779F9ULL;
+    const quint64 Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+    const quint64 Prime64_5 = 0x27D4EB2F165667C5ULL;
+    const quint64 PrimeMx1 = 0x165667919E3779F9ULL;
+    const quint64 PrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+    const int StripeLength = 64;
+    const int SecretConsumeRate = 8;
+    const int AccumulatorCount = 8;
+    const int SecretSize = 192;
+    const int SecretSizeMin = 136;
+    const int MidSizeMax = 240;
+    const int MidSizeStartOffset = 3;
+    const int MidSizeLastOffset = 17;
+    const int SecretLastAccStart = 7;
+    const int SecretMergeAccsStart = 11;
+
+    // Default secret of the reference implementation
+    alignas(16) const quint8 Secret[SecretSize] = {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+    };
+
+    // Loads are memcpy based, the input has no alignment guarantee. Little-endian targets only.
+    inline quint32 read32(const quint8* p) {
+        quint32 value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline quint64 read64(const quint8* p) {
+        quint64 value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline quint64 rotl64(quint64 value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline quint64 swap64(quint64 value) {
+        return ((value << 56) & 0xff00000000000000ULL) | ((value << 40) & 0x00ff000000000000ULL)
+            | ((value << 24) & 0x0000ff0000000000ULL) | ((value << 8) & 0x000000ff00000000ULL)
+            | ((value >> 8) & 0x00000000ff000000ULL) | ((value >> 24) & 0x0000000000ff0000ULL)
+            | ((value >> 40) & 0x000000000000ff00ULL) | ((value >> 56) & 0x00000000000000ffULL);
+    }
+
+    // Low and high halves of the 128-bit product, folded together
+    inline quint64 mul128Fold64(quint64 lhs, quint64 rhs) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        quint64 high;
+        const quint64 low = _umul128(lhs, rhs, &high);
+        return low ^ high;
+#elif defined(__SIZEOF_INT128__)
+        const unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+        return quint64(product) ^ quint64(product >> 64);
+#else
+        const quint64 loLo = (lhs & 0xFFFFFFFFULL) * (rhs & 0xFFFFFFFFULL);
+        const quint64 hiLo = (lhs >> 32) * (rhs & 0xFFFFFFFFULL);
+        const quint64 loHi = (lhs & 0xFFFFFFFFULL) * (rhs >> 32);
+        const quint64 hiHi = (lhs >> 32) * (rhs >> 32);
+        const quint64 cross = (loLo >> 32) + (hiLo & 0xFFFFFFFFULL) + loHi;
+        const quint64 upper = (hiLo >> 32) + (cross >> 32) + hiHi;
+        const quint64 lower = (cross << 32) | (loLo & 0xFFFFFFFFULL);
+        return lower ^ upper;
+#endif
+    }
+
+    inline quint64 xxh64Avalanche(quint64 hash) {
+        hash ^= hash >> 33;
+        hash *= Prime64_2;
+        hash ^= hash >> 29;
+        hash *= Prime64_3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    inline quint64 avalanche(quint64 hash) {
+        hash ^= hash >> 37;
+        hash *= PrimeMx1;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    inline quint64 rrmxmx(quint64 hash, quint64 length) {
+        hash ^= rotl64(hash, 49) ^ rotl64(hash, 24);
+        hash *= PrimeMx2;
+        hash ^= (hash >> 35) + length;
+        hash *= PrimeMx2;
+        return hash ^ (hash >> 28);
+    }
+
+    inline quint64 mix16(const quint8* input, const quint8* secret) {
+        return mul128Fold64(read64(input) ^ read64(secret), read64(input + 8) ^ read64(secret + 8));
+    }
+
+    quint64 hashUpTo16(const quint8* input, quint64 length) {
+        if (length > 8) {
+            const quint64 low = read64(input) ^ (read64(Secret + 24) ^ read64(Secret + 32));
+            const quint64 high = read64(input + length - 8) ^ (read64(Secret + 40) ^ read64(Secret + 48));
+            return avalanche(length + swap64(low) + high + mul128Fold64(low, high));
+        }
+        if (length >= 4) {
+            const quint64 combined = read32(input + length - 4) + (quint64(read32(input)) << 32);
+            return rrmxmx(combined ^ (read64(Secret + 8) ^ read64(Secret + 16)), length);
+        }
+        if (length > 0) {
+            const quint32 combined = (quint32(input[0]) << 16) | (quint32(input[length >> 1]) << 24)
+                | quint32(input[length - 1]) | (quint32(length) << 8);
+            return xxh64Avalanche(quint64(combined ^ (read32(Secret) ^ read32(Secret + 4))));
+        }
+        return xxh64Avalanche(read64(Secret + 56) ^ read64(Secret + 64));
+    }
+
+    quint64 hashUpTo128(const quint8* input, quint64 length) {
+        quint64 acc = length * Prime64_1;
+        if (length > 32) {
+            if (length > 64) {
+                if (length > 96) {
+                    acc += mix16(input + 48, Secret + 96);
+                    acc += mix16(input + length - 64, Secret + 112);
+                }
+                acc += mix16(input + 32, Secret + 64);
+                acc += mix16(input + length - 48, Secret + 80);
+            }
+            acc += mix16(input + 16, Secret + 32);
+            acc += mix16(input + length - 32, Secret + 48);
+        }
+        acc += mix16(input, Secret);
+        acc += mix16(input + length - 16, Secret + 16);
+        return avalanche(acc);
+    }
+
+    quint64 hashUpTo240(const quint8* input, quint64 length) {
+        quint64 acc = length * Prime64_1;
+        const int rounds = int(length / 16);
+        for (int i = 0; i < 8; ++i) {
+            acc += mix16(input + 16 * i, Secret + 16 * i);
+        }
+        acc = avalanche(acc);
+        for (int i = 8; i < rounds; ++i) {
+            acc += mix16(input + 16 * i, Secret + 16 * (i - 8) + MidSizeStartOffset);
+        }
+        acc += mix16(input + length - 16, Secret + SecretSizeMin - MidSizeLastOffset);
+        return avalanche(acc);
+    }
+
+    // One 64-byte stripe into the eight accumulators
+    inline void accumulateStripe(quint64* acc, const quint8* input, const quint8* secret) {
+#ifdef SCREENME_HASH_SSE2
+        __m128i* lanes = reinterpret_cast<__m128i*>(acc);
+        for (int i = 0; i < StripeLength / 16; ++i) {
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+            const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+            const __m128i dataKey = _mm_xor_si128(data, key);
+            // 32x32->64 products of the low and high half of every key-mixed lane
+            const __m128i product = _mm_mul_epu32(dataKey, _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)));
+            // Each lane also takes in its neighbour's raw input
+            const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            lanes[i] = _mm_add_epi64(product, _mm_add_epi64(lanes[i], swapped));
+        }
+#else
+        for (int i = 0; i < AccumulatorCount; ++i) {
+            const quint64 data = read64(input + 8 * i);
+            const quint64 dataKey = data ^ read64(secret + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += quint64(quint32(dataKey)) * (dataKey >> 32);
+        }
+#endif
+    }
+
+    inline void scramble(quint64* acc, const quint8* secret) {
+#ifdef SCREENME_HASH_SSE2
+        __m128i* lanes = reinterpret_cast<__m128i*>(acc);
+        const __m128i prime = _mm_set1_epi32(int(Prime32_1));
+        for (int i = 0; i < StripeLength / 16; ++i) {
+            const __m128i mixed = _mm_xor_si128(lanes[i], _mm_srli_epi64(lanes[i], 47));
+            const __m128i dataKey = _mm_xor_si128(mixed, _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i));
+            // 64-bit multiply by a 32-bit prime out of two 32x32->64 products
+            const __m128i low = _mm_mul_epu32(dataKey, prime);
+            const __m128i high = _mm_mul_epu32(_mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            lanes[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+        }
+#else
+        for (int i = 0; i < AccumulatorCount; ++i) {
+            quint64 value = acc[i];
+            value ^= value >> 47;
+            value ^= read64(secret + 8 * i);
+            acc[i] = value * Prime32_1;
+        }
+#endif
+    }
+
+    quint64 hashLong(const quint8* input, quint64 length) {
+        alignas(16) quint64 acc[AccumulatorCount] = {
+            Prime32_3, Prime64_1, Prime64_2, Prime64_3, Prime64_4, Prime32_2, Prime64_5, Prime32_1
+        };
+        const int stripesPerBlock = (SecretSize - StripeLength) / SecretConsumeRate;
+        const quint64 blockLength = quint64(StripeLength) * stripesPerBlock;
+        const quint64 blocks = (length - 1) / blockLength;
+
+        for (quint64 block = 0; block < blocks; ++block) {
+            const quint8* blockStart = input + block * blockLength;
+            for (int stripe = 0; stripe < stripesPerBlock; ++stripe) {
+                accumulateStripe(acc, blockStart + stripe * StripeLength, Secret + stripe * SecretConsumeRate);
+            }
+            scramble(acc, Secret + SecretSize - StripeLength);
+        }
+
+        const quint8* tail = input + blocks * blockLength;
+        const int stripes = int(((length - 1) - blockLength * blocks) / StripeLength);
+        for (int stripe = 0; stripe < stripes; ++stripe) {
+            accumulateStripe(acc, tail + stripe * StripeLength, Secret + stripe * SecretConsumeRate);
+        }
+        // The last stripe always ends on the last byte, overlapping the previous one if needed
+        accumulateStripe(acc, input + length - StripeLength, Secret + SecretSize - StripeLength - SecretLastAccStart);
+
+        quint64 result = length * Prime64_1;
+        const quint8* mergeSecret = Secret + SecretMergeAccsStart;
+        for (int i = 0; i < 4; ++i) {
+            result += mul128Fold64(acc[2 * i] ^ read64(mergeSecret + 16 * i), acc[2 * i + 1] ^ read64(mergeSecret + 16 * i + 8));
+        }
+        return avalanche(result);
+    }
+}
+
+quint64 ContentHash::xxh3(const void* data, qsizetype length) {
+    const quint8* input = static_cast<const quint8*>(data);
+    const quint64 size = quint64(length);
+    if (size <= 16) {
+        return hashUpTo16(input, size);
+    }
+    if (size <= 128) {
+        return hashUpTo128(input, size);
+    }
+    if (size <= quint64(MidSizeMax)) {
+        return hashUpTo240(input, size);
+    }
+    return hashLong(input, size);
+}
+
+quint64 ContentHash::ofFile(const QString& filePath, bool* ok) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (ok) {
+            *ok = false;
+        }
+        return 0;
+    }
+    if (ok) {
+        *ok = true;
+    }
+    if (file.size() == 0) {
+        return xxh3(nullptr, 0);
+    }
+    const uchar* mapped = file.map(0, file.size());
+    if (mapped) {
+        const quint64 hash = xxh3(mapped, file.size());
+        file.unmap(const_cast<uchar*>(mapped));
+        return hash;
+    }
+    const QByteArray bytes = file.readAll();
+    return xxh3(bytes.constData(), bytes.size());
+}
+
+QString ContentHash::toHex(quint64 hash) {
+    return QString("%1").arg(hash, 16, 16, QChar('0'));
+}
@@ -0,0 +1,77 @@
+#include "include/desktop_layers.h"
+#include "include/frame_buffer_pool.h"
+#include <QPainter>
+
+void DesktopLayers::addScreen(const QImage& background, const QRect& area, qreal scale) {
+    screens.append({ area, LayerStack(background, scale, area.topLeft()) });
+}
+
+void DesktopLayers::addAnnotation(LayerStack::LayerId layer, const Annotation& annotation) {
+    for (Screen& screen : screens) {
+        screen.layers.addAnnotation(layer, annotation);
+    }
+}
+
+void DesktopLayers::updateAnnotation(LayerStack::LayerId layer, int index, const Annotation& annotation, bool recordUndo) {
+    for (Screen& screen : screens) {
+        screen.layers.updateAnnotation(layer, index, annotation, recordUndo);
+    }
+}
+
+bool DesktopLayers::undo() {
+    bool undone = false;
+    for (Screen& screen : screens) {
+        undone = screen.layers.undo();
+    }
+    return undone;
+}
+
+void DesktopLayers::removeAnnotation(LayerStack::LayerId layer, int index) {
+    for (Screen& screen : screens) {
+        screen.layers.removeAnnotation(layer, index);
+    }
+}
+
+const QVector<Annotation>& DesktopLayers::annotations(LayerStack::LayerId layer) const {
+    static const QVector<Annotation> none;
+    return screens.isEmpty() ? none : screens.first().layers.annotations(layer);
+}
+
+qreal DesktopLayers::scale(const QRect& area) const {
+    qreal ratio = 0.0;
+    for (const Screen& screen : screens) {
+        if (screen.area.intersects(area)) {
+            ratio = qMax(ratio, screen.layers.scale());
+        }
+    }
+    return ratio > 0 ? ratio : 1.0;
+}
+
+QImage DesktopLayers::render(const QRect& area, LayerStack::LayerId layer) {
+    FrameBufferPool* pool = FrameBufferPool::instance();
+    for (Screen& screen : screens) {
+        if (screen.area.contains(area)) {
+            const QImage& source = screen.layers.flattened(layer);
+            return pool->copy(source, screen.layers.mapToImage(area).intersected(source.rect()));
+        }
+    }
+
+    const qreal ratio = scale(area);
+    QImage image = pool->image((QSizeF(area.size()) * ratio).toSize(), QImage::Format_RGB32);
+    // Screens of different sizes leave areas no screen covers
+    image.fill(Qt::black);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.scale(ratio, ratio);
+    painter.translate(-area.topLeft());
+    for (Screen& screen : screens) {
+        const QRect part = screen.area.intersected(area);
+        if (part.isEmpty()) {
+            continue;
+        }
+        const QImage& source = screen.layers.flattened(layer);
+        painter.drawImage(part, source, screen.layers.mapToImage(part).intersected(source.rect()));
+    }
+    painter.end();
+    return image;
+}
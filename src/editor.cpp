@@ -1,5 +1,32 @@
 #include "include/editor.h"
 #include <QIcon>
+#include <QPainter>
+#include <QPixmap>
+
+namespace {
+    // Tools without a bundled icon get a small painted one
+    QIcon highlightIcon() {
+        QPixmap pixmap(15, 15);
+        pixmap.fill(Qt::transparent);
+        QPainter painter(&pixmap);
+        painter.fillRect(QRect(0, 4, 15, 7), QColor(255, 235, 59));
+        painter.setPen(Qt::black);
+        painter.drawLine(2, 7, 12, 7);
+        return QIcon(pixmap);
+    }
+
+    QIcon redactIcon() {
+        QPixmap pixmap(15, 15);
+        pixmap.fill(Qt::transparent);
+        QPainter painter(&pixmap);
+        for (int y = 0; y < 3; ++y) {
+            for (int x = 0; x < 3; ++x) {
+                painter.fillRect(QRect(x * 5, y * 5, 5, 5), (x + y) % 2 ? Qt::darkGray : Qt::black);
+            }
+        }
+        return QIcon(pixmap);
+    }
+}
 
 Editor::Editor(QWidget* parent)
     : QWidget(parent), layout(new QVBoxLayout(this)), currentTool(None), currentColor(Qt::black) {
@@ -25,11 +52,14 @@ Editor::Editor(QWidget* parent)
     createToolButton("Oval", Ellipse, QIcon(":/resources/icons/ellipse.png"));
     createToolButton("Line", Line, QIcon(":/resources/icons/line.png"));
     createToolButton("Arrow", Arrow, QIcon(":/resources/icons/arrow.png"));
+    createToolButton("Highlight", Highlight, highlightIcon());
+    createToolButton("Redact", Redact, redactIcon());
 
     actionLayout = new QHBoxLayout();
     createActionButton("Save", QIcon(":/resources/icons/save.png"), "saveRequested");
     createActionButton("Copy to clipboard (CTRL + C)", QIcon(":/resources/icons/copy.png"), "copyRequested");
     createActionButton("Upload to ScreenMe", QIcon(":/resources/icons/upload.png"), "publishRequested");
+    createActionButton("Scrolling capture", QIcon(":/resources/icons/scroll.png"), "scrollCaptureRequested");
     createActionButton("Close editor", QIcon(":/resources/icons/close.png"), "closeRequested");
     layout->addLayout(actionLayout);
 }
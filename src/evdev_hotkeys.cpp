@@ -0,0 +1,587 @@
+#include "include/evdev_hotkeys.h"
+
+#if defined(Q_OS_LINUX)
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimer>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+    const char* InputDir = "/dev/input";
+
+    // Modifier keys in Device::pressed bit order, and the modifier each one stands for
+    const int ModifierKeys[] = {
+        KEY_LEFTCTRL, KEY_RIGHTCTRL, KEY_LEFTSHIFT, KEY_RIGHTSHIFT,
+        KEY_LEFTALT, KEY_RIGHTALT, KEY_LEFTMETA, KEY_RIGHTMETA
+    };
+    const int ModifierOf[] = {
+        EvdevHotkeys::Control, EvdevHotkeys::Control, EvdevHotkeys::Shift, EvdevHotkeys::Shift,
+        EvdevHotkeys::Alt, EvdevHotkeys::Alt, EvdevHotkeys::Meta, EvdevHotkeys::Meta
+    };
+
+    // Tags for the epoll entries that are not keyboards
+    char StopTag;
+    char HotplugTag;
+
+    // Qt letters by position in the alphabet, as keys on a US layout
+    const int LetterKeys[] = {
+        KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+        KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+    };
+    const int FunctionKeys[] = {
+        KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12,
+        KEY_F13, KEY_F14, KEY_F15, KEY_F16, KEY_F17, KEY_F18, KEY_F19, KEY_F20, KEY_F21, KEY_F22, KEY_F23, KEY_F24
+    };
+
+    bool testBit(const unsigned char* bits, int bit) {
+        return bits[bit / 8] & (1 << (bit % 8));
+    }
+
+    int modifierSet(quint8 pressed) {
+        int mods = 0;
+        for (int i = 0; i < 8; ++i) {
+            if (pressed & (1 << i)) {
+                mods |= ModifierOf[i];
+            }
+        }
+        return mods;
+    }
+
+    // Mice, power buttons and lid switches report EV_KEY too, a keyboard has letters
+    bool isKeyboard(int fd) {
+        unsigned char keys[KEY_MAX / 8 + 1] = {};
+        if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0) {
+            return false;
+        }
+        return testBit(keys, KEY_A) && testBit(keys, KEY_Z) && testBit(keys, KEY_SPACE);
+    }
+
+    // Self test keyboard, every key of a standard layout
+    int createVirtualKeyboard() {
+        const int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        ioctl(fd, UI_SET_EVBIT, EV_KEY);
+        for (int key = KEY_ESC; key <= KEY_MICMUTE; ++key) {
+            ioctl(fd, UI_SET_KEYBIT, key);
+        }
+        uinput_setup setup = {};
+        setup.id.bustype = BUS_VIRTUAL;
+        strncpy(setup.name, "ScreenMe hotkey self test", UINPUT_MAX_NAME_SIZE - 1);
+        if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Event device of the uinput keyboard once udev lets us read it, empty after `timeoutMs`
+    QString virtualKeyboardNode(int fd, int timeoutMs) {
+        char name[64] = {};
+        if (ioctl(fd, UI_GET_SYSNAME(sizeof(name)), name) < 0) {
+            return QString();
+        }
+        const QStringList nodes = QDir(QString("/sys/devices/virtual/input/%1").arg(name))
+            .entryList({ "event*" }, QDir::Dirs | QDir::NoDotAndDotDot);
+        if (nodes.isEmpty()) {
+            return QString();
+        }
+        const QString path = QString("%1/%2").arg(InputDir, nodes.first());
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < timeoutMs) {
+            const int probe = open(path.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+            if (probe >= 0) {
+                close(probe);
+                return path;
+            }
+            QThread::msleep(20);
+        }
+        return QString();
+    }
+
+    // Appends a key event and the report closing it
+    void appendKey(std::vector<input_event>& events, int code, int value) {
+        input_event event = {};
+        event.type = EV_KEY;
+        event.code = quint16(code);
+        event.value = value;
+        events.push_back(event);
+        event.type = EV_SYN;
+        event.code = SYN_REPORT;
+        event.value = 0;
+        events.push_back(event);
+    }
+
+    void appendTap(std::vector<input_event>& events, int code) {
+        appendKey(events, code, 1);
+        appendKey(events, code, 0);
+    }
+
+    bool writeEvents(int fd, const std::vector<input_event>& events) {
+        const ssize_t size = ssize_t(events.size() * sizeof(input_event));
+        return write(fd, events.data(), size_t(size)) == size;
+    }
+
+    // Runs the event loop until `hits` has `count` entries or `timeoutMs` passed
+    void waitForHits(const QVector<size_t>& hits, int count, int timeoutMs) {
+        QElapsedTimer timer;
+        timer.start();
+        while (hits.size() < count && timer.elapsed() < timeoutMs) {
+            QEventLoop loop;
+            QTimer::singleShot(20, &loop, &QEventLoop::quit);
+            loop.exec();
+        }
+    }
+
+    bool check(bool passed, const char* name) {
+        std::cout << (passed ? "PASS " : "FAIL ") << name << std::endl;
+        return passed;
+    }
+}
+
+EvdevHotkeys::EvdevHotkeys(std::function<void(size_t)> activated)
+    : activated(std::move(activated)), table(new std::atomic<quint32>[(KEY_MAX + 1) * ModifierSets]),
+      epollFd(-1), inotifyFd(-1), stopFd(-1), wakeFd(-1), notifier(nullptr), queueHead(0), queueTail(0) {
+    for (int i = 0; i < (KEY_MAX + 1) * ModifierSets; ++i) {
+        table[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+EvdevHotkeys::~EvdevHotkeys() {
+    if (reader.joinable()) {
+        const quint64 one = 1;
+        if (write(stopFd, &one, sizeof(one)) < 0) {
+            qWarning() << "Failed to stop the evdev hotkey reader";
+        }
+        reader.join();
+    }
+    delete notifier;
+    for (Device* device : devices) {
+        close(device->fd);
+        delete device;
+    }
+    for (int fd : { epollFd, inotifyFd, stopFd, wakeFd }) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool EvdevHotkeys::start() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd < 0 || stopFd < 0 || wakeFd < 0) {
+        qWarning() << "Failed to set up evdev hotkeys:" << strerror(errno);
+        return false;
+    }
+    epoll_event stopEvent = {};
+    stopEvent.events = EPOLLIN;
+    stopEvent.data.ptr = &StopTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &stopEvent);
+
+    // udev creates the node first and grants access after, so permission changes count too
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd >= 0 && inotify_add_watch(inotifyFd, InputDir, IN_CREATE | IN_ATTRIB) >= 0) {
+        epoll_event hotplugEvent = {};
+        hotplugEvent.events = EPOLLIN;
+        hotplugEvent.data.ptr = &HotplugTag;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &hotplugEvent);
+    }
+    else if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+
+    const QStringList names = QDir(InputDir).entryList({ "event*" }, QDir::System);
+    for (const QString& name : names) {
+        openDevice(QString("%1/%2").arg(InputDir, name));
+    }
+    if (devices.isEmpty()) {
+        qWarning() << "No readable keyboard in" << InputDir << "- evdev hotkeys need access to the input group";
+        if (inotifyFd < 0) {
+            return false;
+        }
+    }
+
+    notifier = new QSocketNotifier(wakeFd, QSocketNotifier::Read);
+    QObject::connect(notifier, &QSocketNotifier::activated, [this]() { drain(); });
+    reader = std::thread([this]() { run(); });
+    return true;
+}
+
+int EvdevHotkeys::keyCode(int qtKey) {
+    if (qtKey >= Qt::Key_A && qtKey <= Qt::Key_Z) {
+        return LetterKeys[qtKey - Qt::Key_A];
+    }
+    if (qtKey >= Qt::Key_1 && qtKey <= Qt::Key_9) {
+        return KEY_1 + (qtKey - Qt::Key_1);
+    }
+    if (qtKey >= Qt::Key_F1 && qtKey <= Qt::Key_F24) {
+        return FunctionKeys[qtKey - Qt::Key_F1];
+    }
+    switch (qtKey) {
+    case Qt::Key_0: return KEY_0;
+    case Qt::Key_Print: return KEY_SYSRQ;
+    case Qt::Key_Space: return KEY_SPACE;
+    case Qt::Key_Escape: return KEY_ESC;
+    case Qt::Key_Tab: return KEY_TAB;
+    case Qt::Key_Backspace: return KEY_BACKSPACE;
+    case Qt::Key_Return: return KEY_ENTER;
+    case Qt::Key_Enter: return KEY_KPENTER;
+    case Qt::Key_Insert: return KEY_INSERT;
+    case Qt::Key_Delete: return KEY_DELETE;
+    case Qt::Key_Pause: return KEY_PAUSE;
+    case Qt::Key_ScrollLock: return KEY_SCROLLLOCK;
+    case Qt::Key_Home: return KEY_HOME;
+    case Qt::Key_End: return KEY_END;
+    case Qt::Key_PageUp: return KEY_PAGEUP;
+    case Qt::Key_PageDown: return KEY_PAGEDOWN;
+    case Qt::Key_Left: return KEY_LEFT;
+    case Qt::Key_Right: return KEY_RIGHT;
+    case Qt::Key_Up: return KEY_UP;
+    case Qt::Key_Down: return KEY_DOWN;
+    case Qt::Key_Minus: return KEY_MINUS;
+    case Qt::Key_Equal: return KEY_EQUAL;
+    case Qt::Key_BracketLeft: return KEY_LEFTBRACE;
+    case Qt::Key_BracketRight: return KEY_RIGHTBRACE;
+    case Qt::Key_Semicolon: return KEY_SEMICOLON;
+    case Qt::Key_Apostrophe: return KEY_APOSTROPHE;
+    case Qt::Key_QuoteLeft: return KEY_GRAVE;
+    case Qt::Key_Backslash: return KEY_BACKSLASH;
+    case Qt::Key_Comma: return KEY_COMMA;
+    case Qt::Key_Period: return KEY_DOT;
+    case Qt::Key_Slash: return KEY_SLASH;
+    default: return 0;
+    }
+}
+
+bool EvdevHotkeys::registerHotkey(const UKeySequence& keySeq, size_t id) {
+    const QVector<int> keys = keySeq.GetSimpleKeys();
+    const int code = keys.isEmpty() ? 0 : keyCode(keys[0]);
+    if (code == 0 || id == 0 || id > 0xFFFFFFFFu) {
+        qWarning() << "Hotkey" << id << "has no evdev key";
+        return false;
+    }
+    int mods = 0;
+    for (int modifier : keySeq.GetModifiers()) {
+        mods |= modifier == Qt::Key_Control ? Control
+            : modifier == Qt::Key_Shift ? Shift
+            : modifier == Qt::Key_Alt ? Alt
+            : Meta;
+    }
+
+    const int slot = code * ModifierSets + mods;
+    const quint32 current = table[slot].load(std::memory_order_relaxed);
+    if (current != 0 && current != id) {
+        qWarning() << "Hotkey" << id << "is already taken by hotkey" << current;
+        return false;
+    }
+    unregisterHotkey(id);
+    table[slot].store(quint32(id), std::memory_order_relaxed);
+    slots.insert(id, slot);
+    return true;
+}
+
+void EvdevHotkeys::unregisterHotkey(size_t id) {
+    auto found = slots.find(id);
+    if (found != slots.end()) {
+        table[*found].store(0, std::memory_order_relaxed);
+        slots.erase(found);
+    }
+}
+
+void EvdevHotkeys::run() {
+    epoll_event events[16];
+    for (;;) {
+        const int count = epoll_wait(epollFd, events, 16, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qWarning() << "Evdev hotkey reader stopped:" << strerror(errno);
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.ptr == &StopTag) {
+                return;
+            }
+            if (events[i].data.ptr == &HotplugTag) {
+                readHotplug();
+            }
+            else {
+                readDevice(static_cast<Device*>(events[i].data.ptr));
+            }
+        }
+    }
+}
+
+void EvdevHotkeys::openDevice(const QString& path) {
+    if (devices.contains(path)) {
+        return;
+    }
+    const int fd = open(path.toLocal8Bit().constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (!isKeyboard(fd)) {
+        close(fd);
+        return;
+    }
+    Device* device = new Device();
+    device->fd = fd;
+    device->path = path;
+    // A modifier held while the device was opened still counts
+    syncModifiers(device);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = device;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        close(fd);
+        delete device;
+        return;
+    }
+    devices.insert(path, device);
+}
+
+void EvdevHotkeys::closeDevice(Device* device) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, device->fd, nullptr);
+    close(device->fd);
+    devices.remove(device->path);
+    delete device;
+}
+
+void EvdevHotkeys::readDevice(Device* device) {
+    input_event events[64];
+    for (;;) {
+        const ssize_t bytes = read(device->fd, events, sizeof(events));
+        if (bytes < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                // Unplugged
+                closeDevice(device);
+            }
+            return;
+        }
+        if (bytes == 0) {
+            return;
+        }
+        const int count = int(bytes / sizeof(input_event));
+        for (int i = 0; i < count; ++i) {
+            const input_event& event = events[i];
+            if (event.type == EV_SYN) {
+                if (event.code == SYN_DROPPED) {
+                    device->dropped = true;
+                }
+                else if (event.code == SYN_REPORT && device->dropped) {
+                    device->dropped = false;
+                    syncModifiers(device);
+                }
+            }
+            else if (event.type == EV_KEY && !device->dropped) {
+                handleKey(device, event.code, event.value);
+            }
+        }
+    }
+}
+
+void EvdevHotkeys::readHotplug() {
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        const ssize_t bytes = read(inotifyFd, buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            return;
+        }
+        for (ssize_t offset = 0; offset < bytes;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += ssize_t(sizeof(inotify_event) + event->len);
+            const QString name = event->len > 0 ? QString::fromLocal8Bit(event->name) : QString();
+            if (name.startsWith("event")) {
+                openDevice(QString("%1/%2").arg(InputDir, name));
+            }
+        }
+    }
+}
+
+void EvdevHotkeys::syncModifiers(Device* device) {
+    unsigned char keys[KEY_MAX / 8 + 1] = {};
+    device->pressed = 0;
+    if (ioctl(device->fd, EVIOCGKEY(sizeof(keys)), keys) < 0) {
+        return;
+    }
+    for (int i = 0; i < 8; ++i) {
+        if (testBit(keys, ModifierKeys[i])) {
+            device->pressed |= quint8(1 << i);
+        }
+    }
+}
+
+void EvdevHotkeys::handleKey(Device* device, int code, int value) {
+    if (code > KEY_MAX) {
+        return;
+    }
+    for (int i = 0; i < 8; ++i) {
+        if (code == ModifierKeys[i]) {
+            if (value == 0) {
+                device->pressed &= quint8(~(1 << i));
+            }
+            else {
+                device->pressed |= quint8(1 << i);
+            }
+            return;
+        }
+    }
+    // Presses only, not auto-repeat or release
+    if (value != 1) {
+        return;
+    }
+    const quint32 id = table[code * ModifierSets + modifierSet(device->pressed)].load(std::memory_order_relaxed);
+    if (id != 0) {
+        post(id);
+    }
+}
+
+void EvdevHotkeys::post(quint32 id) {
+    const quint32 head = queueHead.load(std::memory_order_relaxed);
+    if (head - queueTail.load(std::memory_order_acquire) >= quint32(QueueSize)) {
+        // The GUI thread is stuck, a hotkey press more or less makes no difference
+        return;
+    }
+    queue[head % QueueSize] = id;
+    queueHead.store(head + 1, std::memory_order_release);
+    const quint64 one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        qWarning() << "Failed to wake the GUI thread for a hotkey";
+    }
+}
+
+void EvdevHotkeys::drain() {
+    quint64 count = 0;
+    if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        return;
+    }
+    quint32 tail = queueTail.load(std::memory_order_relaxed);
+    const quint32 head = queueHead.load(std::memory_order_acquire);
+    while (tail != head) {
+        const quint32 id = queue[tail % QueueSize];
+        queueTail.store(++tail, std::memory_order_release);
+        // Unregistered after the press was queued
+        if (slots.contains(id)) {
+            activated(id);
+        }
+    }
+}
+
+int EvdevHotkeys::selfTest() {
+    int keyboard = -1;
+    const UKeySequence ctrlShiftA("Ctrl+Shift+A");
+    const UKeySequence print("Print");
+    const UKeySequence ctrlPrint("Ctrl+Print");
+    bool passed = true;
+
+    {
+        QVector<size_t> hits;
+        EvdevHotkeys hotkeys([&hits](size_t id) { hits.push_back(id); });
+        if (!hotkeys.start()) {
+            std::cerr << "Failed to start the evdev backend" << std::endl;
+            return 2;
+        }
+        hotkeys.registerHotkey(ctrlShiftA, 1);
+        hotkeys.registerHotkey(print, 2);
+        hotkeys.registerHotkey(ctrlPrint, 3);
+        // Created after the start, so it has to come in through the hotplug watch
+        keyboard = createVirtualKeyboard();
+        if (keyboard < 0) {
+            std::cerr << "Failed to create a uinput keyboard: " << strerror(errno) << std::endl;
+            return 2;
+        }
+
+        std::vector<input_event> events;
+        appendKey(events, KEY_LEFTCTRL, 1);
+        appendKey(events, KEY_RIGHTSHIFT, 1);
+        appendTap(events, KEY_A);
+        appendKey(events, KEY_RIGHTSHIFT, 0);
+        appendKey(events, KEY_LEFTCTRL, 0);
+        // Until udev lets the reader open the keyboard
+        for (int attempt = 0; attempt < 50 && hits.isEmpty(); ++attempt) {
+            writeEvents(keyboard, events);
+            waitForHits(hits, 1, 100);
+        }
+        passed &= check(!hits.isEmpty() && hits.count(1) == hits.size(), "activation through a hotplugged keyboard");
+
+        // A without modifiers is not a hotkey, both Ctrl keys count as Ctrl and the
+        // modifier is only gone once both are up
+        hits.clear();
+        events.clear();
+        appendTap(events, KEY_A);
+        appendTap(events, KEY_SYSRQ);
+        appendKey(events, KEY_LEFTCTRL, 1);
+        appendKey(events, KEY_RIGHTCTRL, 1);
+        appendKey(events, KEY_LEFTCTRL, 0);
+        appendTap(events, KEY_SYSRQ);
+        appendKey(events, KEY_RIGHTCTRL, 0);
+        appendTap(events, KEY_SYSRQ);
+        writeEvents(keyboard, events);
+        waitForHits(hits, 3, 2000);
+        // Anything that should not have fired
+        waitForHits(hits, 4, 200);
+        passed &= check(hits == QVector<size_t>({ 2, 3, 2 }), "modifier tracking");
+    }
+
+    {
+        // Driven by hand without the reader thread, so nothing drains the device while
+        // the flood below overflows its kernel buffer
+        QVector<size_t> hits;
+        EvdevHotkeys hotkeys([&hits](size_t id) { hits.push_back(id); });
+        hotkeys.epollFd = epoll_create1(EPOLL_CLOEXEC);
+        hotkeys.wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        hotkeys.registerHotkey(print, 2);
+        hotkeys.registerHotkey(ctrlPrint, 3);
+        const QString node = virtualKeyboardNode(keyboard, 2000);
+        if (!node.isEmpty()) {
+            hotkeys.openDevice(node);
+        }
+        Device* device = hotkeys.devices.value(node);
+        if (!device) {
+            close(keyboard);
+            std::cerr << "Failed to open the uinput keyboard's event device" << std::endl;
+            return 2;
+        }
+
+        // The Ctrl press and release are lost in the overflow, only the resync knows
+        for (int held : { 1, 0 }) {
+            std::vector<input_event> events;
+            appendKey(events, KEY_LEFTCTRL, held);
+            for (int i = 0; i < 1000; ++i) {
+                appendTap(events, KEY_B);
+            }
+            appendTap(events, KEY_SYSRQ);
+            writeEvents(keyboard, events);
+            hotkeys.readDevice(device);
+            hotkeys.drain();
+        }
+        passed &= check(hits == QVector<size_t>({ 3, 2 }), "modifier resync after SYN_DROPPED");
+    }
+
+    ioctl(keyboard, UI_DEV_DESTROY);
+    close(keyboard);
+    return passed ? 0 : 1;
+}
+#endif
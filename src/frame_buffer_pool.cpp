@@ -0,0 +1,229 @@
+#include "include/frame_buffer_pool.h"
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#ifdef Q_OS_WIN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Below this a frame is cheap enough for the heap
+    const size_t MinPooledBytes = 256 * 1024;
+    const qint64 DefaultCacheLimitMb = 256;
+
+    size_t systemPageSize() {
+#ifdef Q_OS_WIN
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return size_t(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    // Huge page size the process may allocate with, 0 when it may not
+    size_t enableHugePages() {
+#ifdef Q_OS_WIN
+        // Large pages need SeLockMemoryPrivilege, which only an administrator can grant
+        HANDLE token = nullptr;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return 0;
+        }
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool granted = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+            && AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+            && GetLastError() == ERROR_SUCCESS;
+        CloseHandle(token);
+        return granted ? GetLargePageMinimum() : 0;
+#elif defined(MADV_HUGEPAGE)
+        // Transparent huge pages, granted per mapping by the kernel when it can
+        return 2 * 1024 * 1024;
+#else
+        return 0;
+#endif
+    }
+}
+
+FrameBufferPool::FrameBufferPool()
+    : cacheLimit(DefaultCacheLimitMb * 1024 * 1024), wantHugePages(false), hugePageSize(0), hugePagesTried(false) {
+}
+
+FrameBufferPool* FrameBufferPool::instance() {
+    static FrameBufferPool* pool = new FrameBufferPool();
+    return pool;
+}
+
+void FrameBufferPool::applyConfig(const QJsonObject& config) {
+    const qint64 limit = qMax(0, config["frame_pool_limit_mb"].toInt(int(DefaultCacheLimitMb))) * qint64(1024 * 1024);
+    const bool hugePages = config["frame_pool_huge_pages"].toBool(false);
+    bool overLimit = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cacheLimit = limit;
+        if (hugePages && !hugePagesTried) {
+            hugePagesTried = true;
+            hugePageSize = enableHugePages();
+            if (hugePageSize == 0) {
+                qWarning() << "Huge pages are not available, frame buffers use normal pages";
+            }
+        }
+        wantHugePages = hugePages;
+        counters.hugePages = wantHugePages && hugePageSize > 0;
+        overLimit = counters.bytesCached > cacheLimit;
+    }
+    if (overLimit) {
+        trim(limit);
+    }
+}
+
+size_t FrameBufferPool::classSize(size_t bytes, size_t pageSize) {
+    // Quarter steps between powers of two waste at most a fifth of a buffer
+    size_t power = 1;
+    while (power * 2 < bytes) {
+        power *= 2;
+    }
+    const size_t step = qMax(power / 4, pageSize);
+    return (bytes + step - 1) / step * step;
+}
+
+FrameBufferPool::Buffer FrameBufferPool::allocate(size_t bytes) {
+    Buffer buffer;
+    buffer.size = bytes;
+    buffer.hugePages = counters.hugePages;
+#ifdef Q_OS_WIN
+    if (buffer.hugePages) {
+        buffer.data = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    }
+    if (!buffer.data) {
+        buffer.data = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+#else
+    void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED) {
+        buffer.data = data;
+#ifdef MADV_HUGEPAGE
+        if (buffer.hugePages) {
+            madvise(data, bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+#endif
+    return buffer;
+}
+
+void FrameBufferPool::unmap(const Buffer& buffer) {
+#ifdef Q_OS_WIN
+    VirtualFree(buffer.data, 0, MEM_RELEASE);
+#else
+    munmap(buffer.data, buffer.size);
+#endif
+}
+
+QImage FrameBufferPool::image(const QSize& size, QImage::Format format) {
+    const int depth = QImage::toPixelFormat(format).bitsPerPixel();
+    const qsizetype bytesPerLine = (qsizetype(size.width()) * depth + 31) / 32 * 4;
+    const size_t bytes = size_t(bytesPerLine) * qMax(0, size.height());
+    if (size.isEmpty() || depth < 8 || bytes < MinPooledBytes) {
+        return QImage(size, format);
+    }
+
+    Buffer buffer;
+    size_t sizeClass = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sizeClass = classSize(bytes, counters.hugePages ? hugePageSize : systemPageSize());
+        ++counters.requests;
+        auto found = cached.find(sizeClass);
+        if (found != cached.end() && !found->isEmpty()) {
+            buffer = found->takeLast();
+            counters.bytesCached -= qint64(buffer.size);
+            ++counters.hits;
+        }
+        counters.bytesInUse += qint64(sizeClass);
+        counters.peakBytesInUse = qMax(counters.peakBytesInUse, counters.bytesInUse);
+        if (!buffer.data) {
+            buffer = allocate(sizeClass);
+        }
+        if (!buffer.data) {
+            counters.bytesInUse -= qint64(sizeClass);
+        }
+    }
+    if (!buffer.data) {
+        return QImage(size, format);
+    }
+    return QImage(static_cast<uchar*>(buffer.data), size.width(), size.height(), bytesPerLine, format,
+        &FrameBufferPool::release, new Buffer(buffer));
+}
+
+QImage FrameBufferPool::copy(const QImage& source, const QRect& area) {
+    if (!source.rect().contains(area) || area.isEmpty() || source.depth() < 8) {
+        return source.copy(area);
+    }
+    QImage target = image(area.size(), source.format());
+    const size_t rowBytes = size_t(area.width()) * source.depth() / 8;
+    const size_t offset = size_t(area.x()) * source.depth() / 8;
+    for (int y = 0; y < area.height(); ++y) {
+        std::memcpy(target.scanLine(y), source.constScanLine(area.y() + y) + offset, rowBytes);
+    }
+    target.setDevicePixelRatio(source.devicePixelRatio());
+    target.setDotsPerMeterX(source.dotsPerMeterX());
+    target.setDotsPerMeterY(source.dotsPerMeterY());
+    target.setColorSpace(source.colorSpace());
+    return target;
+}
+
+void FrameBufferPool::release(void* info) {
+    Buffer* buffer = static_cast<Buffer*>(info);
+    instance()->recycle(buffer);
+    delete buffer;
+}
+
+void FrameBufferPool::recycle(Buffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.bytesInUse -= qint64(buffer->size);
+        // Buffers sized for the other page kind are dropped once huge pages are switched
+        if (buffer->hugePages == counters.hugePages && counters.bytesCached + qint64(buffer->size) <= cacheLimit) {
+            cached[buffer->size].append(*buffer);
+            counters.bytesCached += qint64(buffer->size);
+            return;
+        }
+    }
+    unmap(*buffer);
+}
+
+void FrameBufferPool::trim(qint64 keepBytes) {
+    QVector<Buffer> released;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Full-screen frames are the largest classes and the ones the next capture needs
+        QList<size_t> classes = cached.keys();
+        std::sort(classes.begin(), classes.end(), std::greater<size_t>());
+        qint64 kept = 0;
+        for (size_t sizeClass : classes) {
+            QVector<Buffer>& buffers = cached[sizeClass];
+            while (!buffers.isEmpty() && kept + qint64(sizeClass) * buffers.size() > keepBytes) {
+                released.append(buffers.takeLast());
+            }
+            kept += qint64(sizeClass) * buffers.size();
+            if (buffers.isEmpty()) {
+                cached.remove(sizeClass);
+            }
+        }
+        counters.bytesCached = kept;
+    }
+    for (const Buffer& buffer : released) {
+        unmap(buffer);
+    }
+}
+
+FrameBufferPool::Stats FrameBufferPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
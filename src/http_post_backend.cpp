@@ -0,0 +1,72 @@
+#include "include/http_post_backend.h"
+#include "include/multipart_body.h"
+#include <QFile>
+#include <QJsonDocument>
+
+HttpPostBackend::HttpPostBackend(const QJsonObject& config, QObject* parent)
+    : UploadBackend(parent) {
+    url = QUrl(config["http_upload_url"].toString());
+    fieldName = config["http_upload_field"].toString("file").toUtf8();
+    linkField = config["http_upload_link_field"].toString("url");
+    // Sent verbatim, e.g. "Bearer ..." or "Basic ..."
+    authorization = config["http_upload_authorization"].toString().toUtf8();
+}
+
+UploadTask* HttpPostBackend::upload(const UploadSource& source, UploadPriority priority) {
+    UploadTask* task = new UploadTask(this);
+    if (!url.isValid() || url.isRelative()) {
+        task->fail("No upload URL configured (http_upload_url).");
+        return task;
+    }
+
+    QFile* file = new QFile(source.filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        task->fail("Failed to open the image file for upload.");
+        return task;
+    }
+    MultipartBody* body = new MultipartBody(fieldName, source.fileName, source.mimeType, file);
+
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, body->contentType());
+    if (!authorization.isEmpty()) {
+        request.setRawHeader("Authorization", authorization);
+    }
+
+    ScheduledUpload* step = UploadScheduler::instance()->enqueue(request, body, priority);
+    task->track(step);
+    connect(step, &ScheduledUpload::uploadProgress, task, &UploadTask::progress);
+    connect(step, &ScheduledUpload::finished, task, [this, task](QNetworkReply* reply) {
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            task->finish(failure(reply));
+            return;
+        }
+        const QByteArray response = reply->readAll();
+        UploadResult result;
+        result.httpStatus = httpStatus(reply);
+
+        QJsonDocument json = QJsonDocument::fromJson(response);
+        if (json.isObject()) {
+            result.link = json.object()[linkField].toString();
+            QJsonValue id = json.object()["id"];
+            result.id = id.isDouble() ? QString::number(id.toInteger()) : id.toString();
+        }
+        if (result.link.isEmpty()) {
+            result.link = reply->header(QNetworkRequest::LocationHeader).toUrl().toString();
+        }
+        if (result.link.isEmpty() && response.trimmed().startsWith("http")) {
+            result.link = QString::fromUtf8(response.trimmed());
+        }
+        // Relative links are resolved against the endpoint
+        if (!result.link.isEmpty()) {
+            result.link = url.resolved(QUrl(result.link)).toString();
+        }
+
+        result.success = !result.link.isEmpty();
+        if (!result.success) {
+            result.error = "The server accepted the upload but returned no link.";
+        }
+        task->finish(result);
+    });
+    return task;
+}
@@ -0,0 +1,257 @@
+#include "include/image_diff.h"
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCREENME_DIFF_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const int CellSize = 16;
+
+    // Writes one byte per pixel into `mask` (1 = changed) and returns the number of changed pixels
+    int diffRow(const quint32* before, const quint32* after, int width, uchar tolerance, uchar* mask) {
+        int changed = 0;
+        int x = 0;
+#ifdef SCREENME_DIFF_SSE2
+        // Expands a 4-bit movemask into four 0/1 mask bytes
+        static const quint32 expand[16] = {
+            0x00000000, 0x00000001, 0x00000100, 0x00000101,
+            0x00010000, 0x00010001, 0x00010100, 0x00010101,
+            0x01000000, 0x01000001, 0x01000100, 0x01000101,
+            0x01010000, 0x01010001, 0x01010100, 0x01010101,
+        };
+        static const int bitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+        const __m128i limit = _mm_set1_epi8(char(tolerance));
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 4 <= width; x += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(before + x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(after + x));
+            __m128i absDiff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+            // Non-zero only in the channels that differ by more than the tolerance
+            __m128i overLimit = _mm_subs_epu8(absDiff, limit);
+            __m128i unchanged = _mm_cmpeq_epi32(overLimit, zero);
+            int bits = ~_mm_movemask_ps(_mm_castsi128_ps(unchanged)) & 0xF;
+            std::memcpy(mask + x, &expand[bits], sizeof(quint32));
+            changed += bitCount[bits];
+        }
+#endif
+        for (; x < width; ++x) {
+            quint32 a = before[x];
+            quint32 b = after[x];
+            bool differs = false;
+            for (int shift = 0; shift < 32; shift += 8) {
+                int delta = int((a >> shift) & 0xFF) - int((b >> shift) & 0xFF);
+                if (delta > tolerance || -delta > tolerance) {
+                    differs = true;
+                    break;
+                }
+            }
+            mask[x] = differs ? 1 : 0;
+            changed += differs ? 1 : 0;
+        }
+        return changed;
+    }
+
+    bool anyChanged(const uchar* mask, int count) {
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+            quint64 word;
+            std::memcpy(&word, mask + i, sizeof(word));
+            if (word) {
+                return true;
+            }
+        }
+        for (; i < count; ++i) {
+            if (mask[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Groups 8-connected changed cells and returns their pixel-accurate bounding boxes
+    QVector<QRect> clusterCells(const QVector<uchar>& cells, int cellsWide, int cellsHigh,
+        const QVector<uchar>& mask, int width, int height) {
+        QVector<QRect> regions;
+        QVector<uchar> visited(cells.size(), 0);
+        QVector<int> pending;
+
+        for (int start = 0; start < cells.size(); ++start) {
+            if (!cells[start] || visited[start]) {
+                continue;
+            }
+            int left = cellsWide, top = cellsHigh, right = -1, bottom = -1;
+            pending.clear();
+            pending.append(start);
+            visited[start] = 1;
+
+            while (!pending.isEmpty()) {
+                int cell = pending.takeLast();
+                int cx = cell % cellsWide;
+                int cy = cell / cellsWide;
+                left = qMin(left, cx);
+                right = qMax(right, cx);
+                top = qMin(top, cy);
+                bottom = qMax(bottom, cy);
+
+                for (int ny = qMax(0, cy - 1); ny <= qMin(cellsHigh - 1, cy + 1); ++ny) {
+                    for (int nx = qMax(0, cx - 1); nx <= qMin(cellsWide - 1, cx + 1); ++nx) {
+                        int neighbour = ny * cellsWide + nx;
+                        if (cells[neighbour] && !visited[neighbour]) {
+                            visited[neighbour] = 1;
+                            pending.append(neighbour);
+                        }
+                    }
+                }
+            }
+
+            QRect box = QRect(QPoint(left * CellSize, top * CellSize),
+                QPoint((right + 1) * CellSize - 1, (bottom + 1) * CellSize - 1)).intersected(QRect(0, 0, width, height));
+
+            // Shrink the cell-aligned box down to the changed pixels it contains
+            auto rowHasChange = [&](int y) { return anyChanged(mask.constData() + qsizetype(y) * width + box.left(), box.width()); };
+            auto columnHasChange = [&](int x) {
+                for (int y = box.top(); y <= box.bottom(); ++y) {
+                    if (mask[qsizetype(y) * width + x]) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+            while (box.height() > 1 && !rowHasChange(box.top())) box.setTop(box.top() + 1);
+            while (box.height() > 1 && !rowHasChange(box.bottom())) box.setBottom(box.bottom() - 1);
+            while (box.width() > 1 && !columnHasChange(box.left())) box.setLeft(box.left() + 1);
+            while (box.width() > 1 && !columnHasChange(box.right())) box.setRight(box.right() - 1);
+
+            regions.append(box);
+        }
+        return regions;
+    }
+}
+
+QJsonObject ImageDiffResult::toJson() const {
+    QJsonArray regionArray;
+    for (const QRect& region : regions) {
+        QJsonObject entry;
+        entry["x"] = region.x();
+        entry["y"] = region.y();
+        entry["width"] = region.width();
+        entry["height"] = region.height();
+        regionArray.append(entry);
+    }
+
+    const qint64 totalPixels = qint64(size.width()) * size.height();
+    QJsonObject json;
+    json["width"] = size.width();
+    json["height"] = size.height();
+    json["tolerance"] = tolerance;
+    json["changed_pixels"] = changedPixels;
+    json["changed_ratio"] = totalPixels > 0 ? double(changedPixels) / totalPixels : 0.0;
+    json["elapsed_ms"] = elapsedMs;
+    json["regions"] = regionArray;
+    return json;
+}
+
+ImageDiffResult ImageDiff::compare(const QImage& before, const QImage& after, int tolerance) {
+    QElapsedTimer timer;
+    timer.start();
+
+    ImageDiffResult result;
+    result.tolerance = qBound(0, tolerance, 255);
+
+    QImage a = before.convertToFormat(QImage::Format_RGB32);
+    QImage b = after.convertToFormat(QImage::Format_RGB32);
+    const int width = qMin(a.width(), b.width());
+    const int height = qMin(a.height(), b.height());
+
+    const int cellsWide = (width + CellSize - 1) / CellSize;
+    const int cellsHigh = (height + CellSize - 1) / CellSize;
+    QVector<uchar> cells(cellsWide * cellsHigh, 0);
+    QVector<uchar> mask(qsizetype(width) * height, 0);
+
+    for (int y = 0; y < height; ++y) {
+        uchar* maskRow = mask.data() + qsizetype(y) * width;
+        int changed = diffRow(reinterpret_cast<const quint32*>(a.constScanLine(y)),
+            reinterpret_cast<const quint32*>(b.constScanLine(y)), width, uchar(result.tolerance), maskRow);
+        if (!changed) {
+            continue;
+        }
+        result.changedPixels += changed;
+        uchar* cellRow = cells.data() + (y / CellSize) * cellsWide;
+        for (int cx = 0; cx < cellsWide; ++cx) {
+            if (!cellRow[cx]) {
+                int x = cx * CellSize;
+                cellRow[cx] = anyChanged(maskRow + x, qMin(CellSize, width - x)) ? 1 : 0;
+            }
+        }
+    }
+
+    result.regions = clusterCells(cells, cellsWide, cellsHigh, mask, width, height);
+
+    // Whatever only exists in one of the captures is reported as changed as well, over the
+    // area both of them cover together: content that was added or cut away
+    result.size = a.size().expandedTo(b.size());
+    if (result.size.width() > width) {
+        result.regions.append(QRect(width, 0, result.size.width() - width, result.size.height()));
+        result.changedPixels += qint64(result.size.width() - width) * result.size.height();
+    }
+    if (result.size.height() > height) {
+        result.regions.append(QRect(0, height, width, result.size.height() - height));
+        result.changedPixels += qint64(width) * (result.size.height() - height);
+    }
+
+    if (result.size == b.size()) {
+        result.highlighted = b.convertToFormat(QImage::Format_ARGB32);
+    }
+    else {
+        // What the after capture no longer covers stays transparent
+        result.highlighted = QImage(result.size, QImage::Format_ARGB32);
+        result.highlighted.fill(Qt::transparent);
+        QPainter(&result.highlighted).drawImage(0, 0, b);
+    }
+    for (const QRect& region : result.regions) {
+        for (int y = region.top(); y <= region.bottom() && y < height; ++y) {
+            quint32* line = reinterpret_cast<quint32*>(result.highlighted.scanLine(y));
+            const uchar* maskRow = mask.constData() + qsizetype(y) * width;
+            for (int x = region.left(); x <= region.right() && x < width; ++x) {
+                if (maskRow[x]) {
+                    // Half-way blend towards red
+                    line[x] = 0xFF000000 | (((line[x] & 0xFEFEFE) >> 1) + 0x7F0000);
+                }
+            }
+        }
+    }
+    QPainter painter(&result.highlighted);
+    painter.setPen(QPen(Qt::red, 2));
+    painter.setBrush(Qt::NoBrush);
+    for (const QRect& region : result.regions) {
+        painter.drawRect(region.adjusted(-1, -1, 1, 1));
+    }
+    painter.end();
+
+    result.elapsedMs = timer.nsecsElapsed() / 1e6;
+    return result;
+}
+
+bool ImageDiff::exportResult(const ImageDiffResult& result, const QString& imagePath, int quality) {
+    if (!result.highlighted.save(imagePath, nullptr, quality)) {
+        return false;
+    }
+
+    QFileInfo info(imagePath);
+    QFile summary(info.dir().filePath(info.completeBaseName() + ".json"));
+    if (!summary.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+    summary.write(QJsonDocument(result.toJson()).toJson());
+    return true;
+}
@@ -0,0 +1,240 @@
+#include "include/image_resampler.h"
+#include <QVector>
+#include <QtMath>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCREENME_RESAMPLE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const int WeightBits = 14;
+    const double LanczosSupport = 3.0;
+
+    // Fixed-point filter taps for every output position along one axis
+    struct Contributions {
+        int taps = 0;
+        QVector<int> first;
+        QVector<qint16> weights;
+    };
+
+    double lanczos(double x) {
+        if (x == 0.0) {
+            return 1.0;
+        }
+        if (x <= -LanczosSupport || x >= LanczosSupport) {
+            return 0.0;
+        }
+        const double px = M_PI * x;
+        return LanczosSupport * std::sin(px) * std::sin(px / LanczosSupport) / (px * px);
+    }
+
+    Contributions contributions(int sourceSize, int targetSize) {
+        const double scale = double(sourceSize) / targetSize;
+        // Stretching the kernel by the scale factor is what makes it low-pass when shrinking
+        const double filterScale = qMax(scale, 1.0);
+        const double support = LanczosSupport * filterScale;
+
+        Contributions result;
+        result.taps = qMin(sourceSize, int(std::ceil(support)) * 2 + 1);
+        result.first.resize(targetSize);
+        result.weights.fill(0, targetSize * result.taps);
+
+        QVector<double> weights(result.taps);
+        for (int i = 0; i < targetSize; ++i) {
+            const double center = (i + 0.5) * scale;
+            const int from = qMax(0, int(std::floor(center - support)));
+            const int to = qMin(sourceSize, int(std::ceil(center + support)));
+            // Keep the whole tap window inside the source so the kernels never need bounds checks
+            const int first = qMax(0, qMin(from, sourceSize - result.taps));
+
+            double total = 0.0;
+            weights.fill(0.0);
+            for (int j = from; j < to && j - first < result.taps; ++j) {
+                weights[j - first] = lanczos((j + 0.5 - center) / filterScale);
+                total += weights[j - first];
+            }
+
+            // Rounded weights have to sum to exactly one, the remainder goes to the largest tap
+            qint16* fixed = result.weights.data() + i * result.taps;
+            int sum = 0;
+            int largest = 0;
+            for (int k = 0; k < result.taps; ++k) {
+                fixed[k] = qint16(qRound(weights[k] / total * (1 << WeightBits)));
+                sum += fixed[k];
+                if (fixed[k] > fixed[largest]) {
+                    largest = k;
+                }
+            }
+            fixed[largest] += qint16((1 << WeightBits) - sum);
+            result.first[i] = first;
+        }
+        return result;
+    }
+
+    inline quint32 clampPixel(const int* channels) {
+        quint32 pixel = 0;
+        for (int c = 0; c < 4; ++c) {
+            pixel |= quint32(qBound(0, channels[c] >> WeightBits, 255)) << (c * 8);
+        }
+        return pixel;
+    }
+
+    void resampleRow(const quint32* src, quint32* dst, int width, const Contributions& filter) {
+        const int taps = filter.taps;
+        for (int x = 0; x < width; ++x) {
+            const quint32* pixels = src + filter.first[x];
+            const qint16* weights = filter.weights.constData() + x * taps;
+#ifdef SCREENME_RESAMPLE_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            __m128i sum = _mm_set1_epi32(1 << (WeightBits - 1));
+            int k = 0;
+            for (; k + 1 < taps; k += 2) {
+                // [c0 c1 c2 c3 of pixel k, then of pixel k+1] regrouped as channel pairs for madd
+                __m128i wide = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + k)), zero);
+                __m128i pairs = _mm_unpacklo_epi16(wide, _mm_srli_si128(wide, 8));
+                __m128i weight = _mm_set1_epi32(int((quint32(quint16(weights[k + 1])) << 16) | quint16(weights[k])));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, weight));
+            }
+            if (k < taps) {
+                __m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(pixels[k])), zero), zero);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(wide, _mm_set1_epi32(quint16(weights[k]))));
+            }
+            sum = _mm_srai_epi32(sum, WeightBits);
+            sum = _mm_packs_epi32(sum, sum);
+            dst[x] = quint32(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+#else
+            int channels[4] = { 1 << (WeightBits - 1), 1 << (WeightBits - 1), 1 << (WeightBits - 1), 1 << (WeightBits - 1) };
+            for (int k = 0; k < taps; ++k) {
+                for (int c = 0; c < 4; ++c) {
+                    channels[c] += int((pixels[k] >> (c * 8)) & 0xff) * weights[k];
+                }
+            }
+            dst[x] = clampPixel(channels);
+#endif
+        }
+    }
+
+    void resampleColumns(const QImage& src, int firstRow, const qint16* weights, int taps, quint32* dst, int width) {
+        int x = 0;
+#ifdef SCREENME_RESAMPLE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi32(1 << (WeightBits - 1));
+        for (; x + 4 <= width; x += 4) {
+            __m128i sum0 = rounding, sum1 = rounding, sum2 = rounding, sum3 = rounding;
+            for (int k = 0; k < taps; k += 2) {
+                const bool pair = k + 1 < taps;
+                const quint32* rowA = reinterpret_cast<const quint32*>(src.constScanLine(firstRow + k)) + x;
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowA));
+                __m128i b = zero;
+                if (pair) {
+                    const quint32* rowB = reinterpret_cast<const quint32*>(src.constScanLine(firstRow + k + 1)) + x;
+                    b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowB));
+                }
+                __m128i weight = _mm_set1_epi32(int((quint32(pair ? quint16(weights[k + 1]) : 0) << 16) | quint16(weights[k])));
+
+                // Interleaving the two rows puts each channel next to its partner tap
+                __m128i aLow = _mm_unpacklo_epi8(a, zero), bLow = _mm_unpacklo_epi8(b, zero);
+                __m128i aHigh = _mm_unpackhi_epi8(a, zero), bHigh = _mm_unpackhi_epi8(b, zero);
+                sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(aLow, bLow), weight));
+                sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(aLow, bLow), weight));
+                sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi16(aHigh, bHigh), weight));
+                sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi16(aHigh, bHigh), weight));
+            }
+            __m128i low = _mm_packs_epi32(_mm_srai_epi32(sum0, WeightBits), _mm_srai_epi32(sum1, WeightBits));
+            __m128i high = _mm_packs_epi32(_mm_srai_epi32(sum2, WeightBits), _mm_srai_epi32(sum3, WeightBits));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(low, high));
+        }
+#endif
+        for (; x < width; ++x) {
+            int channels[4] = { 1 << (WeightBits - 1), 1 << (WeightBits - 1), 1 << (WeightBits - 1), 1 << (WeightBits - 1) };
+            for (int k = 0; k < taps; ++k) {
+                const quint32 pixel = reinterpret_cast<const quint32*>(src.constScanLine(firstRow + k))[x];
+                for (int c = 0; c < 4; ++c) {
+                    channels[c] += int((pixel >> (c * 8)) & 0xff) * weights[k];
+                }
+            }
+            dst[x] = clampPixel(channels);
+        }
+    }
+}
+
+QImage ImageResampler::downscale(const QImage& source, const QSize& size) {
+    if (source.isNull() || size.isEmpty()) {
+        return QImage();
+    }
+    if (size.width() >= source.width() && size.height() >= source.height()) {
+        return source;
+    }
+
+    const QImage::Format format = source.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    const QImage input = source.convertToFormat(format);
+    const QSize target = size.boundedTo(input.size());
+
+    const Contributions horizontal = contributions(input.width(), target.width());
+    const Contributions vertical = contributions(input.height(), target.height());
+
+    QImage rows(target.width(), input.height(), format);
+    for (int y = 0; y < input.height(); ++y) {
+        resampleRow(reinterpret_cast<const quint32*>(input.constScanLine(y)),
+            reinterpret_cast<quint32*>(rows.scanLine(y)), target.width(), horizontal);
+    }
+
+    QImage result(target, format);
+    for (int y = 0; y < target.height(); ++y) {
+        resampleColumns(rows, vertical.first[y], vertical.weights.constData() + y * vertical.taps, vertical.taps,
+            reinterpret_cast<quint32*>(result.scanLine(y)), target.width());
+    }
+
+    if (format == QImage::Format_ARGB32_Premultiplied) {
+        // Ringing can push a premultiplied channel above its alpha
+        for (int y = 0; y < result.height(); ++y) {
+            QRgb* line = reinterpret_cast<QRgb*>(result.scanLine(y));
+            for (int x = 0; x < result.width(); ++x) {
+                const int alpha = qAlpha(line[x]);
+                line[x] = qRgba(qMin(qRed(line[x]), alpha), qMin(qGreen(line[x]), alpha), qMin(qBlue(line[x]), alpha), alpha);
+            }
+        }
+    }
+    result.setDotsPerMeterX(source.dotsPerMeterX());
+    result.setDotsPerMeterY(source.dotsPerMeterY());
+    return result;
+}
+
+QSize ImageResampler::exportSize(const QSize& source, int maxDimension, int scalePercent) {
+    QSize size = source;
+    if (scalePercent > 0 && scalePercent < 100) {
+        size = QSize(qMax(1, source.width() * scalePercent / 100), qMax(1, source.height() * scalePercent / 100));
+    }
+    if (maxDimension > 0 && qMax(size.width(), size.height()) > maxDimension) {
+        size = size.scaled(maxDimension, maxDimension, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    }
+    return size;
+}
+
+double ImageResampler::psnr(const QImage& reference, const QImage& image) {
+    if (reference.size() != image.size() || reference.isNull()) {
+        return 0.0;
+    }
+    const QImage a = reference.convertToFormat(QImage::Format_RGB32);
+    const QImage b = image.convertToFormat(QImage::Format_RGB32);
+
+    double squaredError = 0.0;
+    for (int y = 0; y < a.height(); ++y) {
+        const QRgb* lineA = reinterpret_cast<const QRgb*>(a.constScanLine(y));
+        const QRgb* lineB = reinterpret_cast<const QRgb*>(b.constScanLine(y));
+        for (int x = 0; x < a.width(); ++x) {
+            const int dr = qRed(lineA[x]) - qRed(lineB[x]);
+            const int dg = qGreen(lineA[x]) - qGreen(lineB[x]);
+            const int db = qBlue(lineA[x]) - qBlue(lineB[x]);
+            squaredError += dr * dr + dg * dg + db * db;
+        }
+    }
+    if (squaredError == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    const double mse = squaredError / (double(a.width()) * a.height() * 3);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
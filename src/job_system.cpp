@@ -0,0 +1,206 @@
+#include "include/job_system.h"
+#include <algorithm>
+
+namespace {
+    // Index of the worker running on this thread, -1 on any other thread
+    thread_local int currentWorker = -1;
+
+    int laneIndex(JobSystem::Lane lane) {
+        return lane == JobSystem::Lane::Interactive ? 0 : 1;
+    }
+}
+
+JobSystem::JobSystem(int workerCount, QObject* parent)
+    : QObject(parent), nextWorker(0), stopping(false) {
+    workerCount = qMax(1, workerCount);
+    // Keep one worker for interactive jobs whenever there is more than one
+    maxBackground = qMax(1, workerCount - 1);
+    for (int lane = 0; lane < LaneCount; ++lane) {
+        queued[lane] = 0;
+        running[lane] = 0;
+        metrics[lane].waits.reserve(WaitSamples);
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        workers[i]->thread = std::thread([this, i]() { work(i); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (const std::unique_ptr<Worker>& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+JobSystem* JobSystem::instance() {
+    static JobSystem* system = new JobSystem(QThread::idealThreadCount(), QCoreApplication::instance());
+    return system;
+}
+
+std::shared_ptr<JobToken> JobSystem::submit(Lane lane, std::function<void(const JobToken&)> run, QObject* owner) {
+    Job job;
+    job.run = std::move(run);
+    job.token = std::make_shared<JobToken>();
+    job.lane = lane;
+    job.submitted = std::chrono::steady_clock::now();
+    if (owner) {
+        job.ownerConnection = connect(owner, &QObject::destroyed, [token = job.token]() { token->cancel(); });
+    }
+    std::shared_ptr<JobToken> token = job.token;
+
+    // Nested jobs stay with the worker that spawned them, others are spread round-robin
+    const int index = currentWorker >= 0 ? currentWorker : int(nextWorker++ % workers.size());
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->lanes[laneIndex(lane)].push_back(std::move(job));
+        ++queued[laneIndex(lane)];
+    }
+    // A worker that just found nothing either sees the job or is already waiting
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+    return token;
+}
+
+JobSystem::LaneStats JobSystem::stats(Lane lane) const {
+    const int index = laneIndex(lane);
+    LaneStats stats;
+    stats.queued = queued[index];
+    stats.running = running[index];
+
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    const Metrics& laneMetrics = metrics[index];
+    stats.completed = laneMetrics.completed;
+    stats.canceled = laneMetrics.canceled;
+    stats.maxWaitMs = laneMetrics.maxWait;
+    if (!laneMetrics.waits.empty()) {
+        std::vector<double> waits = laneMetrics.waits;
+        double total = 0.0;
+        for (double wait : waits) {
+            total += wait;
+        }
+        stats.meanWaitMs = total / waits.size();
+        const size_t p95 = std::min(waits.size() - 1, waits.size() * 95 / 100);
+        std::nth_element(waits.begin(), waits.begin() + p95, waits.end());
+        stats.p95WaitMs = waits[p95];
+    }
+    return stats;
+}
+
+void JobSystem::work(int index) {
+    currentWorker = index;
+    for (;;) {
+        Job job;
+        if (take(index, &job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || hasRunnable(); });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+bool JobSystem::hasRunnable() const {
+    return queued[0] > 0 || (queued[1] > 0 && running[1] < maxBackground);
+}
+
+bool JobSystem::take(int index, Job* job) {
+    if (takeFrom(index, Lane::Interactive, job)) {
+        return true;
+    }
+    // Claim a background slot before looking, so the last free worker is never taken
+    int background = running[1];
+    do {
+        if (background >= maxBackground) {
+            return false;
+        }
+    } while (!running[1].compare_exchange_weak(background, background + 1));
+    if (takeFrom(index, Lane::Background, job)) {
+        return true;
+    }
+    --running[1];
+    return false;
+}
+
+bool JobSystem::takeFrom(int index, Lane lane, Job* job) {
+    const int slot = laneIndex(lane);
+    if (queued[slot] == 0) {
+        return false;
+    }
+    // Own deque from the back, keeping what was just queued warm in cache
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.lanes[slot].empty()) {
+            *job = std::move(own.lanes[slot].back());
+            own.lanes[slot].pop_back();
+            --queued[slot];
+            return true;
+        }
+    }
+    // Steal the oldest job of another worker
+    const int count = int(workers.size());
+    for (int offset = 1; offset < count; ++offset) {
+        Worker& victim = *workers[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.lanes[slot].empty()) {
+            *job = std::move(victim.lanes[slot].front());
+            victim.lanes[slot].pop_front();
+            --queued[slot];
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Job& job) {
+    const int slot = laneIndex(job.lane);
+    if (slot == 0) {
+        ++running[0];
+    }
+    const double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.submitted).count();
+    const bool canceled = job.token->isCanceled();
+    if (!canceled) {
+        job.run(*job.token);
+    }
+    disconnect(job.ownerConnection);
+    // Drop the callable here, its captures may report completion when destroyed
+    job.run = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        Metrics& laneMetrics = metrics[slot];
+        if (canceled) {
+            ++laneMetrics.canceled;
+        }
+        else {
+            ++laneMetrics.completed;
+            if (int(laneMetrics.waits.size()) < WaitSamples) {
+                laneMetrics.waits.push_back(waitMs);
+            }
+            else {
+                laneMetrics.waits[laneMetrics.nextWait] = waitMs;
+            }
+            laneMetrics.nextWait = (laneMetrics.nextWait + 1) % WaitSamples;
+            laneMetrics.maxWait = qMax(laneMetrics.maxWait, waitMs);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        --running[slot];
+    }
+    // A finished background job frees a slot another worker may be waiting for
+    if (slot == 1 && queued[1] > 0) {
+        wake.notify_one();
+    }
+}
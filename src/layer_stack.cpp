@@ -0,0 +1,247 @@
+#include "include/layer_stack.h"
+#include "include/frame_buffer_pool.h"
+#include <QPainter>
+#include <cstring>
+
+namespace {
+    const int TileSize = 256;
+    const int RedactionBlockSize = 12;
+}
+
+LayerStack::LayerStack(const QImage& background, qreal scale, const QPoint& origin)
+    : tilesWide(0), tilesHigh(0), anyDirty(false), scaleFactor(scale > 0 ? scale : 1.0), originPoint(origin) {
+    QImage base = background;
+    if (base.format() != QImage::Format_RGB32 && base.format() != QImage::Format_ARGB32_Premultiplied) {
+        base = base.convertToFormat(base.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    }
+    // Layer rasters are addressed in plain pixels, the logical to pixel mapping is scaleFactor
+    base.setDevicePixelRatio(1.0);
+
+    layers[Background].composite = base;
+    layers[Background].used = true;
+
+    tilesWide = (base.width() + TileSize - 1) / TileSize;
+    tilesHigh = (base.height() + TileSize - 1) / TileSize;
+    dirtyFrom = QVector<quint8>(tilesWide * tilesHigh, quint8(LayerCount));
+}
+
+LayerStack::LayerId LayerStack::layerFor(Annotation::Kind kind) {
+    switch (kind) {
+    case Annotation::Redaction:
+        return Redactions;
+    case Annotation::Highlight:
+        return Highlights;
+    case Annotation::Text:
+        return Text;
+    default:
+        return Shapes;
+    }
+}
+
+BlendMode LayerStack::blendMode(LayerId layer) {
+    return layer == Highlights ? BlendMode::Multiply : BlendMode::SourceOver;
+}
+
+QRect LayerStack::mapToImage(const QRectF& logicalRect) const {
+    return QRectF((logicalRect.x() - originPoint.x()) * scaleFactor, (logicalRect.y() - originPoint.y()) * scaleFactor,
+        logicalRect.width() * scaleFactor, logicalRect.height() * scaleFactor).toAlignedRect();
+}
+
+void LayerStack::addAnnotation(LayerId layer, const Annotation& annotation) {
+    Q_ASSERT(layer != Background);
+    ensureLayer(layer);
+    layers[layer].annotations.append(annotation);
+    history.append({ layer, int(layers[layer].annotations.size()) - 1, false, Annotation() });
+
+    QPainter painter(&layers[layer].raster);
+    painter.scale(scaleFactor, scaleFactor);
+    painter.translate(-originPoint);
+    paintAnnotation(painter, annotation);
+    painter.end();
+
+    markDirty(layer, mapToImage(annotation.bounds()));
+}
+
+void LayerStack::updateAnnotation(LayerId layer, int index, const Annotation& annotation, bool recordUndo) {
+    Annotation& current = layers[layer].annotations[index];
+    QRect area = mapToImage(current.bounds()).united(mapToImage(annotation.bounds()));
+    if (recordUndo) {
+        history.append({ layer, index, true, current });
+    }
+    current = annotation;
+    repaintArea(layer, area);
+}
+
+bool LayerStack::undo() {
+    if (history.isEmpty()) {
+        return false;
+    }
+    HistoryEntry entry = history.takeLast();
+    QVector<Annotation>& annotations = layers[entry.layer].annotations;
+    QRect area = mapToImage(annotations.at(entry.index).bounds());
+    if (entry.replaced) {
+        area = area.united(mapToImage(entry.previous.bounds()));
+        annotations[entry.index] = entry.previous;
+    }
+    else {
+        annotations.removeAt(entry.index);
+    }
+    repaintArea(entry.layer, area);
+    return true;
+}
+
+void LayerStack::removeAnnotation(LayerId layer, int index) {
+    QVector<Annotation>& annotations = layers[layer].annotations;
+    const QRect area = mapToImage(annotations.at(index).bounds());
+    annotations.removeAt(index);
+    for (int i = history.size() - 1; i >= 0; --i) {
+        HistoryEntry& entry = history[i];
+        if (entry.layer != layer || entry.index < index) {
+            continue;
+        }
+        if (entry.index == index) {
+            history.removeAt(i);
+        }
+        else {
+            --entry.index;
+        }
+    }
+    repaintArea(layer, area);
+}
+
+const QImage& LayerStack::composite() {
+    if (anyDirty) {
+        for (int tile = 0; tile < dirtyFrom.size(); ++tile) {
+            if (dirtyFrom[tile] < LayerCount) {
+                compositeTile(tile);
+            }
+        }
+        anyDirty = false;
+    }
+    return layers[topLayer()].composite;
+}
+
+const QImage& LayerStack::flattened(LayerId layer) {
+    composite();
+    for (int index = layer; index > Background; --index) {
+        if (layers[index].used) {
+            return layers[index].composite;
+        }
+    }
+    return layers[Background].composite;
+}
+
+QImage LayerStack::render(const QRect& imageArea) {
+    return FrameBufferPool::instance()->copy(composite(), imageArea);
+}
+
+void LayerStack::ensureLayer(LayerId layer) {
+    Layer& target = layers[layer];
+    if (target.used) {
+        return;
+    }
+    const QImage& base = layers[Background].composite;
+    FrameBufferPool* pool = FrameBufferPool::instance();
+    target.raster = pool->image(base.size(), QImage::Format_ARGB32_Premultiplied);
+    target.raster.fill(Qt::transparent);
+    target.composite = pool->image(base.size(), base.format());
+    target.used = true;
+    // The new composite starts out uninitialised, build it once for every tile
+    markDirty(layer, base.rect());
+}
+
+void LayerStack::paintAnnotation(QPainter& painter, const Annotation& annotation) {
+    if (annotation.kind != Annotation::Redaction) {
+        annotation.paint(painter);
+        return;
+    }
+
+    // Redactions are a mosaic of the capture itself rather than a vector shape
+    const QImage& base = layers[Background].composite;
+    QRect area = mapToImage(annotation.rect.normalized()).intersected(base.rect());
+    if (area.isEmpty()) {
+        return;
+    }
+    QImage blocks = base.copy(area)
+        .scaled(qMax(1, area.width() / RedactionBlockSize), qMax(1, area.height() / RedactionBlockSize),
+            Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+        .scaled(area.size(), Qt::IgnoreAspectRatio, Qt::FastTransformation);
+
+    painter.save();
+    painter.resetTransform();
+    painter.drawImage(area.topLeft(), blocks);
+    painter.restore();
+}
+
+void LayerStack::repaintArea(LayerId layer, const QRect& imageArea) {
+    Layer& target = layers[layer];
+    QRect area = imageArea.intersected(target.raster.rect());
+    if (area.isEmpty()) {
+        return;
+    }
+
+    QPainter painter(&target.raster);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.fillRect(area, Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setClipRect(area);
+    painter.scale(scaleFactor, scaleFactor);
+    painter.translate(-originPoint);
+    for (const Annotation& annotation : target.annotations) {
+        if (mapToImage(annotation.bounds()).intersects(area)) {
+            paintAnnotation(painter, annotation);
+        }
+    }
+    painter.end();
+
+    markDirty(layer, area);
+}
+
+void LayerStack::markDirty(LayerId layer, const QRect& imageArea) {
+    QRect area = imageArea.intersected(layers[Background].composite.rect());
+    if (area.isEmpty()) {
+        return;
+    }
+    for (int ty = area.top() / TileSize; ty <= area.bottom() / TileSize; ++ty) {
+        for (int tx = area.left() / TileSize; tx <= area.right() / TileSize; ++tx) {
+            quint8& from = dirtyFrom[ty * tilesWide + tx];
+            from = qMin(from, quint8(layer));
+        }
+    }
+    anyDirty = true;
+}
+
+void LayerStack::compositeTile(int tile) {
+    const int from = dirtyFrom[tile];
+    const QImage& base = layers[Background].composite;
+    const QRect area = QRect((tile % tilesWide) * TileSize, (tile / tilesWide) * TileSize, TileSize, TileSize)
+        .intersected(base.rect());
+    const qsizetype rowBytes = qsizetype(area.width()) * sizeof(quint32);
+
+    const QImage* below = &base;
+    for (int index = Background + 1; index < LayerCount; ++index) {
+        Layer& layer = layers[index];
+        if (!layer.used) {
+            continue;
+        }
+        if (index >= from) {
+            BlendKernels::SpanFunction blend = BlendKernels::spanFunction(blendMode(LayerId(index)), layer.composite.format());
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                quint32* dst = reinterpret_cast<quint32*>(layer.composite.scanLine(y)) + area.left();
+                std::memcpy(dst, reinterpret_cast<const quint32*>(below->constScanLine(y)) + area.left(), rowBytes);
+                blend(reinterpret_cast<const quint32*>(layer.raster.constScanLine(y)) + area.left(), dst, area.width());
+            }
+        }
+        below = &layer.composite;
+    }
+    dirtyFrom[tile] = quint8(LayerCount);
+}
+
+int LayerStack::topLayer() const {
+    for (int index = LayerCount - 1; index > Background; --index) {
+        if (layers[index].used) {
+            return index;
+        }
+    }
+    return Background;
+}
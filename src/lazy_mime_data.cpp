@@ -0,0 +1,79 @@
+#include "include/lazy_mime_data.h"
+#include <QBuffer>
+#include <QImageWriter>
+#include <QDebug>
+
+namespace {
+    const QString QtImageMime = QStringLiteral("application/x-qt-image");
+
+    struct EncodedFormat {
+        const char* mimeType;
+        const char* writerFormat;
+    };
+
+    // Lossless formats only, in order of preference for consumers that pick the first match
+    const EncodedFormat encodedFormats[] = {
+        { "image/png", "PNG" },
+        { "image/bmp", "BMP" },
+        { "image/x-bmp", "BMP" },
+    };
+
+    const char* writerFormatFor(const QString& mimeType) {
+        for (const EncodedFormat& format : encodedFormats) {
+            if (mimeType == QLatin1String(format.mimeType)) {
+                return format.writerFormat;
+            }
+        }
+        return nullptr;
+    }
+}
+
+LazyImageMimeData::LazyImageMimeData(const QImage& image)
+    : QMimeData(), image(image) {}
+
+bool LazyImageMimeData::hasFormat(const QString& mimeType) const {
+    return mimeType == QtImageMime || writerFormatFor(mimeType) != nullptr;
+}
+
+QStringList LazyImageMimeData::formats() const {
+    QStringList result;
+    result << QtImageMime;
+    for (const EncodedFormat& format : encodedFormats) {
+        result << QLatin1String(format.mimeType);
+    }
+    return result;
+}
+
+QVariant LazyImageMimeData::retrieveData(const QString& mimeType, QMetaType type) const {
+    if (mimeType == QtImageMime) {
+        // Platform converters (DIB on Windows, image/* on X11) encode from the QImage themselves
+        return QVariant(image);
+    }
+    if (!writerFormatFor(mimeType)) {
+        return QMimeData::retrieveData(mimeType, type);
+    }
+
+    auto cached = encodedCache.constFind(mimeType);
+    if (cached != encodedCache.constEnd()) {
+        return QVariant(cached.value());
+    }
+
+    QByteArray bytes = encode(mimeType);
+    encodedCache.insert(mimeType, bytes);
+    return QVariant(bytes);
+}
+
+QByteArray LazyImageMimeData::encode(const QString& mimeType) const {
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+
+    QImageWriter writer(&buffer, writerFormatFor(mimeType));
+    // Clipboard consumers expect the paste to be quick, favour speed over size
+    writer.setCompression(1);
+    if (!writer.write(image)) {
+        qWarning() << "Failed to encode clipboard image as" << mimeType << ":" << writer.errorString();
+        return QByteArray();
+    }
+    return bytes;
+}
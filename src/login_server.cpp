@@ -4,7 +4,8 @@
 LoginServer::LoginServer(QObject* parent)
     : QObject(parent),
     webSocketServer(new QWebSocketServer(QStringLiteral("Login Server"),
-        QWebSocketServer::NonSecureMode, this)) {
+        QWebSocketServer::NonSecureMode, this)),
+    automationApi(new AutomationApi(this)) {
     if (webSocketServer->listen(QHostAddress::LocalHost, 4242)) {
         connect(webSocketServer, &QWebSocketServer::newConnection,
             this, &LoginServer::onNewConnection);
@@ -18,14 +19,30 @@ void LoginServer::onNewConnection() {
     QWebSocket* client = webSocketServer->nextPendingConnection();
     clients << client;
 
+    automationApi->addClient(client);
+
     connect(client, &QWebSocket::textMessageReceived,
         this, &LoginServer::processTextMessage);
+    connect(client, &QWebSocket::binaryMessageReceived,
+        this, &LoginServer::processBinaryMessage);
     connect(client, &QWebSocket::disconnected,
         this, &LoginServer::socketDisconnected);
 }
 
 void LoginServer::processTextMessage(QString message) {
-    QJsonDocument doc = QJsonDocument::fromJson(message.toUtf8());
+    processMessage(qobject_cast<QWebSocket*>(sender()), message.toUtf8());
+}
+
+void LoginServer::processBinaryMessage(QByteArray message) {
+    processMessage(qobject_cast<QWebSocket*>(sender()), message);
+}
+
+void LoginServer::processMessage(QWebSocket* client, const QByteArray& message) {
+    QJsonDocument doc = QJsonDocument::fromJson(message);
+    if (client && AutomationApi::isRpcMessage(doc)) {
+        automationApi->handleMessage(client, doc);
+        return;
+    }
     if (!doc.isObject()) {
         qDebug() << "Received invalid JSON";
         return;
@@ -49,6 +66,7 @@ void LoginServer::socketDisconnected() {
     QWebSocket* client = qobject_cast<QWebSocket*>(sender());
     if (client) {
         clients.removeAll(client);
+        automationApi->removeClient(client);
         client->deleteLater();
     }
 }
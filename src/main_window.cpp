@@ -8,6 +8,56 @@
 #include "include/options_window.h"
 #include "include/screenshotdisplay.h"
 #include "include/uglobalhotkeys.h"
+#include "include/content_classifier.h"
+#include "include/frame_buffer_pool.h"
+#include "include/capture_search.h"
+#include "include/metrics_registry.h"
+#include "include/upload_scheduler.h"
+#include "include/job_system.h"
+#include <QElapsedTimer>
+
+namespace {
+    // Counts the capture and times grabbing its pixels
+    template <typename Grab>
+    auto grabCapture(const QString& mode, const Grab& grab) {
+        MetricsRegistry* metrics = MetricsRegistry::instance();
+        QElapsedTimer timer;
+        timer.start();
+        auto capture = grab();
+        metrics->histogram("screenme_grab_seconds", "Time to grab the screen pixels")->observe(timer.nsecsElapsed() / 1e9);
+        metrics->counter("screenme_captures_total", "Captures taken", QString("mode=\"%1\"").arg(mode))->add();
+        return capture;
+    }
+
+    void registerGauges() {
+        MetricsRegistry* metrics = MetricsRegistry::instance();
+        metrics->gauge("screenme_upload_queue_depth", "Uploads waiting for a slot", []() {
+            return double(UploadScheduler::instance()->stats().queued);
+        });
+        metrics->gauge("screenme_uploads_active", "Uploads in flight", []() {
+            return double(UploadScheduler::instance()->stats().active);
+        });
+        const QList<QPair<JobSystem::Lane, QString>> lanes = {
+            { JobSystem::Lane::Interactive, "interactive" },
+            { JobSystem::Lane::Background, "background" }
+        };
+        for (const auto& lane : lanes) {
+            const JobSystem::Lane id = lane.first;
+            metrics->gauge("screenme_job_queue_depth", "Image jobs waiting for a worker", [id]() {
+                return double(JobSystem::instance()->stats(id).queued);
+            }, QString("lane=\"%1\"").arg(lane.second));
+        }
+        metrics->gauge("screenme_frame_pool_bytes", "Pixel buffers held by the frame pool", []() {
+            return double(FrameBufferPool::instance()->stats().bytesInUse);
+        }, "state=\"in_use\"");
+        metrics->gauge("screenme_frame_pool_bytes", "Pixel buffers held by the frame pool", []() {
+            return double(FrameBufferPool::instance()->stats().bytesCached);
+        }, "state=\"cached\"");
+        metrics->gauge("screenme_resident_bytes", "Resident memory of the process", []() {
+            return double(MemoryTrimmer::residentBytes());
+        });
+    }
+}
 
 MainWindow::MainWindow(ConfigManager* configManager, QWidget* parent)
     : QMainWindow(parent), configManager(configManager), isScreenshotDisplayed(false) {
@@ -16,10 +66,17 @@ MainWindow::MainWindow(ConfigManager* configManager, QWidget* parent)
 
     // Initialize UGlobalHotkeys
     hotkeyManager = new UGlobalHotkeys(this);
+    memoryTrimmer = new MemoryTrimmer(this);
 
     QJsonObject config = configManager->loadConfig();
     QString screenshotHotkey = config["screenshot_hotkey"].toString();
     QString fullscreenHotkey = config["fullscreen_hotkey"].toString();
+    FrameBufferPool::instance()->applyConfig(config);
+    memoryTrimmer->applyConfig(config);
+    CaptureSearch::instance()->applyConfig(config);
+    MetricsRegistry::instance()->applyConfig(config);
+    applyScreenMeHost(config);
+    registerGauges();
 
     if (!screenshotHotkey.isEmpty()) {
         hotkeyManager->registerHotkey(screenshotHotkey, 1);
@@ -38,6 +95,11 @@ void MainWindow::reloadHotkeys() {
     QJsonObject config = configManager->loadConfig();
     QString screenshotHotkey = config["screenshot_hotkey"].toString();
     QString fullscreenHotkey = config["fullscreen_hotkey"].toString();
+    FrameBufferPool::instance()->applyConfig(config);
+    memoryTrimmer->applyConfig(config);
+    CaptureSearch::instance()->applyConfig(config);
+    MetricsRegistry::instance()->applyConfig(config);
+    applyScreenMeHost(config);
 
     if (!screenshotHotkey.isEmpty()) {
         hotkeyManager->registerHotkey(screenshotHotkey, 1);
@@ -52,15 +114,20 @@ void MainWindow::takeScreenshot() {
     qDebug() << "takeScreenshot";
     if (isScreenshotDisplayed) return;
 
-    QScreen* screen = QGuiApplication::primaryScreen();
-    if (!screen) {
+    if (!QGuiApplication::primaryScreen()) {
         qDebug() << "No primary screen found";
         return;
     }
-    QPixmap originalPixmap = screen->grabWindow(0);
-    screenshotDisplay = new ScreenshotDisplay(originalPixmap, nullptr, configManager);
+    // The pooled frames the trim would release are about to be needed again
+    memoryTrimmer->cancel();
+    // The selection may span every screen, each one gets an overlay over its part
+    QRect desktop;
+    const QVector<ScreenGrab> capture = grabCapture("region", [&desktop]() {
+        return grabDesktop(&desktop);
+    });
+    screenshotDisplay = new ScreenshotDisplay(capture, desktop, nullptr, configManager);
     connect(screenshotDisplay, &ScreenshotDisplay::screenshotClosed, this, &MainWindow::handleScreenshotClosed);
-    screenshotDisplay->show();
+    connect(screenshotDisplay, &ScreenshotDisplay::captureSaved, this, &MainWindow::captureSaved);
     isScreenshotDisplayed = true;
 }
 
@@ -73,10 +140,15 @@ void MainWindow::takeFullscreenScreenshot() {
         qDebug() << "No primary screen found";
         return;
     }
-    QPixmap originalPixmap = screen->grabWindow(0);
     QJsonObject config = configManager->loadConfig();
-    QString savePath = getUniqueFilePath(config["default_save_folder"].toString(), "fullscreen_screenshot", config["file_extension"].toString());
-    originalPixmap.save(savePath);
+    QImage capture = grabCapture("fullscreen", [screen]() { return grabScreen(screen); });
+    QString extension = ContentClassifier::chooseExtension(capture, config["file_extension"].toString());
+    QString savePath = getUniqueFilePath(config["default_save_folder"].toString(), "fullscreen_screenshot", extension);
+    if (saveCapture(capture, savePath, config["image_quality"].toInt())) {
+        CaptureSearch::instance()->addCapture(savePath);
+        emit captureSaved(savePath, capture);
+    }
+    memoryTrimmer->schedule();
 }
 
 void MainWindow::handleHotkeyActivated(size_t id) {
@@ -95,4 +167,6 @@ void MainWindow::handleScreenshotClosed() {
         screenshotDisplay->deleteLater();
         screenshotDisplay = nullptr;
     }
+    // Once the display's deferred delete has run
+    memoryTrimmer->schedule();
 }
@@ -0,0 +1,89 @@
+#include "include/memory_trimmer.h"
+#include "include/frame_buffer_pool.h"
+#include "include/capture_search.h"
+#include <QPixmapCache>
+#include <QElapsedTimer>
+#include <QFile>
+#ifdef Q_OS_WIN
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace {
+    // Long enough for deferred deletes and a quick follow-up capture
+    const int TrimDelayMs = 3000;
+    const int DefaultPoolKeepMb = 64;
+}
+
+MemoryTrimmer::MemoryTrimmer(QObject* parent)
+    : QObject(parent), poolKeepBytes(qint64(DefaultPoolKeepMb) * 1024 * 1024) {
+    delay.setSingleShot(true);
+    delay.setInterval(TrimDelayMs);
+    connect(&delay, &QTimer::timeout, this, [this]() { trim(); });
+}
+
+void MemoryTrimmer::applyConfig(const QJsonObject& config) {
+    poolKeepBytes = qMax(0, config["idle_pool_keep_mb"].toInt(DefaultPoolKeepMb)) * qint64(1024 * 1024);
+}
+
+void MemoryTrimmer::schedule() {
+    delay.start();
+}
+
+void MemoryTrimmer::cancel() {
+    delay.stop();
+}
+
+MemoryTrimmer::Result MemoryTrimmer::trim() {
+    delay.stop();
+    Result result;
+    result.residentBefore = residentBytes();
+    QElapsedTimer clock;
+    clock.start();
+
+    QPixmapCache::clear();
+    FrameBufferPool::instance()->trim(poolKeepBytes);
+    CaptureSearch::instance()->releaseOcrEngine();
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+    // glibc keeps freed arenas and the top of the heap mapped otherwise
+    malloc_trim(0);
+#elif defined(Q_OS_WIN)
+    HeapCompact(GetProcessHeap(), 0);
+    // Freed pages stay in the working set until it is trimmed
+    SetProcessWorkingSetSize(GetCurrentProcess(), SIZE_T(-1), SIZE_T(-1));
+#endif
+
+    result.elapsedMs = clock.elapsed();
+    result.residentAfter = residentBytes();
+    emit trimmed(result);
+    return result;
+}
+
+qint64 MemoryTrimmer::residentBytes() {
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters = {};
+    counters.cb = sizeof(counters);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return qint64(counters.WorkingSetSize);
+    }
+    return -1;
+#elif defined(Q_OS_LINUX)
+    // statm: total and resident size, in pages
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2) {
+        return -1;
+    }
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
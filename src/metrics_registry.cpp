@@ -0,0 +1,202 @@
+#include "include/metrics_registry.h"
+#include "include/utils.h"
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QSaveFile>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const int DefaultExportIntervalS = 15;
+
+    QString formatValue(double value) {
+        if (std::isinf(value)) {
+            return value > 0 ? "+Inf" : "-Inf";
+        }
+        return QString::number(value, 'g', 12);
+    }
+
+    // name{labels} with `extra` appended to the labels
+    QString series(const QString& name, const QString& labels, const QString& extra = QString()) {
+        QString all = labels;
+        if (!extra.isEmpty()) {
+            all += all.isEmpty() ? extra : ',' + extra;
+        }
+        return all.isEmpty() ? name : name + '{' + all + '}';
+    }
+}
+
+MetricsRegistry::Histogram::Histogram(const QVector<double>& bounds)
+    : upperBounds(bounds), buckets(new std::atomic<qint64>[bounds.size() + 1]) {
+    std::sort(upperBounds.begin(), upperBounds.end());
+    for (qsizetype i = 0; i <= upperBounds.size(); ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricsRegistry::Histogram::observe(double seconds) {
+    const qsizetype bucket = std::lower_bound(upperBounds.constBegin(), upperBounds.constEnd(), seconds) - upperBounds.constBegin();
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumMicros.fetch_add(qint64(std::llround(seconds * 1e6)), std::memory_order_relaxed);
+}
+
+QVector<qint64> MetricsRegistry::Histogram::bucketCounts() const {
+    QVector<qint64> counts(upperBounds.size() + 1);
+    for (qsizetype i = 0; i < counts.size(); ++i) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    return counts;
+}
+
+const QVector<double>& MetricsRegistry::latencyBuckets() {
+    static const QVector<double> bounds = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30 };
+    return bounds;
+}
+
+MetricsRegistry::MetricsRegistry(QObject* parent)
+    : QObject(parent), filePath(getConfigFilePath("metrics.prom")) {
+    exportTimer.setInterval(DefaultExportIntervalS * 1000);
+    connect(&exportTimer, &QTimer::timeout, this, [this]() { exportFile(); });
+    exportTimer.start();
+}
+
+MetricsRegistry* MetricsRegistry::instance() {
+    static MetricsRegistry* registry = new MetricsRegistry(QCoreApplication::instance());
+    return registry;
+}
+
+void MetricsRegistry::applyConfig(const QJsonObject& config) {
+    const int seconds = config["metrics_export_interval_s"].toInt(DefaultExportIntervalS);
+    if (seconds <= 0) {
+        exportTimer.stop();
+        return;
+    }
+    exportTimer.start(seconds * 1000);
+}
+
+MetricsRegistry::Metric* MetricsRegistry::find(const QString& name, const QString& labels, Type type) {
+    for (Metric* metric : families.value(name)) {
+        if (metric->labels == labels) {
+            Q_ASSERT(metric->type == type && "Metric registered with another type");
+            return metric;
+        }
+    }
+    auto metric = std::make_unique<Metric>();
+    metric->name = name;
+    metric->labels = labels;
+    metric->type = type;
+    Metric* added = metric.get();
+    metrics.push_back(std::move(metric));
+    families[name].append(added);
+    return added;
+}
+
+MetricsRegistry::Counter* MetricsRegistry::counter(const QString& name, const QString& help, const QString& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* metric = find(name, labels, Type::Counter);
+    metric->help = help;
+    if (!metric->counter) {
+        metric->counter = std::make_unique<Counter>();
+    }
+    return metric->counter.get();
+}
+
+MetricsRegistry::Histogram* MetricsRegistry::histogram(const QString& name, const QString& help, const QString& labels,
+    const QVector<double>& bounds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* metric = find(name, labels, Type::Histogram);
+    metric->help = help;
+    if (!metric->histogram) {
+        metric->histogram = std::make_unique<Histogram>(bounds);
+    }
+    return metric->histogram.get();
+}
+
+void MetricsRegistry::gauge(const QString& name, const QString& help, std::function<double()> read, const QString& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Metric* metric = find(name, labels, Type::Gauge);
+    metric->help = help;
+    metric->read = std::move(read);
+}
+
+QString MetricsRegistry::prometheusText() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    QString text;
+    for (auto family = families.constBegin(); family != families.constEnd(); ++family) {
+        const Metric* first = family.value().first();
+        const char* type = first->type == Type::Counter ? "counter" : first->type == Type::Histogram ? "histogram" : "gauge";
+        text += QString("# HELP %1 %2\n# TYPE %1 %3\n").arg(family.key(), first->help, type);
+        for (const Metric* metric : family.value()) {
+            switch (metric->type) {
+            case Type::Counter:
+                text += series(metric->name, metric->labels) + ' ' + QString::number(metric->counter->value()) + '\n';
+                break;
+            case Type::Gauge:
+                text += series(metric->name, metric->labels) + ' ' + formatValue(metric->read ? metric->read() : 0.0) + '\n';
+                break;
+            case Type::Histogram: {
+                // Prometheus buckets are cumulative
+                const QVector<qint64> counts = metric->histogram->bucketCounts();
+                const QVector<double>& bounds = metric->histogram->bounds();
+                qint64 cumulative = 0;
+                for (qsizetype i = 0; i < counts.size(); ++i) {
+                    cumulative += counts[i];
+                    const double bound = i < bounds.size() ? bounds[i] : INFINITY;
+                    text += series(metric->name + "_bucket", metric->labels, QString("le=\"%1\"").arg(formatValue(bound)))
+                        + ' ' + QString::number(cumulative) + '\n';
+                }
+                text += series(metric->name + "_sum", metric->labels) + ' ' + formatValue(metric->histogram->sum()) + '\n';
+                text += series(metric->name + "_count", metric->labels) + ' ' + QString::number(cumulative) + '\n';
+                break;
+            }
+            }
+        }
+    }
+    return text;
+}
+
+QJsonObject MetricsRegistry::toJson() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    QJsonObject json;
+    for (const std::unique_ptr<Metric>& metric : metrics) {
+        const QString key = series(metric->name, metric->labels);
+        switch (metric->type) {
+        case Type::Counter:
+            json[key] = metric->counter->value();
+            break;
+        case Type::Gauge:
+            json[key] = metric->read ? metric->read() : 0.0;
+            break;
+        case Type::Histogram: {
+            const QVector<qint64> counts = metric->histogram->bucketCounts();
+            const QVector<double>& bounds = metric->histogram->bounds();
+            QJsonArray buckets;
+            for (qsizetype i = 0; i < counts.size(); ++i) {
+                buckets.append(QJsonObject{
+                    { "le", i < bounds.size() ? QJsonValue(bounds[i]) : QJsonValue("+Inf") },
+                    { "count", counts[i] } });
+            }
+            json[key] = QJsonObject{
+                { "count", metric->histogram->count() },
+                { "sum", metric->histogram->sum() },
+                { "buckets", buckets } };
+            break;
+        }
+        }
+    }
+    return json;
+}
+
+bool MetricsRegistry::exportFile() {
+    // Replaced in one rename, a scraper never reads half a file
+    QSaveFile file(filePath);
+    // Not Text, the format wants bare newlines on Windows too
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write metrics to" << filePath;
+        return false;
+    }
+    file.write(prometheusText().toUtf8());
+    return file.commit();
+}
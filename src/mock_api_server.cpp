@@ -0,0 +1,314 @@
+#include "include/mock_api_server.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QUrlQuery>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <limits>
+
+namespace {
+    const int PaceMs = 50;
+    // Small socket buffers make the kernel push back on the client once we stop reading
+    const qint64 ReadBufferSize = 16 * 1024;
+}
+
+MockApiServer::MockApiServer(QObject* parent)
+    : QObject(parent), bandwidth(0), latency(0), jitter(0), errorRate(0.0), authFailureRate(0.0), bulkPrivacy(true),
+    nextId(1) {
+    connect(&server, &QTcpServer::newConnection, this, &MockApiServer::onNewConnection);
+    pacer.setInterval(PaceMs);
+    connect(&pacer, &QTimer::timeout, this, &MockApiServer::drainAll);
+}
+
+bool MockApiServer::listen(quint16 port) {
+    return server.listen(QHostAddress::LocalHost, port);
+}
+
+void MockApiServer::setBandwidth(qint64 bytesPerSecond) {
+    bandwidth = qMax<qint64>(0, bytesPerSecond);
+    if (bandwidth > 0) {
+        pacer.start();
+    }
+    else {
+        pacer.stop();
+    }
+}
+
+void MockApiServer::setLatency(int latencyMs, int jitterMs) {
+    latency = qMax(0, latencyMs);
+    jitter = qMax(0, jitterMs);
+}
+
+void MockApiServer::setErrorRate(double rate) {
+    errorRate = qBound(0.0, rate, 1.0);
+}
+
+void MockApiServer::setRequiredToken(const QByteArray& token, double failureRate) {
+    requiredToken = token;
+    authFailureRate = qBound(0.0, failureRate, 1.0);
+}
+
+void MockApiServer::setBulkPrivacy(bool supported) {
+    bulkPrivacy = supported;
+}
+
+bool MockApiServer::chance(double rate) {
+    return rate > 0.0 && QRandomGenerator::global()->generateDouble() < rate;
+}
+
+void MockApiServer::onNewConnection() {
+    while (QTcpSocket* socket = server.nextPendingConnection()) {
+        connections.insert(socket, Connection());
+        if (bandwidth > 0) {
+            socket->setReadBufferSize(ReadBufferSize);
+        }
+        else {
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { drain(socket); });
+        }
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MockApiServer::drainAll() {
+    const QList<QTcpSocket*> sockets = connections.keys();
+    for (QTcpSocket* socket : sockets) {
+        drain(socket);
+    }
+}
+
+void MockApiServer::drain(QTcpSocket* socket) {
+    auto found = connections.find(socket);
+    if (found == connections.end()) {
+        return;
+    }
+    Connection& connection = found.value();
+    qint64 budget = bandwidth > 0 ? bandwidth * PaceMs / 1000 : std::numeric_limits<qint64>::max();
+
+    while (budget > 0 && socket->bytesAvailable() > 0) {
+        if (connection.contentLength < 0) {
+            // Headers are not metered, only the body is
+            while (socket->canReadLine()) {
+                const QByteArray line = socket->readLine();
+                if (connection.header.isEmpty()) {
+                    const QList<QByteArray> parts = line.trimmed().split(' ');
+                    connection.method = parts.value(0);
+                    connection.path = parts.value(1);
+                }
+                connection.header += line;
+                if (line == "\r\n") {
+                    connection.contentLength = 0;
+                    for (const QByteArray& headerLine : connection.header.split('\n')) {
+                        if (headerLine.toLower().startsWith("content-length:")) {
+                            connection.contentLength = headerLine.mid(15).trimmed().toLongLong();
+                        }
+                    }
+                    break;
+                }
+            }
+            if (connection.contentLength < 0) {
+                return;
+            }
+        }
+
+        const QByteArray chunk = socket->read(qMin(budget, connection.contentLength - connection.received));
+        connection.received += chunk.size();
+        budget -= chunk.size();
+        if (connection.method == "PATCH") {
+            connection.body += chunk;
+        }
+        if (connection.received >= connection.contentLength) {
+            respond(socket, connection);
+            connection = Connection();
+        }
+        else if (chunk.isEmpty()) {
+            return;
+        }
+    }
+}
+
+QByteArray MockApiServer::headerValue(const Connection& connection, const QByteArray& name) {
+    for (const QByteArray& line : connection.header.split('\n')) {
+        const int colon = line.indexOf(':');
+        if (colon > 0 && line.left(colon).trimmed().toLower() == name) {
+            return line.mid(colon + 1).trimmed();
+        }
+    }
+    return QByteArray();
+}
+
+void MockApiServer::respond(QTcpSocket* socket, Connection& connection) {
+    emit requestReceived(connection.method, connection.path, connection.received);
+
+    QByteArray response;
+    const bool api = connection.path.startsWith("/api/");
+    if (chance(errorRate)) {
+        const QByteArray payload = "{\"error\":\"injected\"}";
+        response = "HTTP/1.1 503 Service Unavailable\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: " + QByteArray::number(payload.size()) + "\r\n"
+            "Connection: keep-alive\r\n\r\n" + payload;
+    }
+    else if (api && !requiredToken.isEmpty()
+        && (headerValue(connection, "authorization") != "Bearer " + requiredToken || chance(authFailureRate))) {
+        // Forbidden is what the client turns into "please log in again"
+        response = "HTTP/1.1 403 Forbidden\r\n"
+            "Content-Type: application/json\r\n"
+            "Content-Length: 2\r\n"
+            "Connection: keep-alive\r\n\r\n{}";
+    }
+    else {
+        response = route(connection);
+    }
+
+    const int delay = latency + (jitter > 0 ? int(QRandomGenerator::global()->bounded(jitter + 1)) : 0);
+    if (delay == 0) {
+        socket->write(response);
+        return;
+    }
+    QPointer<QTcpSocket> target(socket);
+    QTimer::singleShot(delay, this, [target, response]() {
+        if (target) {
+            target->write(response);
+        }
+    });
+}
+
+QByteArray MockApiServer::route(const Connection& connection) {
+    const QByteArray path = connection.path.section('?', 0, 0);
+    const QByteArray query = connection.path.section('?', 1);
+    const QUrlQuery queryItems(QString::fromLatin1(query));
+    // "xxh3=<hex>" on uploads that want to be found again by content
+    const QByteArray contentHash = headerValue(connection, "x-screenme-content-hash").section('=', 1);
+    QByteArray status = "200 OK";
+    QByteArray contentType = "application/json";
+    QByteArray extraHeaders;
+    QByteArray payload;
+    // HEAD answers carry the object size without a body
+    qint64 contentLength = -1;
+
+    if (connection.method == "GET" && path == "/api/screenshot/lookup") {
+        const int id = publishedHashes.value(queryItems.queryItemValue("xxh3").toLatin1());
+        if (id > 0) {
+            QJsonObject body;
+            body["id"] = id;
+            body["url"] = QString("mock/%1").arg(id);
+            payload = QJsonDocument(body).toJson(QJsonDocument::Compact);
+        }
+        else {
+            status = "404 Not Found";
+            payload = "{\"found\":false}";
+        }
+    }
+    else if (connection.method == "POST" && path == "/api/screenshot/reserve") {
+        // Link-first publishing: hand out the id and URL, the content follows with a PUT
+        const int id = nextId++;
+        contentStage.insert(id, Reserved);
+        QJsonObject body;
+        body["id"] = id;
+        body["url"] = QString("mock/%1").arg(id);
+        payload = QJsonDocument(body).toJson(QJsonDocument::Compact);
+    }
+    else if (connection.method == "PUT" && path.startsWith("/api/screenshot/")) {
+        // A preview may be replaced by the full image, never the other way around
+        const int id = path.section('/', 3, 3).toInt();
+        const bool preview = headerValue(connection, "x-screenme-variant") == "preview";
+        if (!contentStage.contains(id)) {
+            status = "404 Not Found";
+        }
+        else if (preview && contentStage.value(id) == FullImage) {
+            status = "409 Conflict";
+        }
+        else {
+            contentStage.insert(id, preview ? Preview : FullImage);
+            if (!preview && !contentHash.isEmpty()) {
+                publishedHashes.insert(contentHash, id);
+            }
+        }
+        payload = "{}";
+    }
+    else if (connection.method == "PUT") {
+        // S3 object or part upload, the ETag is what the client echoes back on completion
+        extraHeaders = "ETag: \"mock-" + QByteArray::number(nextId++) + "\"\r\n";
+        if (queryItems.hasQueryItem("partNumber")) {
+            multipartBytes[queryItems.queryItemValue("uploadId").toLatin1()] += connection.received;
+        }
+        else {
+            objectSizes.insert(path, connection.received);
+        }
+    }
+    else if (connection.method == "HEAD") {
+        if (objectSizes.contains(path)) {
+            contentLength = objectSizes.value(path);
+        }
+        else {
+            status = "404 Not Found";
+        }
+    }
+    else if (connection.method == "POST" && queryItems.hasQueryItem("uploads")) {
+        contentType = "application/xml";
+        payload = "<InitiateMultipartUploadResult><UploadId>mock-upload-" + QByteArray::number(nextId++)
+            + "</UploadId></InitiateMultipartUploadResult>";
+    }
+    else if (connection.method == "POST" && queryItems.hasQueryItem("uploadId")) {
+        objectSizes.insert(path, multipartBytes.take(queryItems.queryItemValue("uploadId").toLatin1()));
+        contentType = "application/xml";
+        payload = "<CompleteMultipartUploadResult><Key>" + path + "</Key></CompleteMultipartUploadResult>";
+    }
+    else if (connection.method == "PATCH" && path == "/api/screenshots") {
+        // Privacy update of several screenshots at once, all or nothing. Unknown ids are a
+        // 422: a 404 here means the host has no bulk endpoint and sends clients per id
+        const QJsonArray ids = QJsonDocument::fromJson(connection.body).object().value("ids").toArray();
+        const bool known = std::all_of(ids.begin(), ids.end(), [this](const QJsonValue& value) {
+            const int id = value.toVariant().toInt();
+            return id > 0 && id < nextId;
+        });
+        if (!bulkPrivacy) {
+            status = "404 Not Found";
+        }
+        else if (ids.isEmpty()) {
+            status = "400 Bad Request";
+        }
+        else if (!known) {
+            status = "422 Unprocessable Entity";
+        }
+        payload = "{}";
+    }
+    else if (connection.method == "PATCH" && path.startsWith("/api/screenshot/")) {
+        // Privacy update of a single screenshot, only ids this server handed out exist
+        const int id = path.section('/', 3, 3).toInt();
+        if (id <= 0 || id >= nextId) {
+            status = "404 Not Found";
+        }
+        payload = "{}";
+    }
+    else if (connection.method == "DELETE") {
+        // Releasing a reservation or aborting an S3 multipart upload
+        contentStage.remove(path.section('/', 3, 3).toInt());
+        multipartBytes.remove(queryItems.queryItemValue("uploadId").toLatin1());
+        status = "204 No Content";
+    }
+    else {
+        // ScreenMe API and generic HTTP targets
+        QJsonObject body;
+        if (connection.method == "POST") {
+            const int id = nextId++;
+            body["id"] = id;
+            body["url"] = QString("mock/%1").arg(id);
+            if (!contentHash.isEmpty()) {
+                publishedHashes.insert(contentHash, id);
+            }
+        }
+        payload = QJsonDocument(body).toJson(QJsonDocument::Compact);
+    }
+
+    return "HTTP/1.1 " + status + "\r\n"
+        "Content-Type: " + contentType + "\r\n"
+        + extraHeaders
+        + "Content-Length: " + QByteArray::number(contentLength >= 0 ? contentLength : payload.size()) + "\r\n"
+        "Connection: keep-alive\r\n\r\n" + payload;
+}
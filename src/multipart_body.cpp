@@ -0,0 +1,58 @@
+#include "include/multipart_body.h"
+#include <QRandomGenerator>
+#include <cstring>
+
+MultipartBody::MultipartBody(const QByteArray& fieldName, const QString& fileName, const QByteArray& mimeType, QIODevice* file, QObject* parent)
+    : QIODevice(parent), file(file), position(0) {
+    file->setParent(this);
+    boundary = "----ScreenMe" + QByteArray::number(QRandomGenerator::global()->generate64(), 16);
+    head = "--" + boundary + "\r\n"
+        "Content-Disposition: form-data; name=\"" + fieldName + "\"; filename=\"" + fileName.toUtf8() + "\"\r\n"
+        "Content-Type: " + mimeType + "\r\n\r\n";
+    tail = "\r\n--" + boundary + "--\r\n";
+    open(QIODevice::ReadOnly);
+}
+
+QByteArray MultipartBody::contentType() const {
+    return "multipart/form-data; boundary=" + boundary;
+}
+
+qint64 MultipartBody::size() const {
+    return head.size() + file->size() + tail.size();
+}
+
+qint64 MultipartBody::bytesAvailable() const {
+    return size() - position + QIODevice::bytesAvailable();
+}
+
+bool MultipartBody::atEnd() const {
+    return position >= size() && QIODevice::bytesAvailable() == 0;
+}
+
+qint64 MultipartBody::readData(char* data, qint64 maxSize) {
+    qint64 done = 0;
+    const qint64 fileEnd = head.size() + file->size();
+    while (done < maxSize && position < size()) {
+        qint64 count = 0;
+        if (position < head.size()) {
+            count = qMin(maxSize - done, qint64(head.size()) - position);
+            std::memcpy(data + done, head.constData() + position, size_t(count));
+        }
+        else if (position < fileEnd) {
+            count = file->read(data + done, qMin(maxSize - done, fileEnd - position));
+            if (count < 0) {
+                return -1;
+            }
+            if (count == 0) {
+                break;
+            }
+        }
+        else {
+            count = qMin(maxSize - done, size() - position);
+            std::memcpy(data + done, tail.constData() + (position - fileEnd), size_t(count));
+        }
+        done += count;
+        position += count;
+    }
+    return done;
+}
@@ -39,7 +39,7 @@ OptionsWindow::OptionsWindow(ConfigManager* configManager, QWidget* parent)
     QLabel* extensionLabel = new QLabel("File Extension:", this);
     layout->addWidget(extensionLabel);
     extensionCombo = new QComboBox(this);
-    extensionCombo->addItems({ "png", "jpg" });
+    extensionCombo->addItems({ "auto", "png", "jpg" });
     layout->addWidget(extensionCombo);
 
     QLabel* qualityLabel = new QLabel("Image Quality:", this);
@@ -48,6 +48,49 @@ OptionsWindow::OptionsWindow(ConfigManager* configManager, QWidget* parent)
     qualitySpinbox->setRange(1, 100);
     layout->addWidget(qualitySpinbox);
 
+    QLabel* maxDimensionLabel = new QLabel("Maximum Export Size:", this);
+    layout->addWidget(maxDimensionLabel);
+    maxDimensionSpinbox = new QSpinBox(this);
+    maxDimensionSpinbox->setRange(0, 16384);
+    maxDimensionSpinbox->setSingleStep(64);
+    maxDimensionSpinbox->setSuffix(" px");
+    maxDimensionSpinbox->setSpecialValueText("Original");
+    layout->addWidget(maxDimensionSpinbox);
+
+    QLabel* scaleLabel = new QLabel("Export Scale:", this);
+    layout->addWidget(scaleLabel);
+    scaleSpinbox = new QSpinBox(this);
+    scaleSpinbox->setRange(10, 100);
+    scaleSpinbox->setSuffix(" %");
+    layout->addWidget(scaleSpinbox);
+
+    quantizeCheckbox = new QCheckBox("Reduce uploads to 256 colors", this);
+    layout->addWidget(quantizeCheckbox);
+
+    QLabel* uploadLimitLabel = new QLabel("Upload Bandwidth Limit:", this);
+    layout->addWidget(uploadLimitLabel);
+    uploadLimitSpinbox = new QSpinBox(this);
+    uploadLimitSpinbox->setRange(0, 1000000);
+    uploadLimitSpinbox->setSingleStep(128);
+    uploadLimitSpinbox->setSuffix(" KB/s");
+    uploadLimitSpinbox->setSpecialValueText("Unlimited");
+    layout->addWidget(uploadLimitSpinbox);
+
+    QLabel* uploadConcurrencyLabel = new QLabel("Simultaneous Uploads:", this);
+    layout->addWidget(uploadConcurrencyLabel);
+    uploadConcurrencySpinbox = new QSpinBox(this);
+    uploadConcurrencySpinbox->setRange(1, 8);
+    layout->addWidget(uploadConcurrencySpinbox);
+
+    // S3 and HTTP targets are configured in config.json (s3_*, http_upload_*)
+    QLabel* uploadBackendLabel = new QLabel("Publish To:", this);
+    layout->addWidget(uploadBackendLabel);
+    uploadBackendCombo = new QComboBox(this);
+    uploadBackendCombo->addItem("ScreenMe", "screenme");
+    uploadBackendCombo->addItem("S3-compatible storage", "s3");
+    uploadBackendCombo->addItem("HTTP endpoint", "http");
+    layout->addWidget(uploadBackendCombo);
+
     QLabel* folderLabel = new QLabel("Default Save Folder:", this);
     layout->addWidget(folderLabel);
     folderEdit = new QLineEdit(this);
@@ -80,16 +123,29 @@ void OptionsWindow::loadOptions() {
     qualitySpinbox->setValue(config["image_quality"].toInt());
     folderEdit->setText(config["default_save_folder"].toString());
     startWithSystemCheckbox->setChecked(config["start_with_system"].toBool());
+    maxDimensionSpinbox->setValue(config["export_max_dimension"].toInt(0));
+    scaleSpinbox->setValue(config["export_scale_percent"].toInt(100));
+    quantizeCheckbox->setChecked(config["quantize_uploads"].toBool(false));
+    uploadLimitSpinbox->setValue(config["upload_limit_kb_per_s"].toInt(0));
+    uploadConcurrencySpinbox->setValue(config["upload_concurrency"].toInt(2));
+    uploadBackendCombo->setCurrentIndex(qMax(0, uploadBackendCombo->findData(config["upload_backend"].toString("screenme"))));
 }
 
 void OptionsWindow::saveOptions() {
-    QJsonObject config;
+    // Start from the stored config so keys without a widget (backend targets) survive
+    QJsonObject config = configManager->loadConfig();
     config["screenshot_hotkey"] = hotkeyEdit->text();
     config["fullscreen_hotkey"] = fullscreenHotkeyEdit->text();
     config["file_extension"] = extensionCombo->currentText();
     config["image_quality"] = qualitySpinbox->value();
     config["default_save_folder"] = folderEdit->text();
     config["start_with_system"] = startWithSystemCheckbox->isChecked();
+    config["export_max_dimension"] = maxDimensionSpinbox->value();
+    config["export_scale_percent"] = scaleSpinbox->value();
+    config["quantize_uploads"] = quantizeCheckbox->isChecked();
+    config["upload_limit_kb_per_s"] = uploadLimitSpinbox->value();
+    config["upload_concurrency"] = uploadConcurrencySpinbox->value();
+    config["upload_backend"] = uploadBackendCombo->currentData().toString();
 
     configManager->saveConfig(config);
 
@@ -0,0 +1,391 @@
+#include "include/palette_quantizer.h"
+#include "include/job_system.h"
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    const int MinBandRows = 64;
+    const int HistogramBits = 5;
+    const int HistogramSize = 1 << (3 * HistogramBits);
+
+    int bandCount(int rows) {
+        return qBound(1, QThread::idealThreadCount(), qMax(1, rows / MinBandRows));
+    }
+
+    // Runs function(band, firstRow, endRow) for every band on the job system. The caller
+    // works through the bands too and a band goes to whoever claims it first, so this
+    // finishes even when it runs on a job worker and every other worker is busy.
+    template <typename Function>
+    void forEachBand(int rows, int bands, Function function) {
+        if (bands == 1) {
+            function(0, 0, rows);
+            return;
+        }
+        struct Progress {
+            std::atomic<int> next{ 0 };
+            std::atomic<int> finished{ 0 };
+            std::mutex mutex;
+            std::condition_variable allFinished;
+        };
+        auto progress = std::make_shared<Progress>();
+        // `function` is only touched for a claimed band, which the caller waits for
+        auto work = [progress, rows, bands, &function]() {
+            for (int band = progress->next++; band < bands; band = progress->next++) {
+                function(band, rows * band / bands, rows * (band + 1) / bands);
+                if (++progress->finished == bands) {
+                    std::lock_guard<std::mutex> lock(progress->mutex);
+                    progress->allFinished.notify_all();
+                }
+            }
+        };
+        for (int helper = 1; helper < bands; ++helper) {
+            JobSystem::instance()->submit(JobSystem::Lane::Interactive, [work](const JobToken&) { work(); });
+        }
+        work();
+        std::unique_lock<std::mutex> lock(progress->mutex);
+        progress->allFinished.wait(lock, [&progress, bands]() { return progress->finished == bands; });
+    }
+
+    // Open-addressing colour table that gives up as soon as it holds more than `limit` colours
+    class ColorTable {
+    public:
+        explicit ColorTable(int limit) : limit(limit), count(0) {
+            keys.fill(0);
+            values.fill(-1);
+        }
+
+        bool insert(QRgb color) {
+            int slot = find(color);
+            if (values[slot] >= 0) {
+                return true;
+            }
+            if (count == limit) {
+                return false;
+            }
+            keys[slot] = color;
+            values[slot] = count++;
+            return true;
+        }
+
+        int indexOf(QRgb color) const {
+            return values[find(color)];
+        }
+
+        QVector<QRgb> colors() const {
+            QVector<QRgb> result(count);
+            for (int slot = 0; slot < Slots; ++slot) {
+                if (values[slot] >= 0) {
+                    result[values[slot]] = keys[slot];
+                }
+            }
+            return result;
+        }
+
+    private:
+        static const int Slots = 1024;
+
+        int find(QRgb color) const {
+            int slot = int((color * 2654435761u) >> 22) & (Slots - 1);
+            while (values[slot] >= 0 && keys[slot] != color) {
+                slot = (slot + 1) & (Slots - 1);
+            }
+            return slot;
+        }
+
+        int limit;
+        int count;
+        std::array<QRgb, Slots> keys;
+        std::array<int, Slots> values;
+    };
+
+    inline int histogramIndex(int r, int g, int b) {
+        const int shift = 8 - HistogramBits;
+        return ((r >> shift) << (2 * HistogramBits)) | ((g >> shift) << HistogramBits) | (b >> shift);
+    }
+
+    struct Bin {
+        int index;
+        quint64 count;
+        quint64 sum[3];
+    };
+
+    struct Box {
+        int begin;
+        int end;
+        quint64 count;
+        int longestAxis;
+        int range;
+    };
+
+    int binChannel(const Bin& bin, int axis) {
+        return (bin.index >> ((2 - axis) * HistogramBits)) & ((1 << HistogramBits) - 1);
+    }
+
+    void measure(Box& box, const std::vector<Bin>& bins) {
+        int low[3] = { 255, 255, 255 };
+        int high[3] = { 0, 0, 0 };
+        box.count = 0;
+        for (int i = box.begin; i < box.end; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                low[axis] = qMin(low[axis], binChannel(bins[i], axis));
+                high[axis] = qMax(high[axis], binChannel(bins[i], axis));
+            }
+            box.count += bins[i].count;
+        }
+        box.longestAxis = 0;
+        for (int axis = 1; axis < 3; ++axis) {
+            if (high[axis] - low[axis] > high[box.longestAxis] - low[box.longestAxis]) {
+                box.longestAxis = axis;
+            }
+        }
+        box.range = high[box.longestAxis] - low[box.longestAxis];
+    }
+
+    QVector<QRgb> medianCut(std::vector<Bin>& bins, int maxColors) {
+        std::vector<Box> boxes;
+        boxes.push_back({ 0, int(bins.size()), 0, 0, 0 });
+        measure(boxes.back(), bins);
+
+        while (int(boxes.size()) < maxColors) {
+            // Split the box where a single colour would cover the most pixels over the widest range
+            int pick = -1;
+            quint64 best = 0;
+            for (int i = 0; i < int(boxes.size()); ++i) {
+                const quint64 score = boxes[i].count * quint64(boxes[i].range);
+                if (boxes[i].end - boxes[i].begin > 1 && score > best) {
+                    best = score;
+                    pick = i;
+                }
+            }
+            if (pick < 0) {
+                break;
+            }
+
+            Box& box = boxes[pick];
+            const int axis = box.longestAxis;
+            std::sort(bins.begin() + box.begin, bins.begin() + box.end, [axis](const Bin& a, const Bin& b) {
+                return binChannel(a, axis) < binChannel(b, axis);
+            });
+            quint64 running = 0;
+            int split = box.begin + 1;
+            for (int i = box.begin; i < box.end - 1; ++i) {
+                running += bins[i].count;
+                split = i + 1;
+                if (running * 2 >= box.count) {
+                    break;
+                }
+            }
+
+            Box upper = { split, box.end, 0, 0, 0 };
+            box.end = split;
+            measure(box, bins);
+            measure(upper, bins);
+            boxes.push_back(upper);
+        }
+
+        QVector<QRgb> palette;
+        palette.reserve(int(boxes.size()));
+        for (const Box& box : boxes) {
+            quint64 sum[3] = { 0, 0, 0 };
+            for (int i = box.begin; i < box.end; ++i) {
+                for (int c = 0; c < 3; ++c) {
+                    sum[c] += bins[i].sum[c];
+                }
+            }
+            const quint64 count = qMax<quint64>(1, box.count);
+            palette.append(qRgb(int(sum[0] / count), int(sum[1] / count), int(sum[2] / count)));
+        }
+        return palette;
+    }
+
+    int nearest(const QVector<QRgb>& palette, int r, int g, int b) {
+        int best = 0;
+        int bestDistance = INT_MAX;
+        for (int i = 0; i < palette.size(); ++i) {
+            const int dr = qRed(palette[i]) - r;
+            const int dg = qGreen(palette[i]) - g;
+            const int db = qBlue(palette[i]) - b;
+            const int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // 4x4 Bayer matrix centred on zero, scaled so offsets stay within half a histogram cell
+    const int Bayer[4][4] = {
+        { -15, 1, -11, 5 },
+        { 9, -7, 13, -3 },
+        { -9, 7, -13, 3 },
+        { 15, -1, 11, -5 }
+    };
+}
+
+QVector<QRgb> PaletteQuantizer::exactPalette(const QImage& image, int maxColors) {
+    const QImage source = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    const int bands = bandCount(source.height());
+    std::vector<ColorTable> tables(bands, ColorTable(maxColors));
+    std::vector<char> overflow(bands, 0);
+
+    forEachBand(source.height(), bands, [&](int band, int from, int to) {
+        ColorTable& table = tables[band];
+        for (int y = from; y < to && !overflow[band]; ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            QRgb previous = ~line[0];
+            for (int x = 0; x < source.width(); ++x) {
+                // UI content is mostly runs of one colour
+                if (line[x] != previous && !table.insert(line[x])) {
+                    overflow[band] = 1;
+                    break;
+                }
+                previous = line[x];
+            }
+        }
+    });
+
+    ColorTable merged(maxColors);
+    for (int band = 0; band < bands; ++band) {
+        if (overflow[band]) {
+            return QVector<QRgb>();
+        }
+        for (QRgb color : tables[band].colors()) {
+            if (!merged.insert(color)) {
+                return QVector<QRgb>();
+            }
+        }
+    }
+    return merged.colors();
+}
+
+QImage PaletteQuantizer::quantizeExact(const QImage& image, int maxColors) {
+    if (image.isNull()) {
+        return QImage();
+    }
+    maxColors = qBound(2, maxColors, 256);
+    const QImage source = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    const QVector<QRgb> exact = exactPalette(source, maxColors);
+    if (exact.isEmpty()) {
+        return QImage();
+    }
+
+    ColorTable table(maxColors);
+    for (QRgb color : exact) {
+        table.insert(color);
+    }
+    QImage result(source.size(), QImage::Format_Indexed8);
+    result.setDotsPerMeterX(source.dotsPerMeterX());
+    result.setDotsPerMeterY(source.dotsPerMeterY());
+    // Detached once up front, scanLine() from the workers would race on the detach
+    uchar* const rows = result.bits();
+    const qsizetype rowBytes = result.bytesPerLine();
+    forEachBand(source.height(), bandCount(source.height()), [&](int, int from, int to) {
+        for (int y = from; y < to; ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            uchar* indices = rows + y * rowBytes;
+            for (int x = 0; x < source.width(); ++x) {
+                indices[x] = uchar(x > 0 && line[x] == line[x - 1] ? indices[x - 1] : table.indexOf(line[x]));
+            }
+        }
+    });
+    result.setColorTable(exact);
+    return result;
+}
+
+QImage PaletteQuantizer::quantize(const QImage& image, int maxColors, bool dither) {
+    QImage exact = quantizeExact(image, maxColors);
+    if (!exact.isNull() || image.isNull()) {
+        return exact;
+    }
+    maxColors = qBound(2, maxColors, 256);
+    const QImage source = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    const int bands = bandCount(source.height());
+    QImage result(source.size(), QImage::Format_Indexed8);
+    result.setDotsPerMeterX(source.dotsPerMeterX());
+    result.setDotsPerMeterY(source.dotsPerMeterY());
+
+    if (source.hasAlphaChannel()) {
+        // Translucent captures with a large colour count would lose their alpha in a median cut
+        for (int y = 0; y < source.height(); ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            for (int x = 0; x < source.width(); ++x) {
+                if (qAlpha(line[x]) != 255) {
+                    return QImage();
+                }
+            }
+        }
+    }
+
+    // Histogram of 5-bit-per-channel cells, accumulated per band and then summed
+    std::vector<std::vector<Bin>> partial(bands);
+    forEachBand(source.height(), bands, [&](int band, int from, int to) {
+        std::vector<Bin>& histogram = partial[band];
+        histogram.assign(HistogramSize, Bin());
+        for (int y = from; y < to; ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            for (int x = 0; x < source.width(); ++x) {
+                const int r = qRed(line[x]), g = qGreen(line[x]), b = qBlue(line[x]);
+                Bin& bin = histogram[histogramIndex(r, g, b)];
+                bin.count++;
+                bin.sum[0] += r;
+                bin.sum[1] += g;
+                bin.sum[2] += b;
+            }
+        }
+    });
+
+    std::vector<Bin> bins;
+    for (int index = 0; index < HistogramSize; ++index) {
+        Bin bin = { index, 0, { 0, 0, 0 } };
+        for (const std::vector<Bin>& histogram : partial) {
+            bin.count += histogram[index].count;
+            for (int c = 0; c < 3; ++c) {
+                bin.sum[c] += histogram[index].sum[c];
+            }
+        }
+        if (bin.count > 0) {
+            bins.push_back(bin);
+        }
+    }
+    partial.clear();
+
+    const QVector<QRgb> palette = medianCut(bins, maxColors);
+
+    // Nearest palette entry for every cell, dithering can land on cells the image never used
+    std::vector<uchar> lookup(HistogramSize);
+    const int cellShift = 8 - HistogramBits;
+    forEachBand(HistogramSize, bandCount(HistogramSize), [&](int, int from, int to) {
+        for (int index = from; index < to; ++index) {
+            const int r = ((index >> (2 * HistogramBits)) << cellShift) | (1 << (cellShift - 1));
+            const int g = (((index >> HistogramBits) & ((1 << HistogramBits) - 1)) << cellShift) | (1 << (cellShift - 1));
+            const int b = ((index & ((1 << HistogramBits) - 1)) << cellShift) | (1 << (cellShift - 1));
+            lookup[index] = uchar(nearest(palette, r, g, b));
+        }
+    });
+
+    // Ordered dithering has no error carried between rows, so bands stay independent
+    uchar* const rows = result.bits();
+    const qsizetype rowBytes = result.bytesPerLine();
+    forEachBand(source.height(), bands, [&](int, int from, int to) {
+        for (int y = from; y < to; ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            uchar* indices = rows + y * rowBytes;
+            for (int x = 0; x < source.width(); ++x) {
+                const int offset = dither ? Bayer[y & 3][x & 3] * (1 << cellShift) / 32 : 0;
+                indices[x] = lookup[histogramIndex(qBound(0, qRed(line[x]) + offset, 255),
+                    qBound(0, qGreen(line[x]) + offset, 255), qBound(0, qBlue(line[x]) + offset, 255))];
+            }
+        }
+    });
+    result.setColorTable(palette);
+    return result;
+}
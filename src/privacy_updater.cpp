@@ -0,0 +1,142 @@
+#include "include/privacy_updater.h"
+#include "include/upload_scheduler.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+
+namespace {
+    // Long enough to absorb a burst of clicks, short enough to feel immediate
+    const int DebounceMs = 400;
+}
+
+PrivacyUpdater::PrivacyUpdater(QObject* parent)
+    : QObject(parent) {
+    debounce.setSingleShot(true);
+    debounce.setInterval(DebounceMs);
+    connect(&debounce, &QTimer::timeout, this, &PrivacyUpdater::flush);
+}
+
+PrivacyUpdater* PrivacyUpdater::instance() {
+    static PrivacyUpdater* updater = new PrivacyUpdater(QCoreApplication::instance());
+    return updater;
+}
+
+void PrivacyUpdater::setPrivacy(const QString& host, const QByteArray& token, const QString& id, bool isPrivate) {
+    setPrivacy(host, token, QStringList{ id }, isPrivate);
+}
+
+void PrivacyUpdater::setPrivacy(const QString& host, const QByteArray& token, const QStringList& ids, bool isPrivate) {
+    Change change;
+    change.host = host;
+    change.token = token;
+    change.isPrivate = isPrivate;
+    for (const QString& id : ids) {
+        pending.insert(id, change);
+    }
+    debounce.start();
+}
+
+void PrivacyUpdater::flush() {
+    debounce.stop();
+    // Superseding a bulk request puts its other ids back in `pending`, so loop until settled
+    while (!pending.isEmpty()) {
+        QHash<QString, Change> sending;
+        sending.swap(pending);
+
+        QMap<QString, QStringList> groups;
+        QHash<QString, Change> groupChanges;
+        for (auto it = sending.constBegin(); it != sending.constEnd(); ++it) {
+            supersede(it.key(), sending);
+            const QString groupKey = it.value().host + '\n' + it.value().token + '\n' + (it.value().isPrivate ? "1" : "0");
+            groups[groupKey].append(it.key());
+            groupChanges.insert(groupKey, it.value());
+        }
+        for (auto it = groups.constBegin(); it != groups.constEnd(); ++it) {
+            send(groupChanges.value(it.key()), it.value());
+        }
+    }
+}
+
+void PrivacyUpdater::supersede(const QString& id, const QHash<QString, Change>& sending) {
+    QNetworkReply* reply = inFlight.take(id);
+    if (!reply || !requests.contains(reply)) {
+        return;
+    }
+    const Request request = requests.value(reply);
+    // The other ids of a bulk request still want its state, resend them with the next round
+    for (const QString& other : request.ids) {
+        if (inFlight.value(other) == reply && !sending.contains(other) && !pending.contains(other)) {
+            inFlight.remove(other);
+            pending.insert(other, request.change);
+        }
+    }
+    reply->abort();
+}
+
+void PrivacyUpdater::send(const Change& change, const QStringList& ids) {
+    const bool bulk = ids.size() > 1;
+    if (bulk && noBulkHosts.contains(change.host)) {
+        for (const QString& id : ids) {
+            send(change, QStringList{ id });
+        }
+        return;
+    }
+
+    QNetworkRequest request(QUrl(bulk ? change.host + "/api/screenshots" : change.host + "/api/screenshot/" + ids.first()));
+    request.setRawHeader("Authorization", "Bearer " + change.token);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    QJsonObject json;
+    json["privacy"] = change.isPrivate ? "private" : "public";
+    if (bulk) {
+        json["ids"] = QJsonArray::fromStringList(ids);
+    }
+
+    QNetworkReply* reply = UploadScheduler::instance()->network()->sendCustomRequest(request, "PATCH",
+        QJsonDocument(json).toJson(QJsonDocument::Compact));
+    requests.insert(reply, { change, ids });
+    for (const QString& id : ids) {
+        inFlight.insert(id, reply);
+    }
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { onFinished(reply); });
+}
+
+void PrivacyUpdater::onFinished(QNetworkReply* reply) {
+    reply->deleteLater();
+    const Request request = requests.take(reply);
+    QStringList ids;
+    for (const QString& id : request.ids) {
+        if (inFlight.value(id) == reply) {
+            inFlight.remove(id);
+            ids.append(id);
+        }
+    }
+    if (reply->error() == QNetworkReply::OperationCanceledError || ids.isEmpty()) {
+        return;
+    }
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (request.ids.size() > 1 && (status == 404 || status == 405)) {
+        // No bulk endpoint on this server, fall back to one request per id
+        noBulkHosts.insert(request.change.host);
+        for (const QString& id : ids) {
+            if (!pending.contains(id)) {
+                send(request.change, QStringList{ id });
+            }
+        }
+        return;
+    }
+
+    for (const QString& id : ids) {
+        if (reply->error() == QNetworkReply::NoError) {
+            emit updated(id, request.change.isPrivate);
+        }
+        else {
+            qWarning() << "Privacy update failed for" << id << ":" << reply->errorString();
+            emit failed(id, reply->errorString());
+        }
+    }
+}
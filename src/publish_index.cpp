@@ -0,0 +1,99 @@
+#include "include/publish_index.h"
+#include "include/utils.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QDebug>
+
+namespace {
+    // Compact once more than half of the file is superseded lines
+    const int CompactMinLines = 256;
+
+    QString keyFor(const QString& contentHash, const QString& target) {
+        return contentHash + '\t' + target;
+    }
+}
+
+PublishIndex::PublishIndex()
+    : filePath(getConfigFilePath("publish_index.tsv")), lineCount(0) {
+    load();
+}
+
+PublishIndex* PublishIndex::instance() {
+    static PublishIndex* index = new PublishIndex();
+    return index;
+}
+
+bool PublishIndex::find(const QString& contentHash, const QString& target, Entry* entry) const {
+    auto found = entries.constFind(keyFor(contentHash, target));
+    if (found == entries.constEnd()) {
+        return false;
+    }
+    *entry = found.value();
+    return true;
+}
+
+void PublishIndex::insert(const QString& contentHash, const QString& target, const Entry& entry) {
+    entries.insert(keyFor(contentHash, target), entry);
+    append(contentHash, target, entry);
+}
+
+void PublishIndex::remove(const QString& contentHash, const QString& target) {
+    if (entries.remove(keyFor(contentHash, target)) == 0) {
+        return;
+    }
+    append(contentHash, target, Entry());
+}
+
+void PublishIndex::append(const QString& contentHash, const QString& target, const Entry& entry) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::Append | QIODevice::Text)) {
+        qWarning() << "Failed to write the publish index" << filePath;
+        return;
+    }
+    QTextStream out(&file);
+    out << contentHash << '\t' << target << '\t' << entry.id << '\t' << entry.link << '\n';
+    ++lineCount;
+    file.close();
+
+    if (lineCount > CompactMinLines && lineCount > 2 * entries.size()) {
+        compact();
+    }
+}
+
+void PublishIndex::load() {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QStringList fields = in.readLine().split('\t');
+        ++lineCount;
+        if (fields.size() != 4) {
+            continue;
+        }
+        // Later lines win, a republish to the same target replaces the older link
+        if (fields[2].isEmpty()) {
+            entries.remove(keyFor(fields[0], fields[1]));
+        }
+        else {
+            entries.insert(keyFor(fields[0], fields[1]), { fields[2], fields[3] });
+        }
+    }
+}
+
+void PublishIndex::compact() {
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return;
+    }
+    QTextStream out(&file);
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        out << it.key() << '\t' << it.value().id << '\t' << it.value().link << '\n';
+    }
+    out.flush();
+    if (file.commit()) {
+        lineCount = entries.size();
+    }
+}
@@ -0,0 +1,444 @@
+#include "include/s3_backend.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <algorithm>
+#include <memory>
+
+namespace {
+    const qint64 MiB = 1024 * 1024;
+    const int DefaultPartSizeMb = 8;
+    // S3 rejects parts below 5 MiB, except for the last one
+    const int MinPartSizeMb = 5;
+    // Parts are started in a window so a large file does not queue hundreds of requests
+    const int PartsInFlight = 3;
+    const QByteArray UnsignedPayload = "UNSIGNED-PAYLOAD";
+    // A publish waits on the existence check, a stalled one falls back to uploading
+    const int LookupTimeoutMs = 5000;
+
+    QByteArray sha256Hex(const QByteArray& data) {
+        return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+    }
+
+    QByteArray hmacSha256(const QByteArray& key, const QByteArray& message) {
+        return QMessageAuthenticationCode::hash(message, key, QCryptographicHash::Sha256);
+    }
+
+    QBuffer* bufferBody(const QByteArray& data) {
+        QBuffer* buffer = new QBuffer();
+        buffer->setData(data);
+        buffer->open(QIODevice::ReadOnly);
+        return buffer;
+    }
+
+    QString xmlElement(const QByteArray& xml, const QString& name) {
+        QXmlStreamReader reader(xml);
+        while (!reader.atEnd()) {
+            if (reader.readNext() == QXmlStreamReader::StartElement && reader.name() == name) {
+                return reader.readElementText();
+            }
+        }
+        return QString();
+    }
+}
+
+// Byte range of a file as a request body, with its own handle so parts can be read in parallel
+class FileSlice : public QIODevice {
+public:
+    FileSlice(const QString& filePath, qint64 offset, qint64 length)
+        : file(filePath), length(length), position(0) {
+        if (file.open(QIODevice::ReadOnly) && file.seek(offset)) {
+            open(QIODevice::ReadOnly);
+        }
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 size() const override { return length; }
+    qint64 bytesAvailable() const override { return length - position + QIODevice::bytesAvailable(); }
+    bool atEnd() const override { return position >= length && QIODevice::bytesAvailable() == 0; }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        const qint64 count = file.read(data, qMin(maxSize, length - position));
+        if (count > 0) {
+            position += count;
+        }
+        return count;
+    }
+
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    QFile file;
+    qint64 length;
+    qint64 position;
+};
+
+struct S3Backend::Multipart {
+    UploadSource source;
+    QString key;
+    QByteArray uploadId;
+    UploadPriority priority = UploadPriority::Interactive;
+    qint64 total = 0;
+    int nextPart = 0;
+    int running = 0;
+    QVector<QByteArray> etags;
+    QVector<qint64> sent;
+    bool failed = false;
+    UploadResult error;
+};
+
+S3Backend::S3Backend(const QJsonObject& config, QObject* parent)
+    : UploadBackend(parent) {
+    endpoint = QUrl(config["s3_endpoint"].toString());
+    bucket = config["s3_bucket"].toString();
+    region = config["s3_region"].toString("us-east-1").toUtf8();
+    accessKey = config["s3_access_key"].toString().toUtf8();
+    secretKey = config["s3_secret_key"].toString().toUtf8();
+    prefix = config["s3_prefix"].toString();
+    partSize = qMax(MinPartSizeMb, config["s3_part_size_mb"].toInt(DefaultPartSizeMb)) * MiB;
+
+    QString base = endpoint.toString();
+    while (base.endsWith('/')) {
+        base.chop(1);
+    }
+    // Links default to the object URL itself, a CDN or public bucket domain can replace it
+    publicUrl = config["s3_public_url"].toString(base + "/" + bucket);
+    while (publicUrl.endsWith('/')) {
+        publicUrl.chop(1);
+    }
+}
+
+UploadTask* S3Backend::upload(const UploadSource& source, UploadPriority priority) {
+    UploadTask* task = new UploadTask(this);
+    if (!endpoint.isValid() || endpoint.isRelative() || bucket.isEmpty()) {
+        task->fail("No S3 endpoint or bucket configured (s3_endpoint, s3_bucket).");
+        return task;
+    }
+    QFileInfo info(source.filePath);
+    if (!info.isReadable()) {
+        task->fail("Failed to open the image file for upload.");
+        return task;
+    }
+
+    const QString key = objectKey(source);
+    // The object URL is fixed by its key, so the link can be handed out before any byte is sent
+    QMetaObject::invokeMethod(task, [this, task, key]() {
+        emit task->linkReady(link(key), key);
+    }, Qt::QueuedConnection);
+    if (source.previewPath.isEmpty()) {
+        uploadObject(task, source, key, priority);
+        return task;
+    }
+
+    // The preview goes to the same key first, the full image then overwrites it
+    FileSlice* body = new FileSlice(source.previewPath, 0, QFileInfo(source.previewPath).size());
+    ScheduledUpload* step = send("PUT", key, QueryItems(), body, UnsignedPayload, priority, source.previewMimeType);
+    task->track(step);
+    connect(step, &ScheduledUpload::finished, task, [this, task, source, key, priority](QNetworkReply* reply) {
+        if (!reply || reply->error() == QNetworkReply::OperationCanceledError) {
+            task->finish(failure(reply));
+            return;
+        }
+        const bool ok = reply->error() == QNetworkReply::NoError;
+        if (ok) {
+            emit task->previewPublished();
+        }
+        uploadObject(task, source, key, ok ? UploadPriority::Background : priority);
+    });
+    return task;
+}
+
+void S3Backend::uploadObject(UploadTask* task, const UploadSource& source, const QString& key, UploadPriority priority) {
+    const qint64 size = QFileInfo(source.filePath).size();
+    // Multipart only pays off once there are at least two full parts
+    if (size > 2 * partSize) {
+        startMultipart(task, source, key, size, priority);
+    }
+    else {
+        putObject(task, source, key, priority);
+    }
+}
+
+QString S3Backend::objectKey(const UploadSource& source) const {
+    const QString suffix = QFileInfo(source.fileName).suffix();
+    const QString name = !source.contentHash.isEmpty() ? source.contentHash
+        : QDateTime::currentDateTimeUtc().toString("yyyyMMdd-HHmmss") + "-" + QString::number(QRandomGenerator::global()->generate(), 16);
+    return prefix + name + (suffix.isEmpty() ? QString() : "." + suffix);
+}
+
+void S3Backend::lookup(UploadTask* task, const UploadSource& source, const std::function<void(const UploadResult&)>& done) {
+    if (source.contentHash.isEmpty() || !endpoint.isValid() || bucket.isEmpty()) {
+        done(UploadResult());
+        return;
+    }
+    const QString key = objectKey(source);
+    const qint64 size = QFileInfo(source.filePath).size();
+    const QNetworkRequest request = signedRequest("HEAD", key, QueryItems(), sha256Hex(QByteArray()));
+    ScheduledUpload* step = UploadScheduler::instance()->enqueue(request, nullptr, UploadPriority::Interactive, "HEAD");
+    task->track(step);
+    // Told apart from a cancel by the user, a timed out check just means uploading
+    auto timedOut = std::make_shared<bool>(false);
+    QTimer::singleShot(LookupTimeoutMs, step, [step, timedOut]() {
+        *timedOut = true;
+        step->cancel();
+    });
+    connect(step, &ScheduledUpload::finished, task, [this, key, size, done, timedOut](QNetworkReply* reply) {
+        UploadResult result;
+        if (*timedOut) {
+            qWarning() << "S3 existence check timed out, uploading";
+        }
+        else if (!reply || reply->error() == QNetworkReply::OperationCanceledError) {
+            result.canceled = true;
+        }
+        else {
+            result.httpStatus = httpStatus(reply);
+            // A preview left behind by an interrupted upload has the key but not the size
+            if (reply->error() == QNetworkReply::NoError && reply->header(QNetworkRequest::ContentLengthHeader).toLongLong() == size) {
+                result.success = true;
+                result.id = key;
+                result.link = link(key);
+            }
+        }
+        done(result);
+    });
+}
+
+QString S3Backend::link(const QString& key) const {
+    return publicUrl + "/" + key;
+}
+
+QNetworkRequest S3Backend::signedRequest(const QByteArray& verb, const QString& key, const QueryItems& query, const QByteArray& payloadHash) const {
+    // Path-style addressing, which every S3-compatible server understands
+    QUrl url = endpoint;
+    QString basePath = url.path();
+    while (basePath.endsWith('/')) {
+        basePath.chop(1);
+    }
+    url.setPath(basePath + "/" + bucket + "/" + key);
+
+    // The query is encoded once here and used verbatim in both the URL and the signature
+    QueryItems sorted = query;
+    std::sort(sorted.begin(), sorted.end());
+    QList<QByteArray> pairs;
+    for (const auto& item : sorted) {
+        pairs.append(QUrl::toPercentEncoding(QString::fromUtf8(item.first)) + "=" + QUrl::toPercentEncoding(QString::fromUtf8(item.second)));
+    }
+    const QByteArray canonicalQuery = pairs.join('&');
+    if (!canonicalQuery.isEmpty()) {
+        url.setQuery(QString::fromLatin1(canonicalQuery));
+    }
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    const QByteArray amzDate = now.toString("yyyyMMdd'T'HHmmss'Z'").toLatin1();
+    const QByteArray date = amzDate.left(8);
+
+    // Must match the Host header QNetworkAccessManager sends
+    QByteArray host = url.host().toUtf8();
+    const int defaultPort = url.scheme() == "https" ? 443 : 80;
+    if (url.port() != -1 && url.port() != defaultPort) {
+        host += ":" + QByteArray::number(url.port());
+    }
+
+    const QByteArray signedHeaders = "host;x-amz-content-sha256;x-amz-date";
+    const QByteArray canonicalRequest = verb + "\n"
+        + url.path(QUrl::FullyEncoded).toLatin1() + "\n"
+        + canonicalQuery + "\n"
+        + "host:" + host + "\n"
+        + "x-amz-content-sha256:" + payloadHash + "\n"
+        + "x-amz-date:" + amzDate + "\n"
+        + "\n"
+        + signedHeaders + "\n"
+        + payloadHash;
+
+    const QByteArray scope = date + "/" + region + "/s3/aws4_request";
+    const QByteArray stringToSign = "AWS4-HMAC-SHA256\n" + amzDate + "\n" + scope + "\n" + sha256Hex(canonicalRequest);
+
+    QByteArray signingKey = hmacSha256("AWS4" + secretKey, date);
+    signingKey = hmacSha256(signingKey, region);
+    signingKey = hmacSha256(signingKey, "s3");
+    signingKey = hmacSha256(signingKey, "aws4_request");
+    const QByteArray signature = hmacSha256(signingKey, stringToSign).toHex();
+
+    QNetworkRequest request(url);
+    request.setRawHeader("x-amz-date", amzDate);
+    request.setRawHeader("x-amz-content-sha256", payloadHash);
+    request.setRawHeader("Authorization", "AWS4-HMAC-SHA256 Credential=" + accessKey + "/" + scope
+        + ", SignedHeaders=" + signedHeaders + ", Signature=" + signature);
+    return request;
+}
+
+ScheduledUpload* S3Backend::send(const QByteArray& verb, const QString& key, const QueryItems& query, QIODevice* body,
+    const QByteArray& payloadHash, UploadPriority priority, const QByteArray& contentType) {
+    QNetworkRequest request = signedRequest(verb, key, query, payloadHash);
+    if (!contentType.isEmpty()) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    }
+    return UploadScheduler::instance()->enqueue(request, body, priority, verb);
+}
+
+void S3Backend::putObject(UploadTask* task, const UploadSource& source, const QString& key, UploadPriority priority) {
+    FileSlice* body = new FileSlice(source.filePath, 0, QFileInfo(source.filePath).size());
+    // The body is streamed, so it cannot be hashed up front
+    ScheduledUpload* step = send("PUT", key, QueryItems(), body, UnsignedPayload, priority, source.mimeType);
+    task->track(step);
+    connect(step, &ScheduledUpload::uploadProgress, task, &UploadTask::progress);
+    connect(step, &ScheduledUpload::finished, task, [this, task, key](QNetworkReply* reply) {
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            task->finish(failure(reply));
+            return;
+        }
+        UploadResult result;
+        result.success = true;
+        result.httpStatus = httpStatus(reply);
+        result.id = key;
+        result.link = link(key);
+        task->finish(result);
+    });
+}
+
+void S3Backend::startMultipart(UploadTask* task, const UploadSource& source, const QString& key, qint64 size, UploadPriority priority) {
+    QSharedPointer<Multipart> state(new Multipart);
+    state->source = source;
+    state->key = key;
+    state->priority = priority;
+    state->total = size;
+    const int partCount = int((size + partSize - 1) / partSize);
+    state->etags.resize(partCount);
+    state->sent.fill(0, partCount);
+
+    ScheduledUpload* step = send("POST", key, { { "uploads", "" } }, bufferBody(QByteArray()),
+        sha256Hex(QByteArray()), priority, source.mimeType);
+    task->track(step);
+    connect(step, &ScheduledUpload::finished, task, [this, task, state](QNetworkReply* reply) {
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            task->finish(failure(reply));
+            return;
+        }
+        state->uploadId = xmlElement(reply->readAll(), "UploadId").toUtf8();
+        if (state->uploadId.isEmpty()) {
+            UploadResult result;
+            result.httpStatus = httpStatus(reply);
+            result.error = "The S3 server did not return an upload id.";
+            task->finish(result);
+            return;
+        }
+        for (int i = 0; i < PartsInFlight; ++i) {
+            sendNextPart(task, state);
+        }
+    });
+}
+
+void S3Backend::sendNextPart(UploadTask* task, QSharedPointer<Multipart> state) {
+    if (state->failed || task->isCanceled() || state->nextPart >= state->etags.size()) {
+        if (state->running > 0) {
+            return;
+        }
+        // Nothing left in flight: either finish the upload or clean it up on the server
+        if (state->failed || task->isCanceled()) {
+            abortMultipart(state->key, state->uploadId);
+            UploadResult result = state->error;
+            result.canceled = !state->failed;
+            task->finish(result);
+        }
+        else {
+            completeMultipart(task, state);
+        }
+        return;
+    }
+
+    const int part = state->nextPart++;
+    const qint64 offset = part * partSize;
+    FileSlice* body = new FileSlice(state->source.filePath, offset, qMin(partSize, state->total - offset));
+    ScheduledUpload* step = send("PUT", state->key,
+        { { "partNumber", QByteArray::number(part + 1) }, { "uploadId", state->uploadId } },
+        body, UnsignedPayload, state->priority);
+    ++state->running;
+    task->track(step);
+
+    connect(step, &ScheduledUpload::uploadProgress, task, [task, state, part](qint64 bytesSent, qint64) {
+        state->sent[part] = bytesSent;
+        qint64 sent = 0;
+        for (qint64 bytes : state->sent) {
+            sent += bytes;
+        }
+        emit task->progress(sent, state->total);
+    });
+    connect(step, &ScheduledUpload::finished, task, [this, task, state, part](QNetworkReply* reply) {
+        --state->running;
+        if (reply && reply->error() == QNetworkReply::NoError) {
+            state->etags[part] = reply->rawHeader("ETag");
+        }
+        else if (!state->failed && !task->isCanceled()) {
+            state->failed = true;
+            state->error = failure(reply);
+            // Stop the other parts, the whole upload is aborted once they are gone
+            task->cancel();
+        }
+        sendNextPart(task, state);
+    });
+}
+
+void S3Backend::completeMultipart(UploadTask* task, QSharedPointer<Multipart> state) {
+    QByteArray xml;
+    QXmlStreamWriter writer(&xml);
+    writer.writeStartElement("CompleteMultipartUpload");
+    for (int i = 0; i < state->etags.size(); ++i) {
+        writer.writeStartElement("Part");
+        writer.writeTextElement("PartNumber", QString::number(i + 1));
+        writer.writeTextElement("ETag", QString::fromLatin1(state->etags.at(i)));
+        writer.writeEndElement();
+    }
+    writer.writeEndElement();
+
+    ScheduledUpload* step = send("POST", state->key, { { "uploadId", state->uploadId } }, bufferBody(xml),
+        sha256Hex(xml), state->priority, "application/xml");
+    task->track(step);
+    connect(step, &ScheduledUpload::finished, task, [this, task, state](QNetworkReply* reply) {
+        UploadResult result;
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            result = failure(reply);
+        }
+        else {
+            // S3 can report a failed completion inside a 200 response
+            const QByteArray response = reply->readAll();
+            result.httpStatus = httpStatus(reply);
+            result.error = xmlElement(response, "Message");
+            if (result.error.isEmpty() && response.contains("<Error>")) {
+                result.error = "The S3 server failed to assemble the upload.";
+            }
+            result.success = result.error.isEmpty();
+        }
+        if (result.success) {
+            result.id = state->key;
+            result.link = link(state->key);
+        }
+        else {
+            abortMultipart(state->key, state->uploadId);
+        }
+        task->finish(result);
+    });
+}
+
+void S3Backend::abortMultipart(const QString& key, const QByteArray& uploadId) {
+    if (uploadId.isEmpty()) {
+        return;
+    }
+    // Not tracked by the task, it has to run even when the task was cancelled
+    ScheduledUpload* step = send("DELETE", key, { { "uploadId", uploadId } }, bufferBody(QByteArray()),
+        sha256Hex(QByteArray()), UploadPriority::Background);
+    connect(step, &ScheduledUpload::finished, this, [key](QNetworkReply* reply) {
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            qWarning() << "Failed to abort the multipart upload of" << key;
+        }
+    });
+}
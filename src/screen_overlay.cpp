@@ -0,0 +1,71 @@
+#include "include/screen_overlay.h"
+#include "include/screenshotdisplay.h"
+#include <QCloseEvent>
+#include <QIcon>
+#include <QInputMethodEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScreen>
+
+ScreenOverlay::ScreenOverlay(ScreenshotDisplay* display, QScreen* screen, const QPoint& desktopOrigin)
+    : QWidget(display), display(display), desktopArea(screen->geometry().translated(-desktopOrigin)) {
+    setWindowFlags(Qt::Window | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint);
+    setWindowTitle("ScreenMe");
+    setWindowIcon(QIcon("resources/icon.png"));
+    setAttribute(Qt::WA_QuitOnClose, false);
+    // The display answers whether input methods apply, only while a text is edited
+    setAttribute(Qt::WA_InputMethodEnabled);
+    setScreen(screen);
+    setGeometry(screen->geometry());
+}
+
+void ScreenOverlay::closeEvent(QCloseEvent* event) {
+    // Closing one screen's window (Alt+F4) ends the whole capture
+    event->ignore();
+    display->close();
+}
+
+void ScreenOverlay::forwardMouse(QMouseEvent* event, void (ScreenshotDisplay::*handler)(QMouseEvent*)) {
+    QMouseEvent translated(event->type(), event->position() + desktopArea.topLeft(), event->globalPosition(),
+        event->button(), event->buttons(), event->modifiers(), event->pointingDevice());
+    (display->*handler)(&translated);
+}
+
+void ScreenOverlay::mousePressEvent(QMouseEvent* event) {
+    forwardMouse(event, &ScreenshotDisplay::mousePressEvent);
+}
+
+void ScreenOverlay::mouseMoveEvent(QMouseEvent* event) {
+    forwardMouse(event, &ScreenshotDisplay::mouseMoveEvent);
+}
+
+void ScreenOverlay::mouseReleaseEvent(QMouseEvent* event) {
+    forwardMouse(event, &ScreenshotDisplay::mouseReleaseEvent);
+}
+
+void ScreenOverlay::keyPressEvent(QKeyEvent* event) {
+    display->keyPressEvent(event);
+}
+
+void ScreenOverlay::wheelEvent(QWheelEvent* event) {
+    display->wheelEvent(event);
+}
+
+void ScreenOverlay::inputMethodEvent(QInputMethodEvent* event) {
+    display->inputMethodEvent(event);
+}
+
+QVariant ScreenOverlay::inputMethodQuery(Qt::InputMethodQuery query) const {
+    const QVariant value = display->inputMethodQuery(query);
+    if (query == Qt::ImCursorRectangle && value.isValid()) {
+        return value.toRect().translated(-desktopArea.topLeft());
+    }
+    return value;
+}
+
+void ScreenOverlay::paintEvent(QPaintEvent* event) {
+    QPainter painter(this);
+    // The display paints in desktop coordinates, only over the area Qt asked for
+    painter.translate(-desktopArea.topLeft());
+    display->paintArea(painter, event->rect().translated(desktopArea.topLeft()), this);
+}
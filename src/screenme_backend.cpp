@@ -0,0 +1,221 @@
+#include "include/screenme_backend.h"
+#include "include/multipart_body.h"
+#include "include/utils.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSet>
+
+namespace {
+    // Hosts that answered the reservation endpoint with 404/405, for this session
+    QSet<QString> hostsWithoutReservation;
+    // Hosts without the lookup endpoint, the publish index answers alone for them
+    QSet<QString> hostsWithoutLookup;
+}
+
+ScreenMeBackend::ScreenMeBackend(const QJsonObject& config, QObject* parent)
+    : UploadBackend(parent) {
+    // Overridable so the upload path can run against a local server
+    baseUrl = config["screenme_host"].toString(screenMeHost());
+    while (baseUrl.endsWith('/')) {
+        baseUrl.chop(1);
+    }
+    linkFirst = config["screenme_link_first"].toBool(true);
+    QJsonObject loginInfo = QJsonDocument::fromJson(loadLoginInfo().toUtf8()).object();
+    // screenme_token stands in for a login when testing against a mock server
+    token = config["screenme_token"].toString(loginInfo["token"].toString()).toUtf8();
+}
+
+QString ScreenMeBackend::account() const {
+    if (token.isEmpty()) {
+        return QString();
+    }
+    return QString::fromLatin1(QCryptographicHash::hash(token, QCryptographicHash::Sha256).toHex().left(16));
+}
+
+UploadTask* ScreenMeBackend::upload(const UploadSource& source, UploadPriority priority) {
+    UploadTask* task = new UploadTask(this);
+    if (!QFileInfo(source.filePath).isReadable()) {
+        task->fail("Failed to open the image file for upload.");
+        return task;
+    }
+    if (linkFirst && !hostsWithoutReservation.contains(baseUrl)) {
+        reserve(task, source, priority);
+    }
+    else {
+        postScreenshot(task, source, priority);
+    }
+    return task;
+}
+
+void ScreenMeBackend::lookup(UploadTask* task, const UploadSource& source, const std::function<void(const UploadResult&)>& done) {
+    if (source.contentHash.isEmpty()) {
+        done(UploadResult());
+        return;
+    }
+    ScheduledUpload* step = UploadScheduler::instance()->enqueue(request("/api/screenshot/lookup?xxh3=" + source.contentHash),
+        nullptr, UploadPriority::Interactive, "GET");
+    task->track(step);
+    connect(step, &ScheduledUpload::finished, task, [this, done](QNetworkReply* reply) {
+        UploadResult result;
+        if (!reply || reply->error() == QNetworkReply::OperationCanceledError) {
+            result.canceled = true;
+            done(result);
+            return;
+        }
+        result.httpStatus = httpStatus(reply);
+        const QJsonObject response = QJsonDocument::fromJson(reply->readAll()).object();
+        if (reply->error() == QNetworkReply::NoError) {
+            if (response.contains("url")) {
+                result.success = true;
+                result.id = QString::number(response["id"].toInt());
+                result.link = baseUrl + "/" + response["url"].toString();
+            }
+        }
+        else if ((result.httpStatus == 404 || result.httpStatus == 405) && !response.contains("found")) {
+            // A miss says {"found": false}, a bare 404 is a server without the endpoint
+            hostsWithoutLookup.insert(baseUrl);
+        }
+        done(result);
+    });
+}
+
+bool ScreenMeBackend::hasLookup() const {
+    return !hostsWithoutLookup.contains(baseUrl);
+}
+
+QNetworkRequest ScreenMeBackend::request(const QString& path) const {
+    QNetworkRequest request(QUrl(baseUrl + path));
+    request.setRawHeader("Authorization", "Bearer " + token);
+    return request;
+}
+
+void ScreenMeBackend::reserve(UploadTask* task, const UploadSource& source, UploadPriority priority) {
+    QJsonObject json;
+    json["file_name"] = source.fileName;
+    json["mime_type"] = QString::fromUtf8(source.mimeType);
+    json["size"] = QFileInfo(source.filePath).size();
+    json["xxh3"] = source.contentHash;
+
+    QBuffer* body = new QBuffer();
+    body->setData(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    body->open(QIODevice::ReadOnly);
+
+    QNetworkRequest reserveRequest = request("/api/screenshot/reserve");
+    reserveRequest.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    ScheduledUpload* step = UploadScheduler::instance()->enqueue(reserveRequest, body, priority);
+    task->track(step);
+    connect(step, &ScheduledUpload::finished, task, [this, task, source, priority](QNetworkReply* reply) {
+        const int status = httpStatus(reply);
+        if (reply && (status == 404 || status == 405)) {
+            // Older server, publish in one request instead
+            hostsWithoutReservation.insert(baseUrl);
+            postScreenshot(task, source, priority);
+            return;
+        }
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            task->finish(failure(reply));
+            return;
+        }
+        QJsonObject response = QJsonDocument::fromJson(reply->readAll()).object();
+        const QString id = QString::number(response["id"].toInt());
+        const QString link = baseUrl + "/" + response["url"].toString();
+        emit task->linkReady(link, id);
+        putContent(task, source, id, link, priority, !source.previewPath.isEmpty());
+    });
+}
+
+void ScreenMeBackend::putContent(UploadTask* task, const UploadSource& source, const QString& id, const QString& link,
+    UploadPriority priority, bool preview, bool previewOnline) {
+    QFile* file = new QFile(preview ? source.previewPath : source.filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        release(id);
+        task->fail("Failed to open the image file for upload.");
+        return;
+    }
+    QNetworkRequest contentRequest = request("/api/screenshot/" + id + "/content");
+    contentRequest.setHeader(QNetworkRequest::ContentTypeHeader, preview ? source.previewMimeType : source.mimeType);
+    // The full image replaces a preview server-side, a late preview never replaces the full image
+    contentRequest.setRawHeader("X-ScreenMe-Variant", preview ? "preview" : "full");
+    if (!preview && !source.contentHash.isEmpty()) {
+        contentRequest.setRawHeader("X-ScreenMe-Content-Hash", "xxh3=" + source.contentHash.toLatin1());
+    }
+
+    ScheduledUpload* step = UploadScheduler::instance()->enqueue(contentRequest, file, priority, "PUT");
+    task->track(step);
+    connect(step, &ScheduledUpload::uploadProgress, task, &UploadTask::progress);
+    connect(step, &ScheduledUpload::finished, task, [this, task, source, id, link, priority, preview, previewOnline](QNetworkReply* reply) {
+        const bool ok = reply && reply->error() == QNetworkReply::NoError;
+        if (preview && (ok || (reply && reply->error() != QNetworkReply::OperationCanceledError))) {
+            if (ok) {
+                emit task->previewPublished();
+            }
+            // With the link working, the full image is no longer urgent
+            putContent(task, source, id, link, ok ? UploadPriority::Background : priority, false, ok);
+            return;
+        }
+        if (!ok) {
+            UploadResult result = failure(reply);
+            if (previewOnline && !result.canceled) {
+                // The shared link keeps showing the preview
+                result.link = link;
+                result.id = id;
+                result.error = "The full resolution upload failed, the link shows the preview: " + result.error;
+            }
+            else if (!previewOnline) {
+                // The link is already out, drop the reservation rather than leave it dangling
+                release(id);
+            }
+            task->finish(result);
+            return;
+        }
+        UploadResult result;
+        result.success = true;
+        result.httpStatus = httpStatus(reply);
+        result.id = id;
+        result.link = link;
+        task->finish(result);
+    });
+}
+
+void ScreenMeBackend::postScreenshot(UploadTask* task, const UploadSource& source, UploadPriority priority) {
+    QFile* file = new QFile(source.filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        task->fail("Failed to open the image file for upload.");
+        return;
+    }
+    MultipartBody* body = new MultipartBody("screenshot", source.fileName, source.mimeType, file);
+
+    QNetworkRequest postRequest = request("/api/screenshot");
+    postRequest.setHeader(QNetworkRequest::ContentTypeHeader, body->contentType());
+    if (!source.contentHash.isEmpty()) {
+        postRequest.setRawHeader("X-ScreenMe-Content-Hash", "xxh3=" + source.contentHash.toLatin1());
+    }
+
+    ScheduledUpload* step = UploadScheduler::instance()->enqueue(postRequest, body, priority);
+    task->track(step);
+    connect(step, &ScheduledUpload::uploadProgress, task, &UploadTask::progress);
+    connect(step, &ScheduledUpload::finished, task, [this, task](QNetworkReply* reply) {
+        if (!reply || reply->error() != QNetworkReply::NoError) {
+            task->finish(failure(reply));
+            return;
+        }
+        QJsonObject response = QJsonDocument::fromJson(reply->readAll()).object();
+        UploadResult result;
+        result.success = true;
+        result.httpStatus = httpStatus(reply);
+        result.id = QString::number(response["id"].toInt());
+        result.link = baseUrl + "/" + response["url"].toString();
+        task->finish(result);
+    });
+}
+
+void ScreenMeBackend::release(const QString& id) {
+    QNetworkReply* reply = UploadScheduler::instance()->network()->deleteResource(request("/api/screenshot/" + id));
+    connect(reply, &QNetworkReply::finished, reply, &QNetworkReply::deleteLater);
+}
@@ -1,11 +1,25 @@
 #include "include/screenshotdisplay.h"
+#include "include/screen_overlay.h"
 #include "include/config_manager.h"
 #include "include/utils.h"
+#include "include/lazy_mime_data.h"
+#include "include/vector_export.h"
+#include "include/image_resampler.h"
+#include "include/palette_quantizer.h"
+#include "include/content_classifier.h"
+#include "include/upload_scheduler.h"
+#include "include/upload_backend.h"
+#include "include/screenme_backend.h"
+#include "include/privacy_updater.h"
+#include "include/async_task.h"
+#include "include/job_system.h"
+#include "include/capture_search.h"
+#include "include/metrics_registry.h"
+#include <QTimer>
 #include <QApplication>
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkReply>
-#include <QtNetwork/QHttpMultiPart>
 #include <QStandardPaths>
 #include <QJsonDocument>
 #include <QFileDialog>
@@ -16,31 +30,135 @@
 #include <QMouseEvent>
 #include <QShortcut>
 #include <QToolTip>
+#include <QInputMethod>
+#include <QInputMethodEvent>
+#include <QScreen>
 #include <QCursor>
 #include <QCheckBox>
 #include <QWheelEvent>
+#include <QHBoxLayout>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QDir>
+#include <memory>
+
+namespace {
+    // Progressive publishing: captures above both limits get a quick JPEG preview first
+    const int PreviewDimension = 1280;
+    const qint64 ProgressiveMinBytes = 1024 * 1024;
+    const int PreviewQuality = 80;
+    // Time for the window system to take the hidden overlays off the screen, fade-out
+    // animations included, before the first scrolling frame is grabbed
+    const int ScrollCaptureStartDelayMs = 250;
+
+    // Removes the encoded files once the last copy of the upload is gone, however the
+    // publish ends, cancelled mid-encode included
+    struct TempFiles {
+        QStringList paths;
+        ~TempFiles() {
+            for (const QString& path : paths) {
+                QFile::remove(path);
+            }
+        }
+    };
+
+    // Capture encoded to temporary files, ready to publish
+    struct EncodedUpload {
+        UploadSource source;
+        bool saved = false;
+        std::shared_ptr<TempFiles> tempFiles = std::make_shared<TempFiles>();
+    };
+
+    // A fresh file per publish: uploads stream from disk for a while, a second publish
+    // must not overwrite or delete the first one's source
+    QString reserveTempFile(const QString& suffix, TempFiles* tempFiles) {
+        QTemporaryFile file(QDir::tempPath() + "/screenshot-XXXXXX." + suffix);
+        file.setAutoRemove(false);
+        if (!file.open()) {
+            return QString();
+        }
+        tempFiles->paths.append(file.fileName());
+        return file.fileName();
+    }
+
+    // Export size, format choice, quantization and the progressive preview. Only touches
+    // its arguments, so it runs as a job; gives up between steps once cancelled.
+    EncodedUpload encodeForUpload(const QImage& selectedImage, const QJsonObject& config, const JobToken& token) {
+        static MetricsRegistry::Histogram* encodeTime = MetricsRegistry::instance()->histogram("screenme_encode_seconds",
+            "Time to encode a capture and write it out", "target=\"upload\"");
+        QElapsedTimer timer;
+        timer.start();
+        // The clipboard keeps the full resolution, only the upload follows the export size policy
+        QImage uploadImage = ScreenshotDisplay::applyExportSize(selectedImage, config);
+        // Uploads stay png unless the format is picked from the content
+        QString extension = config["file_extension"].toString() == "auto"
+            ? ContentClassifier::chooseExtension(uploadImage, "auto") : QString("png");
+        QString mimeType = extension == "jpg" ? QString("image/jpeg") : "image/" + extension;
+        // Opt-in, and lossy only for interface content: photos and gradients keep every colour
+        if (extension == "png" && config["quantize_uploads"].toBool(false)) {
+            QImage indexed = PaletteQuantizer::quantizeExact(uploadImage);
+            if (indexed.isNull() && !ContentClassifier::analyze(uploadImage).isPhotographic()) {
+                indexed = PaletteQuantizer::quantize(uploadImage);
+            }
+            if (!indexed.isNull()) {
+                uploadImage = indexed;
+            }
+        }
 
-ScreenshotDisplay::ScreenshotDisplay(const QPixmap& pixmap, QWidget* parent, ConfigManager* configManager)
-    : QWidget(parent), originalPixmap(pixmap), selectionStarted(false), movingSelection(false), currentHandle(None), configManager(configManager),
+        EncodedUpload encoded;
+        if (token.isCanceled()) {
+            return encoded;
+        }
+        const QString tempFilePath = reserveTempFile(extension, encoded.tempFiles.get());
+        encoded.source = UploadSource{ tempFilePath, "screenshot." + extension, mimeType.toUtf8() };
+        encoded.saved = !tempFilePath.isEmpty() && uploadImage.save(tempFilePath, nullptr, extension == "png" ? -1 : config["image_quality"].toInt());
+        encodeTime->observe(timer.nsecsElapsed() / 1e9);
+        if (encoded.saved && !token.isCanceled() && config["progressive_publish"].toBool(true) && QFileInfo(tempFilePath).size() > ProgressiveMinBytes
+            && qMax(uploadImage.width(), uploadImage.height()) > PreviewDimension) {
+            // The link works as soon as the preview is up, the full image replaces it in the background
+            QImage preview = ImageResampler::downscale(uploadImage.convertToFormat(QImage::Format_RGB32),
+                ImageResampler::exportSize(uploadImage.size(), PreviewDimension));
+            encoded.source.previewPath = reserveTempFile("jpg", encoded.tempFiles.get());
+            encoded.source.previewMimeType = "image/jpeg";
+            if (encoded.source.previewPath.isEmpty() || !preview.save(encoded.source.previewPath, "JPG", PreviewQuality)) {
+                encoded.source.previewPath.clear();
+            }
+        }
+        return encoded;
+    }
+}
+
+ScreenshotDisplay::ScreenshotDisplay(const QVector<ScreenGrab>& capture, const QRect& desktop, QWidget* parent,
+    ConfigManager* configManager)
+    : QWidget(parent), selectionStarted(false), movingSelection(false), currentHandle(None), configManager(configManager),
     drawing(false), shapeDrawing(false), currentColor(Qt::black), currentTool(Editor::None), borderWidth(5),
-    drawingPixmap(pixmap.size()), currentFont("Arial", 16), text("Editable Text"), textEdit(nullptr) {
+    desktopOrigin(desktop.topLeft()), desktopRect(QPoint(), desktop.size()),
+    currentFont("Arial", 16),
+    editingText(-1), editingNewText(false), editSnapshotTaken(false), textCursor(0), draggingText(-1), textDragMoved(false),
+    firstPainted(false) {
+    openedTimer.start();
 
-    setWindowFlags(Qt::Window | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint);
-    setWindowTitle("ScreenMe");
-    setWindowIcon(QIcon("resources/icon.png"));
     setAttribute(Qt::WA_QuitOnClose, false);
 
-    QScreen* screen = QApplication::primaryScreen();
-    QRect screenGeometry = screen->geometry();
-    setGeometry(screenGeometry);
+    // One window per screen keeps each backing store the size of its screen and each
+    // paint at that screen's ratio, where one window over the desktop would be neither
+    for (const ScreenGrab& grab : capture) {
+        if (grab.geometry.intersects(desktop)) {
+            layers.addScreen(grab.image, grab.geometry.translated(-desktopOrigin), grab.devicePixelRatio);
+            overlays.append(new ScreenOverlay(this, grab.screen, desktopOrigin));
+        }
+    }
 
     initializeEditor();
     configureShortcuts();
 
-    drawingPixmap.fill(Qt::transparent);
-    QFontMetrics fm(currentFont);
-    textBoundingRect = QRect(QPoint(100, 100), fm.size(0, text));
-    showFullScreen();
+    for (ScreenOverlay* overlay : overlays) {
+        overlay->showFullScreen();
+    }
+    // Keys go to the screen the capture was started from
+    if (ScreenOverlay* active = overlayAt(QCursor::pos() - desktopOrigin)) {
+        active->activateWindow();
+    }
 }
 
 void ScreenshotDisplay::initializeEditor() {
@@ -48,55 +166,99 @@ void ScreenshotDisplay::initializeEditor() {
     connect(editor.get(), &Editor::toolChanged, this, &ScreenshotDisplay::onToolSelected);
     connect(editor.get(), &Editor::colorChanged, this, [this](const QColor& color) {
         currentColor = color;
-        if (textEdit) {
-            textEdit->setTextColor(currentColor);
+        if (editingText >= 0) {
+            Annotation edited = layers.annotations(LayerStack::Text).at(editingText);
+            edited.color = color;
+            applyTextEdit(edited);
         }
-        update();
+        updateOverlays();
     });
     connect(editor.get(), &Editor::saveRequested, this, &ScreenshotDisplay::onSaveRequested);
     connect(editor.get(), &Editor::copyRequested, this, &ScreenshotDisplay::copySelectionToClipboard);
     connect(editor.get(), &Editor::publishRequested, this, &ScreenshotDisplay::onPublishRequested);
+    connect(editor.get(), &Editor::scrollCaptureRequested, this, &ScreenshotDisplay::onScrollCaptureRequested);
     connect(editor.get(), &Editor::closeRequested, this, &ScreenshotDisplay::onCloseRequested);
 }
 
 void ScreenshotDisplay::configureShortcuts() {
-    QShortcut* escapeShortcut = new QShortcut(QKeySequence(Qt::Key_Escape), this);
-    connect(escapeShortcut, &QShortcut::activated, [this]() {
-        if (editor->getCurrentTool() != Editor::None) {
-            editor->deselectTools();
-            setCursor(Qt::ArrowCursor);
+    // Shortcuts fire for the window that has focus, every overlay gets its own
+    for (ScreenOverlay* overlay : overlays) {
+        QShortcut* escapeShortcut = new QShortcut(QKeySequence(Qt::Key_Escape), overlay);
+        connect(escapeShortcut, &QShortcut::activated, this, [this]() {
+            if (editingText >= 0) {
+                finishTextEditing();
+            }
+            else if (editor->getCurrentTool() != Editor::None) {
+                editor->deselectTools();
+                setOverlayCursor(Qt::ArrowCursor);
+            }
+            else {
+                close();
+            }
+        });
+
+        QShortcut* undoShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_Z), overlay);
+        connect(undoShortcut, &QShortcut::activated, this, &ScreenshotDisplay::undo);
+
+        QShortcut* copyShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_C), overlay);
+        connect(copyShortcut, &QShortcut::activated, this, &ScreenshotDisplay::copySelectionToClipboard);
+    }
+}
+
+void ScreenshotDisplay::updateOverlays(const QRect& area) {
+    for (ScreenOverlay* overlay : overlays) {
+        if (area.isNull()) {
+            overlay->update();
+            continue;
         }
-        else {
-            close();
+        const QRect visible = area.intersected(overlay->area());
+        if (!visible.isEmpty()) {
+            overlay->update(visible.translated(-overlay->area().topLeft()));
         }
-    });
+    }
+}
+
+void ScreenshotDisplay::hideOverlays() {
+    for (ScreenOverlay* overlay : overlays) {
+        overlay->hide();
+    }
+}
 
-    QShortcut* undoShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_Z), this);
-    connect(undoShortcut, &QShortcut::activated, this, &ScreenshotDisplay::undo);
+void ScreenshotDisplay::setOverlayCursor(Qt::CursorShape shape) {
+    for (ScreenOverlay* overlay : overlays) {
+        overlay->setCursor(shape);
+    }
+}
 
-    QShortcut* copyShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_C), this);
-    connect(copyShortcut, &QShortcut::activated, this, &ScreenshotDisplay::copySelectionToClipboard);
+ScreenOverlay* ScreenshotDisplay::overlayAt(const QPoint& point) const {
+    for (ScreenOverlay* overlay : overlays) {
+        if (overlay->area().contains(point)) {
+            return overlay;
+        }
+    }
+    return overlays.isEmpty() ? nullptr : overlays.first();
 }
 
 void ScreenshotDisplay::closeEvent(QCloseEvent* event) {
     emit screenshotClosed();
+    hideOverlays();
     if (editor) {
         editor->hide();
     }
-    if (textEdit) {
-        textEdit->deleteLater();
-        textEdit = nullptr;
+    if (scrollCapture) {
+        scrollCapture->cancel();
     }
-
-    while (!undoStack.empty()) {
-        undoStack.pop();
+    if (scrollCaptureBar) {
+        scrollCaptureBar->deleteLater();
     }
+    finishTextEditing();
 
     QWidget::closeEvent(event);
 }
 
 void ScreenshotDisplay::mousePressEvent(QMouseEvent* event) {
     if (editor->getCurrentTool() == Editor::None) {
+        finishTextEditing();
         HandlePosition handle = handleAtPoint(event->pos());
         if (handle != None) {
             currentHandle = handle;
@@ -115,33 +277,40 @@ void ScreenshotDisplay::mousePressEvent(QMouseEvent* event) {
         }
     }
     else if (editor->getCurrentTool() == Editor::Text) {
-        if (!textEdit) {
-            textEdit = new CustomTextEdit(this);
-            textEdit->setFont(currentFont);
-            textEdit->setTextColor(currentColor);
-            textEdit->setStyleSheet("background: transparent;");
-            textEdit->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-            textEdit->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-            textEdit->setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
-            textEdit->move(event->pos());
-            textEdit->show();
-            textEdit->setFocus();
-            textEditPosition = event->pos();
-            connect(textEdit, &CustomTextEdit::focusOut, this, &ScreenshotDisplay::finalizeTextEdit);
-            connect(textEdit, &QTextEdit::textChanged, this, &ScreenshotDisplay::adjustTextEditSize);
+        // Placed text stays an object: clicking it edits it, dragging it moves it
+        int hit = textAnnotationAt(event->pos());
+        if (hit != editingText) {
+            finishTextEditing();
+            hit = textAnnotationAt(event->pos());
+        }
+        if (hit >= 0) {
+            draggingText = hit;
+            textDragOrigin = event->pos();
+            textDragMoved = false;
         }
         else {
-            finalizeTextEdit();
+            Annotation textAnnotation;
+            textAnnotation.kind = Annotation::Text;
+            textAnnotation.color = editor->getCurrentColor();
+            textAnnotation.font = currentFont;
+            textAnnotation.start = event->pos();
+            layers.addAnnotation(LayerStack::Text, textAnnotation);
+            beginTextEditing(layers.annotations(LayerStack::Text).size() - 1, true);
         }
     }
     else {
-        saveStateForUndo();
+        // Text being typed ends before another annotation starts on top of it
+        finishTextEditing();
         drawing = true;
         lastPoint = event->pos();
         origin = event->pos();
-        if (editor->getCurrentTool() != Editor::Pen) {
+        if (editor->getCurrentTool() == Editor::Pen) {
+            drawingPath = QPainterPath(lastPoint);
+        }
+        else {
             shapeDrawing = true;
             currentShapeRect = QRect(lastPoint, QSize());
+            drawingEnd = lastPoint;
         }
     }
 }
@@ -152,107 +321,114 @@ void ScreenshotDisplay::mouseMoveEvent(QMouseEvent* event) {
         editor->show();
     }
     if (selectionRect.isValid()) {
-        update();
+        updateOverlays();
     }
     if (selectionStarted) {
         QRect newRect = QRect(origin, event->pos()).normalized();
-        QRect screenRect = QApplication::primaryScreen()->geometry();
-        selectionRect = newRect.intersected(screenRect);
-        update();
+        selectionRect = newRect.intersected(desktopRect);
+        updateOverlays();
         updateTooltip();
         updateEditorPosition();
     }
+    else if (draggingText >= 0) {
+        QPoint delta = event->pos() - textDragOrigin;
+        if (textDragMoved || delta.manhattanLength() > QApplication::startDragDistance()) {
+            Annotation moved = layers.annotations(LayerStack::Text).at(draggingText);
+            moved.start += delta;
+            // One undo step for the whole drag
+            layers.updateAnnotation(LayerStack::Text, draggingText, moved, !textDragMoved);
+            textDragOrigin = event->pos();
+            textDragMoved = true;
+            updateOverlays();
+        }
+    }
     else if (drawing && editor->getCurrentTool() == Editor::Pen) {
-        QPixmap tempPixmap = drawingPixmap.copy();
-        QPainter painter(&tempPixmap);
-        painter.setPen(QPen(editor->getCurrentColor(), borderWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-        painter.drawLine(lastPoint, event->pos());
+        // The stroke stays a path until release, only the touched area is repainted
+        QRect dirty = QRect(lastPoint, event->pos()).normalized().adjusted(-borderWidth, -borderWidth, borderWidth, borderWidth);
+        drawingPath.lineTo(event->pos());
         lastPoint = event->pos();
-        drawingPixmap = tempPixmap;
-        update();
+        updateOverlays(dirty);
     }
     else if (shapeDrawing) {
         currentShapeRect = QRect(lastPoint, event->pos()).normalized();
         drawingEnd = event->pos();
-        update();
+        updateOverlays();
     }
     else if (movingSelection) {
         QPoint topLeft = event->pos() - selectionOffset;
-        QRect screenRect = QApplication::primaryScreen()->geometry();
         if (topLeft.x() < 0) topLeft.setX(0);
         if (topLeft.y() < 0) topLeft.setY(0);
-        if (topLeft.x() + selectionRect.width() > screenRect.width()) {
-            topLeft.setX(screenRect.width() - selectionRect.width());
+        if (topLeft.x() + selectionRect.width() > desktopRect.width()) {
+            topLeft.setX(desktopRect.width() - selectionRect.width());
         }
-        if (topLeft.y() + selectionRect.height() > screenRect.height()) {
-            topLeft.setY(screenRect.height() - selectionRect.height());
+        if (topLeft.y() + selectionRect.height() > desktopRect.height()) {
+            topLeft.setY(desktopRect.height() - selectionRect.height());
         }
         selectionRect.moveTopLeft(topLeft);
-        update();
+        updateOverlays();
         updateTooltip();
         updateEditorPosition();
     }
     else if (currentHandle != None) {
         resizeSelection(event->pos());
-        update();
+        updateOverlays();
         updateTooltip();
         updateEditorPosition();
     }
 
     HandlePosition handle = handleAtPoint(event->pos());
-    setCursor(cursorForHandle(handle));
+    setOverlayCursor(cursorForHandle(handle));
 }
 
 void ScreenshotDisplay::mouseReleaseEvent(QMouseEvent* event) {
     selectionStarted = false;
     movingSelection = false;
     currentHandle = None;
+    if (drawing && editor->getCurrentTool() == Editor::Pen && drawingPath.elementCount() > 1) {
+        Annotation stroke;
+        stroke.kind = Annotation::Stroke;
+        stroke.color = editor->getCurrentColor();
+        stroke.penWidth = borderWidth;
+        stroke.path = drawingPath;
+        layers.addAnnotation(LayerStack::Shapes, stroke);
+    }
+    drawingPath = QPainterPath();
     drawing = false;
+    if (draggingText >= 0) {
+        if (!textDragMoved) {
+            beginTextEditing(draggingText, false);
+        }
+        draggingText = -1;
+    }
     endPoint = event->pos();
-    qreal ratio = QApplication::primaryScreen()->devicePixelRatio();
+    qreal ratio = layers.scale(QRect(endPoint, QSize(1, 1)));
     endPoint.setX(endPoint.x() * ratio);
     endPoint.setY(endPoint.y() * ratio);
 
     if (shapeDrawing) {
-        saveStateForUndo();
-        QPixmap tempPixmap = drawingPixmap.copy();
-        QPainter painter(&tempPixmap);
-        painter.setPen(QPen(editor->getCurrentColor(), borderWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-
-        switch (editor->getCurrentTool()) {
-        case Editor::Rectangle:
-            painter.drawRect(currentShapeRect);
-            break;
-        case Editor::Ellipse:
-            painter.drawEllipse(currentShapeRect);
-            break;
-        case Editor::Line:
-            painter.drawLine(lastPoint, drawingEnd);
-            break;
-        case Editor::Arrow:
-            drawArrow(painter, lastPoint, drawingEnd);
-            break;
-        default:
-            break;
-        }
-
-        drawingPixmap = tempPixmap;
+        Annotation shape = currentShapeAnnotation();
+        if (!shape.bounds().isEmpty()) {
+            layers.addAnnotation(LayerStack::layerFor(shape.kind), shape);
+        }
         shapeDrawing = false;
-        update();
+        updateOverlays();
     }
 
-    update();
+    updateOverlays();
     updateTooltip();
 }
 
 void ScreenshotDisplay::keyPressEvent(QKeyEvent* event) {
+    if (editingText >= 0 && editTextWithKey(event)) {
+        return;
+    }
     if (editor->getCurrentTool() != Editor::None && event->key() == Qt::Key_Escape) {
-        if (editor->getCurrentTool() == Editor::Text && textEdit) {
-            finalizeTextEdit();
+        if (editingText >= 0) {
+            finishTextEditing();
         }
         else {
             editor->deselectTools();
-            setCursor(Qt::ArrowCursor);
+            setOverlayCursor(Qt::ArrowCursor);
         }
     }
     else if (event->key() == Qt::Key_Escape) {
@@ -268,92 +444,127 @@ void ScreenshotDisplay::wheelEvent(QWheelEvent* event) {
     if (editor->getCurrentTool() != Editor::None && editor->getCurrentTool() != Editor::Text) {
         borderWidth += event->angleDelta().y() / 120;
         borderWidth = std::clamp(borderWidth, 1, 20);
-        update();
+        updateOverlays();
     }
-    if (editor->getCurrentTool() == Editor::Text && textEdit) {
+    if (editor->getCurrentTool() == Editor::Text) {
         int delta = event->angleDelta().y() / 120;
         int newSize = currentFont.pointSize() + delta;
         if (newSize > 0) {
             currentFont.setPointSize(newSize);
-            textEdit->setFont(currentFont);
-            adjustTextEditSize();
-            update();
+            if (editingText >= 0) {
+                Annotation edited = layers.annotations(LayerStack::Text).at(editingText);
+                edited.font = currentFont;
+                applyTextEdit(edited);
+            }
         }
     }
 }
 
-void ScreenshotDisplay::paintEvent(QPaintEvent* event) {
-    Q_UNUSED(event);
-    QPainter painter(this);
-    QScreen *screen = this->screen();
-    qreal dpr = screen->devicePixelRatio();
-
-    QPixmap scaledOriginalPixmap = originalPixmap.scaled(size() * dpr, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    QPixmap scaledDrawingPixmap = drawingPixmap.scaled(size() * dpr, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+void ScreenshotDisplay::paintArea(QPainter& painter, const QRect& area, const ScreenOverlay* overlay) {
+    // The overlay's own screen grab, at that screen's ratio, so its pixels land one to one
+    LayerStack& screenLayers = layers.screen(overlays.indexOf(overlay));
+    // Only tiles touched since the last paint are recomposited
+    const QImage& composite = screenLayers.composite();
 
-    QPixmap transparentPixmap(scaledOriginalPixmap.size());
-    transparentPixmap.fill(Qt::transparent);
-    
-    QPainter transparentPainter(&transparentPixmap);
-    transparentPainter.setOpacity(0.6);
-    transparentPainter.drawPixmap(0, 0, scaledOriginalPixmap);
-    transparentPainter.drawPixmap(0, 0, scaledDrawingPixmap);
-
-    painter.drawPixmap(0, 0, transparentPixmap);
+    // Just the asked area is read from the capture, a paint costs no more than its screen
+    painter.setOpacity(0.6);
+    painter.drawImage(area, composite, screenLayers.mapToImage(area));
+    painter.setOpacity(1.0);
 
     if (selectionRect.isValid()) {
-        QRect scaledSelectionRect = QRect(selectionRect.topLeft() * dpr, selectionRect.size() * dpr);
-        QPixmap selectedPixmap = scaledOriginalPixmap.copy(scaledSelectionRect);
-        painter.drawPixmap(selectionRect.topLeft(), selectedPixmap);
-
-        QPixmap selectedDrawingPixmap = scaledDrawingPixmap.copy(scaledSelectionRect);
-        painter.drawPixmap(selectionRect.topLeft(), selectedDrawingPixmap);
+        const QRect selected = selectionRect.intersected(area);
+        if (!selected.isEmpty()) {
+            painter.drawImage(selected, composite, screenLayers.mapToImage(selected));
+        }
 
         painter.setPen(QPen(Qt::red, 2, Qt::DashLine));
         painter.drawRect(selectionRect);
         drawHandles(painter);
     }
+    if (drawing && editor->getCurrentTool() == Editor::Pen) {
+        painter.setPen(QPen(editor->getCurrentColor(), borderWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPath(drawingPath);
+    }
     if (shapeDrawing) {
-        painter.setPen(QPen(editor->getCurrentColor(), borderWidth, Qt::SolidLine));
-        switch (editor->getCurrentTool()) {
-        case Editor::Pen:
-            painter.drawPath(drawingPath);
-            break;
-        case Editor::Rectangle:
-            painter.setBrush(Qt::NoBrush);
-            painter.drawRect(currentShapeRect);
-            break;
-        case Editor::Ellipse:
-            painter.setBrush(Qt::NoBrush);
-            painter.drawEllipse(currentShapeRect);
-            break;
-        case Editor::Line:
-            painter.drawLine(origin, drawingEnd);
-            break;
-        case Editor::Arrow:
-            drawArrow(painter, lastPoint, drawingEnd);
-            break;
-        case Editor::Text:
-            painter.setFont(currentFont);
-            painter.setPen(QPen(editor->getCurrentColor()));
-            painter.drawText(textBoundingRect, Qt::AlignLeft, text);
-            break;
-        default:
-            break;
+        Annotation preview = currentShapeAnnotation();
+        if (preview.kind == Annotation::Highlight) {
+            painter.setCompositionMode(QPainter::CompositionMode_Multiply);
         }
+        preview.paint(painter);
+        painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    }
+
+    if (editingText >= 0) {
+        drawTextCursor(painter);
     }
 
     if (editor->getCurrentTool() != Editor::None) {
-        drawBorderCircle(painter, mapFromGlobal(QCursor::pos()));
+        drawBorderCircle(painter, QCursor::pos() - desktopOrigin);
         painter.setBrush(Qt::transparent);
         painter.drawEllipse(cursorPosition, borderWidth / 2, borderWidth / 2);
     }
+
+    if (!firstPainted) {
+        firstPainted = true;
+        static MetricsRegistry::Histogram* firstPaint = MetricsRegistry::instance()->histogram("screenme_first_paint_seconds",
+            "Time from creating the capture overlay to its first paint");
+        firstPaint->observe(openedTimer.nsecsElapsed() / 1e9);
+    }
+}
+
+Annotation ScreenshotDisplay::currentShapeAnnotation() const {
+    Annotation shape;
+    shape.color = editor->getCurrentColor();
+    shape.penWidth = borderWidth;
+    shape.rect = currentShapeRect;
+    shape.start = lastPoint;
+    shape.end = drawingEnd;
+
+    switch (editor->getCurrentTool()) {
+    case Editor::Rectangle:
+        shape.kind = Annotation::Rectangle;
+        break;
+    case Editor::Ellipse:
+        shape.kind = Annotation::Ellipse;
+        break;
+    case Editor::Line:
+        shape.kind = Annotation::Line;
+        break;
+    case Editor::Arrow:
+        shape.kind = Annotation::Arrow;
+        break;
+    case Editor::Highlight:
+        shape.kind = Annotation::Highlight;
+        // Black would multiply everything away, fall back to a highlighter yellow
+        if (shape.color == Qt::black) {
+            shape.color = QColor(255, 235, 59);
+        }
+        break;
+    case Editor::Redact:
+        shape.kind = Annotation::Redaction;
+        break;
+    default:
+        shape.kind = Annotation::Rectangle;
+        break;
+    }
+    return shape;
+}
+
+QStringList ScreenshotDisplay::annotationText() const {
+    QStringList text;
+    for (const Annotation& annotation : layers.annotations(LayerStack::Text)) {
+        text.append(annotation.text);
+    }
+    return text;
 }
 
 void ScreenshotDisplay::onSaveRequested() {
     QJsonObject config = configManager->loadConfig();
     QString defaultSaveFolder = config["default_save_folder"].toString();
     QString fileExtension = config["file_extension"].toString();
+    QImage image = applyExportSize(renderSelection(), config);
+    fileExtension = ContentClassifier::chooseExtension(image, fileExtension);
     QString defaultFileName = getUniqueFilePath(defaultSaveFolder, "screenshot", fileExtension);
 
     QString fileFilter = "PNG Files (*.png);;JPEG Files (*.jpg *.jpeg);;";
@@ -363,184 +574,295 @@ void ScreenshotDisplay::onSaveRequested() {
     else if (fileExtension == "jpg" || fileExtension == "jpeg") {
         fileFilter = "JPEG Files (*.jpg *.jpeg);;";
     }
+    else if (fileExtension == "webp") {
+        fileFilter = "WebP Files (*.webp);;";
+    }
+    fileFilter += "SVG Files (*.svg);;PDF Files (*.pdf);;";
 
-    QString filePath = QFileDialog::getSaveFileName(this, "Save As", defaultFileName, fileFilter);
+    QWidget* dialogParent = overlayAt(selectionRect.center());
+    QString filePath = QFileDialog::getSaveFileName(dialogParent, "Save As", defaultFileName, fileFilter);
 
-    if (!filePath.isEmpty()) {
-        QPixmap selectedPixmap = originalPixmap.copy(selectionRect);
-        selectedPixmap.save(filePath);
-        close();
+    if (filePath.isEmpty()) {
+        return;
+    }
+    if (VectorExport::isVectorFormat(filePath)) {
+        finishTextEditing();
+        if (!exportVector(filePath)) {
+            QMessageBox::warning(dialogParent, "Error", "Failed to export the screenshot.");
+            return;
+        }
+        CaptureSearch::instance()->addCapture(filePath, annotationText());
+        emit captureSaved(filePath, image);
+    }
+    else if (saveCapture(image, filePath, config["image_quality"].toInt())) {
+        CaptureSearch::instance()->addCapture(filePath, annotationText());
+        emit captureSaved(filePath, image);
     }
+    close();
 }
 
 void ScreenshotDisplay::onPublishRequested() {
-    if (textEdit) {
-        finalizeTextEdit();
-    }
-    QPixmap resultPixmap = originalPixmap;
-    QPainter painter(&resultPixmap);
-    painter.drawPixmap(0, 0, drawingPixmap);
-
+    finishTextEditing();
     editor->hide();
 
     if (selectionRect.isValid()) {
-        ScreenshotDisplay::hide();
-        QPixmap selectedPixmap = resultPixmap.copy(selectionRect);
-        QApplication::clipboard()->setPixmap(selectedPixmap);
+        hideOverlays();
+        QImage selectedImage = renderSelection();
+        QApplication::clipboard()->setMimeData(new LazyImageMimeData(selectedImage));
 
-        QString tempFilePath = QStandardPaths::writableLocation(QStandardPaths::TempLocation) + "/screenshot.png";
-        selectedPixmap.save(tempFilePath);
+        // Destroying the display cancels the publish along with whatever it is waiting on
+        Async::spawn(publishSelection(selectedImage), this);
+    }
+}
 
-        QString jsonStr = loadLoginInfo();
-        QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonStr.toUtf8());
-        QJsonObject loginInfo = jsonDoc.object();
+Async::Task<> ScreenshotDisplay::publishSelection(QImage selectedImage) {
+    QJsonObject config = configManager->loadConfig();
+    UploadScheduler* scheduler = UploadScheduler::instance();
+    scheduler->applyConfig(config);
+    // Deleted late, the task it owns is still emitting when this coroutine ends
+    Async::Owned<UploadBackend> backend(UploadBackend::create(config));
+
+    // The connection is set up while the capture is encoded
+    backend->preconnect();
+    const auto job = co_await JobSystem::instance()->run(JobSystem::Lane::Interactive, [selectedImage, config](const JobToken& token) {
+        return encodeForUpload(selectedImage, config, token);
+    });
+    if (!job) {
+        co_return;
+    }
+    // The files go away with `job`, at the end of this coroutine
+    const EncodedUpload& encoded = *job;
+    if (co_await Async::canceled()) {
+        co_return;
+    }
+    if (!encoded.saved) {
+        QMessageBox::critical(this, "Upload Failed", "Failed to encode the screenshot.");
+        emit screenshotClosed();
+        co_return;
+    }
 
-        QNetworkAccessManager* manager = new QNetworkAccessManager(this);
-        QUrl url(SCREEN_ME_HOST + "/api/screenshot");
-        QNetworkRequest request(url);
+    QString jsonStr = loadLoginInfo();
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonStr.toUtf8());
+    QJsonObject loginInfo = jsonDoc.object();
+
+    std::unique_ptr<QProgressDialog> progressDialog(new QProgressDialog("Publishing screenshot", "Cancel", 0, 100, this));
+    progressDialog->setWindowModality(Qt::WindowModal);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->show();
+
+    // Position the progress dialog at the bottom right of the screen
+    QRect screenGeometry = QApplication::primaryScreen()->geometry();
+    QSize progressDialogSize = progressDialog->sizeHint();
+    progressDialog->move(screenGeometry.bottomRight() - QPoint(progressDialogSize.width() + 10, progressDialogSize.height() + 100));
+
+    const bool supportsPrivacy = backend->supportsPrivacy();
+    ScreenMeBackend* screenMe = qobject_cast<ScreenMeBackend*>(backend.get());
+    const QString host = screenMe ? screenMe->host() : screenMeHost();
+    // Republishing identical bytes returns the existing link without uploading
+    UploadTask* task = backend->publish(encoded.source, UploadPriority::Interactive);
+
+    QProgressDialog* dialog = progressDialog.get();
+    connect(dialog, &QProgressDialog::canceled, task, &UploadTask::cancel);
+
+    connect(task, &UploadTask::progress, dialog, [dialog](qint64 bytesSent, qint64 bytesTotal) {
+        if (bytesTotal > 0) {
+            dialog->setMaximum(bytesTotal);
+            dialog->setValue(bytesSent);
+        }
+    });
 
-        request.setRawHeader("Authorization", "Bearer " + loginInfo["token"].toString().toUtf8());
+    dialog->setProperty("status", "Publishing screenshot");
+    connect(scheduler, &UploadScheduler::statsChanged, dialog, [dialog](const UploadScheduler::Stats& stats) {
+        if (stats.bytesPerSecond > 0) {
+            dialog->setLabelText(QString("%1 (%2 KB/s)").arg(dialog->property("status").toString())
+                .arg(qRound(stats.bytesPerSecond / 1024)));
+        }
+    });
 
-        QHttpMultiPart* multiPart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+    // Link-first publishing: the link is shareable while the image is still uploading
+    connect(task, &UploadTask::linkReady, dialog, [dialog](const QString& link) {
+        QApplication::clipboard()->setText(link);
+        dialog->setProperty("status", "Link copied, uploading");
+        dialog->setLabelText("Link copied, uploading");
+    });
+    connect(task, &UploadTask::previewPublished, dialog, [dialog]() {
+        dialog->setProperty("status", "Preview online, uploading full resolution");
+        dialog->setLabelText("Preview online, uploading full resolution");
+    });
 
-        QHttpPart imagePart;
-        imagePart.setHeader(QNetworkRequest::ContentTypeHeader, QVariant("image/png"));
-        imagePart.setHeader(QNetworkRequest::ContentDispositionHeader, QVariant("form-data; name=\"screenshot\"; filename=\"screenshot.png\""));
+    const UploadResult result = co_await Async::signal(task, &UploadTask::finished, [task]() { task->cancel(); });
+    progressDialog->close();
+    if (co_await Async::canceled()) {
+        co_return;
+    }
 
-        QFile* file = new QFile(tempFilePath);
-        if (!file->open(QIODevice::ReadOnly)) {
-            QMessageBox::critical(this, "Error", "Failed to open the image file for upload.");
-            return;
+    if (result.canceled) {
+        emit screenshotClosed();
+        co_return;
+    }
+    if (result.success) {
+        QString id = result.id;
+        QString link = result.link;
+
+        QMessageBox msgBox(this);
+        msgBox.setWindowTitle("Screenshot Uploaded");
+        msgBox.setText(result.deduplicated
+            ? "This screenshot was already published ! Link: " + link
+            : "Screenshot uploaded successfully ! Link: " + link);
+        QPushButton* copyButton = msgBox.addButton(tr("Copy"), QMessageBox::ActionRole);
+        msgBox.addButton(QMessageBox::Ok);
+
+        QCheckBox* privateCheckBox = nullptr;
+        if (supportsPrivacy) {
+            privateCheckBox = new QCheckBox("Private", &msgBox);
+            msgBox.setCheckBox(privateCheckBox);
+
+            // Debounced on the shared client, only the state the box ends in is sent
+            connect(privateCheckBox, &QCheckBox::toggled, this, [id, loginInfo, host](bool checked) {
+                PrivacyUpdater::instance()->setPrivacy(host, loginInfo["token"].toString().toUtf8(), id, checked);
+            });
         }
-        imagePart.setBodyDevice(file);
-        file->setParent(multiPart);
 
-        multiPart->append(imagePart);
+        connect(copyButton, &QPushButton::clicked, [link]() {
+            QClipboard* clipboard = QGuiApplication::clipboard();
+            clipboard->setText(link);
+        });
 
-        QProgressDialog* progressDialog = new QProgressDialog("Publishing screenshot", "Cancel", 0, 100, this);
-        progressDialog->setWindowModality(Qt::WindowModal);
-        progressDialog->setAutoClose(false);
-        progressDialog->setAutoReset(false);
-        progressDialog->show();
+        // Position the message box at the bottom right of the screen
+        msgBox.show();
+        QSize msgBoxSize = msgBox.sizeHint();
+        msgBox.move(screenGeometry.bottomRight() - QPoint(msgBoxSize.width() + 10, msgBoxSize.height() + 100));
+        msgBox.exec();
+    }
+    else {
+        qDebug() << "Upload Failed:" << result.error;
+        if (result.httpStatus == 403 || result.error.contains("Forbidden")) {
+            QMessageBox::critical(this, "Upload Failed", "Failed to upload screenshot: " + result.error + "\nPlease try to log in again.");
+        }
+        else {
+            QMessageBox::critical(this, "Upload Failed", "Failed to upload screenshot: " + result.error);
+        }
+    }
+    emit screenshotClosed();
+}
 
-        // Position the progress dialog at the bottom right of the screen
-        QRect screenGeometry = QApplication::primaryScreen()->geometry();
-        QSize progressDialogSize = progressDialog->sizeHint();
-        progressDialog->move(screenGeometry.bottomRight() - QPoint(progressDialogSize.width() + 10, progressDialogSize.height() + 100));
 
-        QNetworkReply* reply = manager->post(request, multiPart);
-        multiPart->setParent(reply);
+void ScreenshotDisplay::onScrollCaptureRequested() {
+    if (!selectionRect.isValid() || scrollCapture) {
+        return;
+    }
+    finishTextEditing();
 
-        connect(progressDialog, &QProgressDialog::canceled, reply, &QNetworkReply::abort);
+    // The overlay has to go away so the user can scroll the window below the selection
+    editor->hide();
+    hideOverlays();
+
+    // Frames are grabbed from one screen, the one holding most of the selection
+    ScreenOverlay* overlay = overlayAt(selectionRect.center());
+    const QRect screenRect = overlay->area();
+    scrollCapture.reset(new ScrollingCapture(overlay->screen(), selectionRect.intersected(screenRect).translated(-screenRect.topLeft())));
+
+    scrollCaptureBar = new QWidget(nullptr, Qt::Tool | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint);
+    scrollCaptureBar->setAttribute(Qt::WA_DeleteOnClose);
+    QHBoxLayout* barLayout = new QHBoxLayout(scrollCaptureBar);
+    QLabel* heightLabel = new QLabel("Scroll the page slowly...", scrollCaptureBar);
+    QPushButton* doneButton = new QPushButton("Done", scrollCaptureBar);
+    QPushButton* cancelButton = new QPushButton("Cancel", scrollCaptureBar);
+    barLayout->addWidget(heightLabel);
+    barLayout->addWidget(doneButton);
+    barLayout->addWidget(cancelButton);
+
+    connect(scrollCapture.get(), &ScrollingCapture::progress, heightLabel, [heightLabel](int capturedHeight) {
+        heightLabel->setText(QString("Captured %1 px").arg(capturedHeight));
+    });
+    connect(scrollCapture.get(), &ScrollingCapture::frameLost, heightLabel, [heightLabel]() {
+        heightLabel->setText("Scrolled too fast, scroll back a little");
+    });
+    connect(scrollCapture.get(), &ScrollingCapture::limitReached, this, &ScreenshotDisplay::finishScrollCapture);
+    connect(doneButton, &QPushButton::clicked, this, &ScreenshotDisplay::finishScrollCapture);
+    connect(cancelButton, &QPushButton::clicked, this, &ScreenshotDisplay::close);
+
+    // Keep the bar outside of the grabbed region, below it when there is room
+    QSize barSize = scrollCaptureBar->sizeHint();
+    QPoint barPos = selectionRect.bottomLeft() + QPoint(0, 10);
+    if (barPos.y() + barSize.height() > screenRect.y() + screenRect.height()) {
+        barPos.setY(qMax(screenRect.y(), selectionRect.top() - barSize.height() - 10));
+    }
+    scrollCaptureBar->move(barPos + desktopOrigin);
+    scrollCaptureBar->show();
 
-        connect(reply, &QNetworkReply::uploadProgress, this, [progressDialog](qint64 bytesSent, qint64 bytesTotal) {
-            if (bytesTotal > 0) {
-                progressDialog->setMaximum(bytesTotal);
-                progressDialog->setValue(bytesSent);
-            }
-        });
+    // Grabbing right away would stitch the frozen overlay in as the first frame
+    QTimer::singleShot(ScrollCaptureStartDelayMs, scrollCapture.get(), &ScrollingCapture::start);
+}
 
-        connect(reply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::errorOccurred), this, [reply]() {
-            qDebug() << "Network Error:" << reply->errorString();
-        });
+void ScreenshotDisplay::finishScrollCapture() {
+    if (!scrollCapture) {
+        return;
+    }
+    QImage stitchedImage = scrollCapture->finish();
+    if (scrollCaptureBar) {
+        scrollCaptureBar->close();
+    }
 
-        connect(reply, &QNetworkReply::finished, this, [reply, file, tempFilePath, this, progressDialog, screenGeometry, loginInfo]() {
-            progressDialog->close();
-
-            if (reply->error() == QNetworkReply::NoError) {
-                QByteArray response = reply->readAll();
-                QJsonDocument jsonResponse = QJsonDocument::fromJson(response);
-                QJsonObject jsonObject = jsonResponse.object();
-                QString url = jsonObject["url"].toString();
-                QString id = QString::number(jsonObject["id"].toInt());
-                QString link = SCREEN_ME_HOST + "/" + url;
-
-                QMessageBox msgBox(this);
-                msgBox.setWindowTitle("Screenshot Uploaded");
-                msgBox.setText("Screenshot uploaded successfully ! Link: " + link);
-                QPushButton* copyButton = msgBox.addButton(tr("Copy"), QMessageBox::ActionRole);
-                msgBox.addButton(QMessageBox::Ok);
-
-                QCheckBox* privateCheckBox = nullptr;
-                if (!loginInfo["token"].toString().isEmpty()) {
-                    privateCheckBox = new QCheckBox("Private", &msgBox);
-                    msgBox.setCheckBox(privateCheckBox);
-
-                    connect(privateCheckBox, &QCheckBox::toggled, this, [id, loginInfo](bool checked) {
-                        QNetworkAccessManager* manager = new QNetworkAccessManager();
-                        QUrl url(SCREEN_ME_HOST + "/api/screenshot/" + id);
-                        QNetworkRequest request(url);
-
-                        request.setRawHeader("Authorization", "Bearer " + loginInfo["token"].toString().toUtf8());
-                        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-
-                        QJsonObject json;
-                        json["privacy"] = checked ? "private" : "public";
-                        QJsonDocument doc(json);
-                        QByteArray data = doc.toJson();
-
-                        QNetworkReply* reply = manager->sendCustomRequest(request, "PATCH", data);
-                        connect(reply, &QNetworkReply::finished, reply, &QNetworkReply::deleteLater);
-                    });
-                }
-
-                connect(copyButton, &QPushButton::clicked, [link]() {
-                    QClipboard* clipboard = QGuiApplication::clipboard();
-                    clipboard->setText(link);
-                });
-
-                // Position the message box at the bottom right of the screen
-                msgBox.show();
-                QSize msgBoxSize = msgBox.sizeHint();
-                msgBox.move(screenGeometry.bottomRight() - QPoint(msgBoxSize.width() + 10, msgBoxSize.height() + 100));
-                msgBox.exec();
-            }
-            else {
-                QString errorString = reply->errorString();
-                qDebug() << "Upload Failed:" << errorString;
-                QString serverReply = errorString.section("server replied: ", 1, 1);
-                if (serverReply.contains("Forbidden")) {
-                    QMessageBox::critical(this, "Upload Failed", "Failed to upload screenshot: " + serverReply + "\nPlease try to log in again.");
-                }
-                else {
-                    QMessageBox::critical(this, "Upload Failed", "Failed to upload screenshot: " + serverReply);
-                }
-            }
-            reply->deleteLater();
-            file->deleteLater();
-            QFile::remove(tempFilePath);
-            delete progressDialog;
+    if (!stitchedImage.isNull()) {
+        QApplication::clipboard()->setMimeData(new LazyImageMimeData(stitchedImage));
 
-            emit screenshotClosed();
-        });
+        QJsonObject config = configManager->loadConfig();
+        QString extension = ContentClassifier::chooseExtension(stitchedImage, config["file_extension"].toString());
+        QString filePath = getUniqueFilePath(config["default_save_folder"].toString(), "scrolling_screenshot", extension);
+        if (saveCapture(stitchedImage, filePath, config["image_quality"].toInt())) {
+            CaptureSearch::instance()->addCapture(filePath);
+            emit captureSaved(filePath, stitchedImage);
+        }
     }
+    close();
 }
 
-
 void ScreenshotDisplay::onCloseRequested() {
     close();
 }
 
 void ScreenshotDisplay::copySelectionToClipboard() {
-    QPixmap resultPixmap = originalPixmap;
-    QPainter painter(&resultPixmap);
-    painter.drawPixmap(0, 0, drawingPixmap);
+    // Formats are only encoded when something actually pastes, see LazyImageMimeData
+    QApplication::clipboard()->setMimeData(new LazyImageMimeData(renderSelection()));
+    close();
+}
 
-    if (selectionRect.isValid()) {
-        QPixmap selectedPixmap = resultPixmap.copy(selectionRect);
-        QApplication::clipboard()->setPixmap(selectedPixmap);
+QImage ScreenshotDisplay::renderSelection() {
+    // Only the selected area is composed out of the screens, not the whole virtual desktop
+    return layers.render(selectionRect.isValid() ? selectionRect : desktopRect);
+}
+
+bool ScreenshotDisplay::exportVector(const QString& filePath) {
+    const QRect area = selectionRect.isValid() ? selectionRect : desktopRect;
+    // Redactions are baked into the embedded raster so the hidden pixels never reach the file
+    const QImage raster = layers.render(area, LayerStack::Redactions);
+    if (raster.isNull()) {
+        return false;
     }
-    else {
-        QApplication::clipboard()->setPixmap(resultPixmap);
+
+    QVector<Annotation> annotations;
+    for (LayerStack::LayerId layer : { LayerStack::Highlights, LayerStack::Shapes, LayerStack::Text }) {
+        annotations += layers.annotations(layer);
     }
-    close();
+    return VectorExport::write(filePath, raster, annotations, area);
+}
+
+QImage ScreenshotDisplay::applyExportSize(const QImage& image, const QJsonObject& config) {
+    QSize size = ImageResampler::exportSize(image.size(), config["export_max_dimension"].toInt(0),
+        config["export_scale_percent"].toInt(100));
+    if (size == image.size()) {
+        return image;
+    }
+    return ImageResampler::downscale(image, size);
 }
 
 void ScreenshotDisplay::updateTooltip() {
     if (selectionRect.isValid()) {
         QString tooltipText = QString("Size: %1 x %2").arg(selectionRect.width()).arg(selectionRect.height());
         QPoint tooltipPosition = selectionRect.topRight() + QPoint(10, -20);
-        QToolTip::showText(mapToGlobal(tooltipPosition), tooltipText, this);
+        QToolTip::showText(tooltipPosition + desktopOrigin, tooltipText, overlayAt(selectionRect.topRight()));
     }
 }
 
@@ -577,7 +899,6 @@ ScreenshotDisplay::HandlePosition ScreenshotDisplay::handleAtPoint(const QPoint&
 }
 
 void ScreenshotDisplay::resizeSelection(const QPoint& point) {
-    QRect screenRect = QApplication::primaryScreen()->geometry();
     QRect newRect = selectionRect;
 
     switch (currentHandle) {
@@ -609,7 +930,7 @@ void ScreenshotDisplay::resizeSelection(const QPoint& point) {
         break;
     }
 
-    newRect = newRect.normalized().intersected(screenRect);
+    newRect = newRect.normalized().intersected(desktopRect);
 
     selectionRect = newRect;
 }
@@ -634,8 +955,9 @@ Qt::CursorShape ScreenshotDisplay::cursorForHandle(HandlePosition handle) {
 }
 
 void ScreenshotDisplay::onToolSelected(Editor::Tool tool) {
+    finishTextEditing();
     currentTool = tool;
-    setCursor(tool == Editor::None ? Qt::ArrowCursor : Qt::CrossCursor);
+    setOverlayCursor(tool == Editor::None ? Qt::ArrowCursor : Qt::CrossCursor);
 }
 
 void ScreenshotDisplay::updateEditorPosition() {
@@ -643,83 +965,226 @@ void ScreenshotDisplay::updateEditorPosition() {
         const int margin = 10;
         QPoint editorPos = selectionRect.topRight() + QPoint(margin, margin);
 
-        QRect screenRect = QApplication::primaryScreen()->geometry();
+        // Kept on the screen the selection's corner is on
+        QRect screenRect = overlayAt(selectionRect.topRight())->area();
         QSize editorSize = editor->sizeHint();
 
-        if (editorPos.x() + editorSize.width() > screenRect.width()) {
-            editorPos.setX(screenRect.width() - editorSize.width() - margin);
+        if (editorPos.x() + editorSize.width() > screenRect.x() + screenRect.width()) {
+            editorPos.setX(screenRect.x() + screenRect.width() - editorSize.width() - margin);
         }
-        if (editorPos.y() + editorSize.height() > screenRect.height()) {
-            editorPos.setY(screenRect.height() - editorSize.height() - margin);
+        if (editorPos.y() + editorSize.height() > screenRect.y() + screenRect.height()) {
+            editorPos.setY(screenRect.y() + screenRect.height() - editorSize.height() - margin);
         }
-        editor->move(editorPos);
+        editor->move(editorPos + desktopOrigin);
     }
 }
 
-void ScreenshotDisplay::drawArrow(QPainter& painter, const QPoint& start, const QPoint& end) {
-    painter.drawLine(start, end);
+void ScreenshotDisplay::drawBorderCircle(QPainter& painter, const QPoint& position) {
+    painter.setPen(QPen(editor->getCurrentColor(), 2, Qt::SolidLine));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawEllipse(position, borderWidth, borderWidth);
+}
 
-    double angle = std::atan2(start.y() - end.y(), start.x() - end.x());
+int ScreenshotDisplay::textAnnotationAt(const QPoint& point) const {
+    const QVector<Annotation>& texts = layers.annotations(LayerStack::Text);
+    for (int i = texts.size() - 1; i >= 0; --i) {
+        if (texts.at(i).bounds().contains(point)) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    const double arrowHeadLength = borderWidth * 2;
-    const double arrowHeadAngle = M_PI / 6;
+void ScreenshotDisplay::beginTextEditing(int index, bool isNew) {
+    const Annotation& edited = layers.annotations(LayerStack::Text).at(index);
+    editingText = index;
+    editingNewText = isNew;
+    editSnapshotTaken = false;
+    textCursor = edited.text.size();
+    currentFont = edited.font;
+    preeditText.clear();
+    // The overlay asks again whether input methods apply, and where the caret is
+    QGuiApplication::inputMethod()->update(Qt::ImQueryAll);
+    updateOverlays();
+}
 
-    QPoint arrowP1 = end + QPoint(std::cos(angle + arrowHeadAngle) * arrowHeadLength,
-        std::sin(angle + arrowHeadAngle) * arrowHeadLength);
-    QPoint arrowP2 = end + QPoint(std::cos(angle - arrowHeadAngle) * arrowHeadLength,
-        std::sin(angle - arrowHeadAngle) * arrowHeadLength);
+void ScreenshotDisplay::applyTextEdit(const Annotation& edited) {
+    // A new text is undone as a whole, an existing one gets one undo step per editing session
+    layers.updateAnnotation(LayerStack::Text, editingText, edited, !editingNewText && !editSnapshotTaken);
+    editSnapshotTaken = true;
+    QGuiApplication::inputMethod()->update(Qt::ImCursorRectangle);
+    updateOverlays();
+}
 
-    QPolygon arrowHead;
-    arrowHead << end << arrowP1 << arrowP2;
+bool ScreenshotDisplay::editTextWithKey(QKeyEvent* event) {
+    Annotation edited = layers.annotations(LayerStack::Text).at(editingText);
+    QString& content = edited.text;
+
+    if (event->matches(QKeySequence::Paste)) {
+        QString pasted = QApplication::clipboard()->text();
+        pasted.replace("\r\n", "\n");
+        content.insert(textCursor, pasted);
+        textCursor += pasted.size();
+        applyTextEdit(edited);
+        return true;
+    }
 
-    painter.setBrush(QBrush(editor->getCurrentColor()));
-    painter.drawPolygon(arrowHead);
-}
+    switch (event->key()) {
+    case Qt::Key_Escape:
+        return false;
+    case Qt::Key_Left:
+        textCursor = qMax(0, textCursor - 1);
+        updateOverlays();
+        return true;
+    case Qt::Key_Right:
+        textCursor = qMin(int(content.size()), textCursor + 1);
+        updateOverlays();
+        return true;
+    case Qt::Key_Home:
+        textCursor = textCursor > 0 ? content.lastIndexOf('\n', textCursor - 1) + 1 : 0;
+        updateOverlays();
+        return true;
+    case Qt::Key_End: {
+        int lineEnd = content.indexOf('\n', textCursor);
+        textCursor = lineEnd < 0 ? content.size() : lineEnd;
+        updateOverlays();
+        return true;
+    }
+    case Qt::Key_Backspace:
+        if (textCursor == 0) {
+            return true;
+        }
+        content.remove(--textCursor, 1);
+        break;
+    case Qt::Key_Delete:
+        if (textCursor >= content.size()) {
+            return true;
+        }
+        content.remove(textCursor, 1);
+        break;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        content.insert(textCursor++, '\n');
+        break;
+    default: {
+        QString typed = event->text();
+        if (typed.isEmpty() || !typed.at(0).isPrint() || (event->modifiers() & Qt::ControlModifier)) {
+            return false;
+        }
+        content.insert(textCursor, typed);
+        textCursor += typed.size();
+        break;
+    }
+    }
 
-void ScreenshotDisplay::drawBorderCircle(QPainter& painter, const QPoint& position) {
-    painter.setPen(QPen(editor->getCurrentColor(), 2, Qt::SolidLine));
-    painter.setBrush(Qt::NoBrush);
-    painter.drawEllipse(position, borderWidth, borderWidth);
+    applyTextEdit(edited);
+    return true;
 }
 
-void ScreenshotDisplay::adjustTextEditSize() {
-    QFontMetrics fm(textEdit->font());
-    int width = fm.horizontalAdvance(textEdit->toPlainText().replace('\n', ' ')) + 10;
-    textEdit->setFixedSize(width, textEdit->height());
+void ScreenshotDisplay::finishTextEditing() {
+    if (editingText < 0) {
+        return;
+    }
+    const int index = editingText;
+    const bool discard = editingNewText && layers.annotations(LayerStack::Text).at(index).text.isEmpty();
+    editingText = -1;
+    preeditText.clear();
+    if (discard) {
+        // Nothing was typed, drop the empty text added when editing started
+        layers.removeAnnotation(LayerStack::Text, index);
+    }
+    QGuiApplication::inputMethod()->update(Qt::ImQueryAll);
+    updateOverlays();
 }
 
-void ScreenshotDisplay::finalizeTextEdit() {
-    if (textEdit) {
-        saveStateForUndo();
-        QPainter painter(&drawingPixmap);
-        painter.setFont(textEdit->font());
-        painter.setPen(QPen(editor->getCurrentColor()));
+QRect ScreenshotDisplay::textCaretRect() const {
+    const Annotation& edited = layers.annotations(LayerStack::Text).at(editingText);
+    const int line = edited.text.left(textCursor).count('\n');
+    const int lineStart = textCursor > 0 ? edited.text.lastIndexOf('\n', textCursor - 1) + 1 : 0;
 
-        QFontMetrics fm(textEdit->font());
-        QStringList lines = textEdit->toPlainText().split('\n');
-        QPoint currentPos = textEditPosition;
+    QFontMetrics fm(edited.font);
+    QPoint caret = edited.start + QPoint(fm.horizontalAdvance(edited.text.mid(lineStart, textCursor - lineStart)),
+        line * edited.lineHeight());
+    return QRect(caret, QSize(1, edited.lineHeight()));
+}
 
-        currentPos.setY(currentPos.y() + fm.ascent());
+void ScreenshotDisplay::drawTextCursor(QPainter& painter) {
+    const Annotation& edited = layers.annotations(LayerStack::Text).at(editingText);
+    const QRect caret = textCaretRect();
 
-        for (const QString& line : lines) {
-            painter.drawText(currentPos, line);
-            currentPos.setY(currentPos.y() + fm.height());
-        }
+    painter.setPen(QPen(Qt::gray, 1, Qt::DashLine));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawRect(edited.bounds());
+    if (!preeditText.isEmpty()) {
+        // Composition in progress, shown underlined at the caret until the IME commits it
+        QFont font = edited.font;
+        font.setUnderline(true);
+        painter.setFont(font);
+        painter.setPen(edited.color);
+        painter.drawText(caret.topLeft() + QPoint(0, QFontMetrics(font).ascent()), preeditText);
+        return;
+    }
+    painter.setPen(QPen(edited.color, 2));
+    painter.drawLine(caret.topLeft(), caret.bottomLeft());
+}
 
-        textEdit->deleteLater();
-        textEdit = nullptr;
-        update();
+void ScreenshotDisplay::inputMethodEvent(QInputMethodEvent* event) {
+    if (editingText < 0) {
+        event->ignore();
+        return;
+    }
+    Annotation edited = layers.annotations(LayerStack::Text).at(editingText);
+    QString& content = edited.text;
+    // The replacement is relative to the cursor, for IMEs that correct what they committed
+    if (event->replacementLength() > 0) {
+        const int from = qBound(0, textCursor + event->replacementStart(), int(content.size()));
+        content.remove(from, qMin(event->replacementLength(), int(content.size()) - from));
+        textCursor = from;
+    }
+    const QString committed = event->commitString();
+    content.insert(textCursor, committed);
+    textCursor += committed.size();
+    preeditText = event->preeditString();
+    if (committed.isEmpty() && event->replacementLength() == 0) {
+        updateOverlays();
     }
+    else {
+        applyTextEdit(edited);
+    }
+    event->accept();
 }
 
-void ScreenshotDisplay::saveStateForUndo() {
-    undoStack.push(drawingPixmap);
+QVariant ScreenshotDisplay::inputMethodQuery(Qt::InputMethodQuery query) const {
+    if (editingText < 0) {
+        return query == Qt::ImEnabled ? QVariant(false) : QVariant();
+    }
+    const Annotation& edited = layers.annotations(LayerStack::Text).at(editingText);
+    switch (query) {
+    case Qt::ImEnabled:
+        return true;
+    case Qt::ImCursorRectangle:
+        return textCaretRect();
+    case Qt::ImFont:
+        return edited.font;
+    case Qt::ImSurroundingText:
+        return edited.text;
+    case Qt::ImCursorPosition:
+    case Qt::ImAnchorPosition:
+        return textCursor;
+    default:
+        return QVariant();
+    }
 }
 
 void ScreenshotDisplay::undo() {
-    if (!undoStack.empty()) {
-        drawingPixmap = undoStack.top();
-        undoStack.pop();
-        update();
+    if (editingText >= 0) {
+        const bool placeholder = editingNewText && layers.annotations(LayerStack::Text).at(editingText).text.isEmpty();
+        finishTextEditing();
+        if (placeholder) {
+            return;
+        }
+    }
+    if (layers.undo()) {
+        updateOverlays();
     }
 }
@@ -0,0 +1,204 @@
+#include "include/scrolling_capture.h"
+#include <QPixmap>
+#include <QMultiHash>
+#include <cstring>
+
+namespace {
+    const int GrabIntervalMs = 120;
+    // Most image viewers and QPainter itself stop coping well past this height
+    const int MaxStitchedHeight = 32000;
+    const int MaxWindowRows = 32;
+    const int MaxCandidates = 64;
+    const double MinOverlapMatch = 0.9;
+    const quint64 WindowBase = 0x100000001B3ULL;
+
+    quint64 mixRow(quint64 hash, quint64 word) {
+        hash ^= word;
+        hash *= 0x9E3779B97F4A7C15ULL;
+        return hash ^ (hash >> 29);
+    }
+
+    // Rolling polynomial hash over `window` consecutive row hashes, one value per start row
+    QVector<quint64> windowHashes(const QVector<quint64>& rows, int window) {
+        QVector<quint64> result;
+        if (rows.size() < window) {
+            return result;
+        }
+        result.resize(rows.size() - window + 1);
+
+        quint64 highestPower = 1;
+        for (int i = 1; i < window; ++i) {
+            highestPower *= WindowBase;
+        }
+
+        quint64 hash = 0;
+        for (int i = 0; i < window; ++i) {
+            hash = hash * WindowBase + rows[i];
+        }
+        result[0] = hash;
+        for (int i = 1; i < result.size(); ++i) {
+            hash = (hash - rows[i - 1] * highestPower) * WindowBase + rows[i + window - 1];
+            result[i] = hash;
+        }
+        return result;
+    }
+
+    // Uniform bands (blank margins, solid backgrounds) match everywhere and are useless as anchors
+    bool isDistinctive(const QVector<quint64>& rows, int start, int window) {
+        int changes = 0;
+        for (int i = start + 1; i < start + window; ++i) {
+            if (rows[i] != rows[i - 1]) {
+                ++changes;
+            }
+        }
+        return changes >= window / 4;
+    }
+}
+
+ScrollingCapture::ScrollingCapture(QScreen* screen, const QRect& region, QObject* parent)
+    : QObject(parent), screen(screen), region(region) {
+    timer.setInterval(GrabIntervalMs);
+    connect(&timer, &QTimer::timeout, this, &ScrollingCapture::grabFrame);
+}
+
+void ScrollingCapture::start() {
+    stitched.clear();
+    lastHashes.clear();
+    grabFrame();
+    timer.start();
+}
+
+QImage ScrollingCapture::finish() {
+    timer.stop();
+    // Tiles are released as they are copied, the capture is never held twice
+    QImage result = stitched.takeImage();
+    lastHashes.clear();
+    return result;
+}
+
+void ScrollingCapture::cancel() {
+    timer.stop();
+    stitched.clear();
+    lastHashes.clear();
+}
+
+QVector<quint64> ScrollingCapture::rowHashes(const QImage& image) {
+    QVector<quint64> hashes(image.height());
+    const qsizetype rowBytes = qsizetype(image.width()) * image.depth() / 8;
+    const qsizetype wordCount = rowBytes / sizeof(quint64);
+
+    for (int y = 0; y < image.height(); ++y) {
+        const uchar* line = image.constScanLine(y);
+        quint64 hash = 0xCBF29CE484222325ULL;
+        for (qsizetype i = 0; i < wordCount; ++i) {
+            quint64 word;
+            std::memcpy(&word, line + i * sizeof(quint64), sizeof(word));
+            hash = mixRow(hash, word);
+        }
+        for (qsizetype i = wordCount * sizeof(quint64); i < rowBytes; ++i) {
+            hash = mixRow(hash, line[i]);
+        }
+        hashes[y] = hash;
+    }
+    return hashes;
+}
+
+int ScrollingCapture::findScrollOffset(const QVector<quint64>& previous, const QVector<quint64>& next) {
+    if (previous.size() != next.size() || previous.isEmpty()) {
+        return -1;
+    }
+    if (previous == next) {
+        return 0;
+    }
+
+    const int rows = previous.size();
+    const int window = qBound(1, rows / 4, MaxWindowRows);
+    QVector<quint64> previousWindows = windowHashes(previous, window);
+    QVector<quint64> nextWindows = windowHashes(next, window);
+    if (previousWindows.isEmpty()) {
+        return -1;
+    }
+
+    QMultiHash<quint64, int> previousIndex;
+    previousIndex.reserve(previousWindows.size());
+    for (int i = 0; i < previousWindows.size(); ++i) {
+        previousIndex.insert(previousWindows[i], i);
+    }
+
+    // Content scrolls up, so the top of the new frame is found further down in the old one.
+    // Anchors are taken from the top of the new frame; several are tried in case a sticky
+    // header or an animated element sits there.
+    int bestOffset = -1;
+    for (int anchor = 0; anchor < nextWindows.size() && bestOffset < 0; anchor += qMax(1, window / 2)) {
+        if (!isDistinctive(next, anchor, window)) {
+            continue;
+        }
+
+        int candidates = 0;
+        for (auto it = previousIndex.constFind(nextWindows[anchor]);
+            it != previousIndex.constEnd() && it.key() == nextWindows[anchor] && candidates < MaxCandidates;
+            ++it, ++candidates) {
+            int offset = it.value() - anchor;
+            if (offset < 0 || (bestOffset >= 0 && offset >= bestOffset)) {
+                continue;
+            }
+
+            const int overlap = rows - offset;
+            int matches = 0;
+            for (int i = 0; i < overlap; ++i) {
+                if (previous[offset + i] == next[i]) {
+                    ++matches;
+                }
+            }
+            if (overlap >= window && matches >= overlap * MinOverlapMatch) {
+                bestOffset = offset;
+            }
+        }
+    }
+    return bestOffset;
+}
+
+void ScrollingCapture::grabFrame() {
+    if (!screen) {
+        timer.stop();
+        return;
+    }
+
+    QImage frame = screen->grabWindow(0, region.x(), region.y(), region.width(), region.height())
+        .toImage().convertToFormat(QImage::Format_ARGB32);
+    if (frame.isNull()) {
+        return;
+    }
+    QVector<quint64> hashes = rowHashes(frame);
+
+    if (stitched.isEmpty()) {
+        stitched = TiledImage(frame.width(), frame.format());
+        stitched.appendRows(frame, 0, frame.height());
+        lastHashes = hashes;
+        emit progress(stitched.height());
+        return;
+    }
+    if (frame.width() != stitched.width()) {
+        return;
+    }
+
+    int offset = findScrollOffset(lastHashes, hashes);
+    if (offset < 0) {
+        // Scrolled further than one frame between two grabs, keep the last good frame as reference
+        emit frameLost();
+        return;
+    }
+    if (offset == 0) {
+        return;
+    }
+
+    int newRows = qMin(offset, MaxStitchedHeight - stitched.height());
+    stitched.appendRows(frame, frame.height() - offset, newRows);
+    lastHashes = hashes;
+    emit progress(stitched.height());
+
+    if (stitched.height() >= MaxStitchedHeight) {
+        timer.stop();
+        emit limitReached();
+    }
+}
@@ -0,0 +1,44 @@
+#include "include/tiled_image.h"
+#include <cstring>
+
+TiledImage::TiledImage(int width, QImage::Format format, int tileHeight)
+    : imageWidth(width), tileHeight(tileHeight), totalRows(0), format(format) {}
+
+void TiledImage::appendRows(const QImage& source, int firstRow, int rowCount) {
+    Q_ASSERT(source.width() == imageWidth && source.format() == format);
+    rowCount = qMin(rowCount, source.height() - firstRow);
+    const qsizetype rowBytes = qsizetype(imageWidth) * source.depth() / 8;
+
+    for (int row = 0; row < rowCount; ++row) {
+        int tileRow = totalRows % tileHeight;
+        if (tileRow == 0) {
+            tiles.append(QImage(imageWidth, tileHeight, format));
+        }
+        std::memcpy(tiles.last().scanLine(tileRow), source.constScanLine(firstRow + row), rowBytes);
+        ++totalRows;
+    }
+}
+
+QImage TiledImage::takeImage() {
+    if (totalRows == 0) {
+        return QImage();
+    }
+
+    QImage result(imageWidth, totalRows, format);
+    const qsizetype rowBytes = qsizetype(imageWidth) * result.depth() / 8;
+    int row = 0;
+    while (!tiles.isEmpty()) {
+        const QImage tile = tiles.takeFirst();
+        const int tileRows = qMin(tileHeight, totalRows - row);
+        for (int tileRow = 0; tileRow < tileRows; ++tileRow, ++row) {
+            std::memcpy(result.scanLine(row), tile.constScanLine(tileRow), rowBytes);
+        }
+    }
+    totalRows = 0;
+    return result;
+}
+
+void TiledImage::clear() {
+    tiles.clear();
+    totalRows = 0;
+}
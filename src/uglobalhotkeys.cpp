@@ -5,6 +5,7 @@
 #include <QWindow>
 #include <qpa/qplatformnativeinterface.h>
 #include <QApplication>
+#include "include/evdev_hotkeys.h"
 #endif
 
 #include "include/hotkeymap.h"
@@ -15,12 +16,28 @@ UGlobalHotkeys::UGlobalHotkeys(QWidget *parent)
 {
     //qApp->installNativeEventFilter((QAbstractNativeEventFilter*)this);
     #if defined(Q_OS_LINUX)
-    qApp->installNativeEventFilter(this);
-    QWindow wndw;
-    void* v = qApp->platformNativeInterface()->nativeResourceForWindow("connection", &wndw);
-    X11Connection = (xcb_connection_t*)v;
-    X11Wid = xcb_setup_roots_iterator(xcb_get_setup(X11Connection)).data->root;
-    X11KeySymbs = xcb_key_symbols_alloc(X11Connection);
+    Evdev = nullptr;
+    X11Connection = nullptr;
+    X11KeySymbs = nullptr;
+    if (QGuiApplication::platformName() == "xcb") {
+        QWindow wndw;
+        void* v = qApp->platformNativeInterface()->nativeResourceForWindow("connection", &wndw);
+        X11Connection = (xcb_connection_t*)v;
+    }
+    // SCREENME_HOTKEY_BACKEND=evdev|x11 overrides the choice; without X there are no grabs
+    const QByteArray backend = qgetenv("SCREENME_HOTKEY_BACKEND");
+    if (backend == "evdev" || (backend != "x11" && !X11Connection)) {
+        Evdev = new EvdevHotkeys([this](size_t id) { emit activated(id); });
+        if (!Evdev->start() && X11Connection) {
+            delete Evdev;
+            Evdev = nullptr;
+        }
+    }
+    if (!Evdev && X11Connection) {
+        qApp->installNativeEventFilter(this);
+        X11Wid = xcb_setup_roots_iterator(xcb_get_setup(X11Connection)).data->root;
+        X11KeySymbs = xcb_key_symbols_alloc(X11Connection);
+    }
     #endif
 }
 
@@ -137,7 +154,10 @@ UGlobalHotkeys::~UGlobalHotkeys() {
         UnregisterHotKey((HWND)winId(), *i);
     }
     #elif defined(Q_OS_LINUX)
-    xcb_key_symbols_free(X11KeySymbs);
+    delete Evdev;
+    if (X11KeySymbs) {
+        xcb_key_symbols_free(X11KeySymbs);
+    }
     #endif
 }
 
@@ -189,6 +209,17 @@ bool UGlobalHotkeys::linuxEvent(xcb_generic_event_t *message)
 
 void UGlobalHotkeys::regLinuxHotkey(const UKeySequence &keySeq, size_t id)
 {
+    if (Evdev) {
+        // The evdev backend keeps its own key table
+        if (Evdev->registerHotkey(keySeq, id))
+            Registered.insert(id, UHotkeyData{0, 0});
+        return;
+    }
+    if (!X11Connection) {
+        qWarning() << "No hotkey backend available for hotkey" << id;
+        return;
+    }
+
     UHotkeyData data;
     UKeyData keyData = QtKeyToLinux(keySeq);
 
@@ -207,6 +238,10 @@ void UGlobalHotkeys::regLinuxHotkey(const UKeySequence &keySeq, size_t id)
 void UGlobalHotkeys::unregLinuxHotkey(size_t id)
 {
     UHotkeyData data = Registered.take(id);
+    if (Evdev) {
+        Evdev->unregisterHotkey(id);
+        return;
+    }
     xcb_ungrab_key(X11Connection, data.keyCode, X11Wid, data.mods);
     xcb_ungrab_key(X11Connection, data.keyCode, X11Wid, data.mods | XCB_MOD_MASK_2);
 }
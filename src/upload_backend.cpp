@@ -0,0 +1,236 @@
+#include "include/upload_backend.h"
+#include "include/screenme_backend.h"
+#include "include/http_post_backend.h"
+#include "include/s3_backend.h"
+#include "include/content_hash.h"
+#include "include/publish_index.h"
+#include "include/job_system.h"
+#include "include/metrics_registry.h"
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QUrl>
+#include <optional>
+
+UploadTask::UploadTask(QObject* parent)
+    : QObject(parent), canceled(false), done(false) {
+}
+
+void UploadTask::track(ScheduledUpload* upload) {
+    steps.append(upload);
+    if (canceled) {
+        // Deferred, so the caller can still connect to the step's finished()
+        QMetaObject::invokeMethod(upload, &ScheduledUpload::cancel, Qt::QueuedConnection);
+    }
+}
+
+void UploadTask::follow(UploadTask* inner) {
+    innerTask = inner;
+    connect(inner, &UploadTask::progress, this, &UploadTask::progress);
+    connect(inner, &UploadTask::linkReady, this, &UploadTask::linkReady);
+    connect(inner, &UploadTask::previewPublished, this, &UploadTask::previewPublished);
+    if (canceled) {
+        QMetaObject::invokeMethod(inner, &UploadTask::cancel, Qt::QueuedConnection);
+    }
+}
+
+void UploadTask::cancel() {
+    if (canceled || done) {
+        return;
+    }
+    canceled = true;
+    if (innerTask) {
+        innerTask->cancel();
+    }
+    // Copy first, a step that never started reports back synchronously
+    const QList<QPointer<ScheduledUpload>> running = steps;
+    for (const QPointer<ScheduledUpload>& step : running) {
+        if (step) {
+            step->cancel();
+        }
+    }
+}
+
+void UploadTask::finish(const UploadResult& result) {
+    if (done) {
+        return;
+    }
+    done = true;
+    emit finished(result);
+    deleteLater();
+}
+
+void UploadTask::fail(const QString& error) {
+    QMetaObject::invokeMethod(this, [this, error]() {
+        UploadResult result;
+        result.error = error;
+        finish(result);
+    }, Qt::QueuedConnection);
+}
+
+namespace {
+    UploadResult canceledResult() {
+        UploadResult result;
+        result.canceled = true;
+        return result;
+    }
+
+    void finishReused(UploadTask* task, const QString& id, const QString& link) {
+        UploadResult result;
+        result.success = true;
+        result.deduplicated = true;
+        result.id = id;
+        result.link = link;
+        emit task->linkReady(link, id);
+        task->finish(result);
+    }
+}
+
+UploadBackend* UploadBackend::create(const QJsonObject& config, QObject* parent) {
+    const QString backend = config["upload_backend"].toString("screenme");
+    if (backend == "s3") {
+        return new S3Backend(config, parent);
+    }
+    if (backend == "http") {
+        return new HttpPostBackend(config, parent);
+    }
+    if (backend != "screenme") {
+        qWarning() << "Unknown upload backend" << backend << ", using ScreenMe";
+    }
+    return new ScreenMeBackend(config, parent);
+}
+
+UploadTask* UploadBackend::publish(const UploadSource& source, UploadPriority priority) {
+    UploadTask* task = new UploadTask(this);
+    QElapsedTimer started;
+    started.start();
+    connect(task, &UploadTask::finished, task, [started](const UploadResult& result) {
+        MetricsRegistry* metrics = MetricsRegistry::instance();
+        if (result.canceled) {
+            return;
+        }
+        if (result.success) {
+            metrics->counter("screenme_uploads_total", "Captures published")->add();
+            metrics->histogram("screenme_upload_seconds", "Time to publish a capture, hashing and lookup included")
+                ->observe(started.nsecsElapsed() / 1e9);
+        }
+        else {
+            metrics->counter("screenme_upload_failures_total", "Publishes that failed")->add();
+        }
+    });
+    // Runs until its first suspension here, the task reports nothing before the caller connects
+    Async::spawn(publishSteps(task, source, priority), task);
+    return task;
+}
+
+Async::Task<> UploadBackend::publishSteps(QPointer<UploadTask> task, UploadSource source, UploadPriority priority) {
+    // Hashing reads the whole file, keep it off the GUI thread. Only an interactive
+    // publish has someone waiting on it.
+    const QString filePath = source.filePath;
+    const JobSystem::Lane lane = priority == UploadPriority::Interactive ? JobSystem::Lane::Interactive : JobSystem::Lane::Background;
+    const auto hashed = co_await JobSystem::instance()->run(lane, [filePath](const JobToken&) -> std::optional<quint64> {
+        bool ok = false;
+        const quint64 value = ContentHash::ofFile(filePath, &ok);
+        return ok ? std::optional<quint64>(value) : std::nullopt;
+    });
+    // The task goes away with this backend, check it before touching anything else
+    if (!task) {
+        co_return;
+    }
+    if (!hashed || task->isCanceled()) {
+        task->finish(canceledResult());
+        co_return;
+    }
+    const std::optional<quint64> hash = *hashed;
+    if (!hash) {
+        task->fail("Failed to open the image file for upload.");
+        co_return;
+    }
+    source.contentHash = ContentHash::toHex(*hash);
+
+    PublishIndex* index = PublishIndex::instance();
+    const QString indexed = indexTarget();
+    PublishIndex::Entry entry;
+    const bool known = index->find(source.contentHash, indexed, &entry);
+    // Without a lookup the index is all there is. Otherwise the target has the last word:
+    // a capture deleted there must not dedupe to a dead link.
+    if (known && !hasLookup()) {
+        finishReused(task, entry.id, entry.link);
+        co_return;
+    }
+
+    const UploadResult existing = co_await Async::callback<UploadResult>([this, task, source](std::function<void(UploadResult)> done) {
+        lookup(task, source, done);
+    });
+    if (!task) {
+        co_return;
+    }
+    if (existing.canceled || task->isCanceled()) {
+        task->finish(canceledResult());
+        co_return;
+    }
+    // The lookup can find out the target has none, the index is all there is then
+    if (known && !hasLookup()) {
+        finishReused(task, entry.id, entry.link);
+        co_return;
+    }
+    if (existing.success) {
+        if (!known || entry.id != existing.id || entry.link != existing.link) {
+            index->insert(source.contentHash, indexed, { existing.id, existing.link });
+        }
+        finishReused(task, existing.id, existing.link);
+        co_return;
+    }
+    // The target answered and does not have it, unlike a lookup that failed on the way
+    if (known && existing.httpStatus >= 200 && existing.httpStatus < 500) {
+        index->remove(source.contentHash, indexed);
+    }
+
+    UploadTask* inner = upload(source, priority);
+    task->follow(inner);
+    const UploadResult result = co_await Async::signal(inner, &UploadTask::finished);
+    if (!task) {
+        co_return;
+    }
+    if (result.success) {
+        index->insert(source.contentHash, indexed, { result.id, result.link });
+    }
+    task->finish(result);
+}
+
+QString UploadBackend::indexTarget() const {
+    const QString user = account();
+    return user.isEmpty() ? target() : user + '@' + target();
+}
+
+void UploadBackend::preconnect() {
+    const QUrl url(target());
+    QNetworkAccessManager* network = UploadScheduler::instance()->network();
+    if (url.scheme() == "https") {
+        network->connectToHostEncrypted(url.host(), url.port(443));
+    }
+    else if (url.scheme() == "http") {
+        network->connectToHost(url.host(), url.port(80));
+    }
+}
+
+void UploadBackend::lookup(UploadTask*, const UploadSource&, const std::function<void(const UploadResult&)>& done) {
+    done(UploadResult());
+}
+
+int UploadBackend::httpStatus(QNetworkReply* reply) {
+    return reply ? reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() : 0;
+}
+
+UploadResult UploadBackend::failure(QNetworkReply* reply) {
+    UploadResult result;
+    if (!reply || reply->error() == QNetworkReply::OperationCanceledError) {
+        result.canceled = true;
+        return result;
+    }
+    result.httpStatus = httpStatus(reply);
+    const QString errorString = reply->errorString();
+    // Keep only the server's part of Qt's message when there is one
+    const QString serverReply = errorString.section("server replied: ", 1, 1);
+    result.error = serverReply.isEmpty() ? errorString : serverReply;
+    return result;
+}
@@ -0,0 +1,236 @@
+#include "include/upload_scheduler.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+    const int TickMs = 50;
+    const int DefaultConcurrency = 2;
+    // Smallest bucket, so low caps still move whole TCP segments instead of dribbling bytes
+    const qint64 MinBurst = 16 * 1024;
+}
+
+// Request body handed to QNetworkAccessManager. Reads are granted by the scheduler's
+// bucket; a read that gets no tokens returns 0 and readyRead() fires once it refills.
+class ThrottledBody : public QIODevice {
+public:
+    ThrottledBody(QIODevice* source, UploadScheduler* scheduler)
+        : source(source), scheduler(scheduler), priority(UploadPriority::Interactive) {
+        source->setParent(this);
+        open(QIODevice::ReadOnly);
+    }
+
+    void wake() {
+        emit readyRead();
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 size() const override { return source->size(); }
+    qint64 bytesAvailable() const override { return source->bytesAvailable() + QIODevice::bytesAvailable(); }
+    bool atEnd() const override { return source->atEnd() && QIODevice::bytesAvailable() == 0; }
+
+    UploadPriority priority;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        const qint64 granted = scheduler->takeTokens(this, maxSize);
+        if (granted == 0) {
+            return 0;
+        }
+        const qint64 count = source->read(data, granted);
+        if (count > 0) {
+            scheduler->bytesSinceTick += count;
+        }
+        // Tokens that the source could not fill go back to the bucket
+        if (count < granted) {
+            scheduler->tokens += granted - qMax<qint64>(0, count);
+        }
+        return count;
+    }
+
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    QIODevice* source;
+    UploadScheduler* scheduler;
+};
+
+ScheduledUpload::ScheduledUpload(const QNetworkRequest& request, const QByteArray& verb, ThrottledBody* body, UploadPriority priority, QObject* parent)
+    : QObject(parent), request(request), verb(verb), body(body), uploadPriority(priority), networkReply(nullptr) {
+    if (body) {
+        body->setParent(this);
+        body->priority = priority;
+    }
+}
+
+void ScheduledUpload::cancel() {
+    if (networkReply) {
+        networkReply->abort();
+        return;
+    }
+    UploadScheduler* scheduler = qobject_cast<UploadScheduler*>(parent());
+    if (scheduler) {
+        scheduler->remove(this);
+    }
+    emit finished(nullptr);
+    deleteLater();
+}
+
+UploadScheduler::UploadScheduler(QObject* parent)
+    : QObject(parent), lastTick(0), bandwidthLimit(0), tokens(0.0), maxConcurrent(DefaultConcurrency), bytesSinceTick(0) {
+    ticker.setInterval(TickMs);
+    connect(&ticker, &QTimer::timeout, this, &UploadScheduler::tick);
+    clock.start();
+}
+
+UploadScheduler* UploadScheduler::instance() {
+    static UploadScheduler* scheduler = new UploadScheduler(QCoreApplication::instance());
+    return scheduler;
+}
+
+void UploadScheduler::setBandwidthLimit(qint64 bytesPerSecond) {
+    bandwidthLimit = qMax<qint64>(0, bytesPerSecond);
+    tokens = qMin(tokens, double(qMax(MinBurst, bandwidthLimit)));
+}
+
+void UploadScheduler::setMaxConcurrent(int count) {
+    maxConcurrent = qMax(1, count);
+    dispatch();
+}
+
+void UploadScheduler::applyConfig(const QJsonObject& config) {
+    setBandwidthLimit(qint64(config["upload_limit_kb_per_s"].toInt(0)) * 1024);
+    setMaxConcurrent(config["upload_concurrency"].toInt(DefaultConcurrency));
+}
+
+ScheduledUpload* UploadScheduler::enqueue(const QNetworkRequest& request, QIODevice* body, UploadPriority priority, const QByteArray& verb) {
+    QNetworkRequest sized = request;
+    if (body) {
+        // Without a length QNetworkAccessManager would buffer a sequential body completely before sending
+        sized.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+    }
+
+    ScheduledUpload* upload = new ScheduledUpload(sized, verb, body ? new ThrottledBody(body, this) : nullptr, priority, this);
+    int index = 0;
+    while (index < queued.size() && queued.at(index)->priority() <= priority) {
+        ++index;
+    }
+    queued.insert(index, upload);
+    dispatch();
+    updateCounts();
+    return upload;
+}
+
+void UploadScheduler::dispatch() {
+    while (!queued.isEmpty()) {
+        ScheduledUpload* next = queued.first();
+        if (active.size() >= maxConcurrent && next->priority() != UploadPriority::Interactive) {
+            break;
+        }
+        queued.removeFirst();
+        start(next);
+    }
+}
+
+void UploadScheduler::start(ScheduledUpload* upload) {
+    active.append(upload);
+    if (!ticker.isActive()) {
+        // A fresh bucket starts full so small uploads never wait
+        tokens = double(qMax(MinBurst, bandwidthLimit));
+        lastTick = clock.elapsed();
+        bytesSinceTick = 0;
+        ticker.start();
+    }
+
+    QNetworkReply* reply = nullptr;
+    if (upload->verb == "HEAD") {
+        // Only head() knows the answer has no body, a custom HEAD would wait for Content-Length bytes
+        reply = manager.head(upload->request);
+    }
+    else if (!upload->body) {
+        reply = manager.sendCustomRequest(upload->request, upload->verb);
+    }
+    else {
+        reply = manager.sendCustomRequest(upload->request, upload->verb, upload->body);
+    }
+    upload->networkReply = reply;
+    connect(reply, &QNetworkReply::uploadProgress, upload, &ScheduledUpload::uploadProgress);
+    connect(reply, &QNetworkReply::finished, this, [this, upload, reply]() {
+        remove(upload);
+        waiting.removeAll(upload->body);
+        emit upload->finished(reply);
+        reply->deleteLater();
+        upload->deleteLater();
+        dispatch();
+        updateCounts();
+    });
+    emit upload->started();
+}
+
+void UploadScheduler::remove(ScheduledUpload* upload) {
+    queued.removeAll(upload);
+    active.removeAll(upload);
+    updateCounts();
+}
+
+qint64 UploadScheduler::takeTokens(ThrottledBody* body, qint64 wanted) {
+    if (bandwidthLimit <= 0) {
+        return wanted;
+    }
+    // A starving upload of a higher class gets the next refill before anyone below it
+    for (ThrottledBody* other : waiting) {
+        if (other != body && other->priority < body->priority) {
+            if (!waiting.contains(body)) {
+                waiting.append(body);
+            }
+            return 0;
+        }
+    }
+    const qint64 granted = qMin(wanted, qint64(tokens));
+    if (granted <= 0) {
+        if (!waiting.contains(body)) {
+            waiting.append(body);
+        }
+        return 0;
+    }
+    tokens -= granted;
+    waiting.removeAll(body);
+    return granted;
+}
+
+void UploadScheduler::tick() {
+    const qint64 now = clock.elapsed();
+    const qint64 elapsed = qMax<qint64>(1, now - lastTick);
+    lastTick = now;
+
+    // Throughput is smoothed over roughly half a second
+    const double rate = bytesSinceTick * 1000.0 / elapsed;
+    currentStats.bytesPerSecond = currentStats.bytesPerSecond * 0.8 + rate * 0.2;
+    currentStats.bytesSent += bytesSinceTick;
+    bytesSinceTick = 0;
+
+    if (bandwidthLimit > 0) {
+        tokens = qMin(tokens + bandwidthLimit * elapsed / 1000.0, double(qMax(MinBurst, bandwidthLimit)));
+        // Sleepers stay listed until they get tokens, so a lower class that reads first
+        // still yields to a higher one that was woken in the same tick
+        QList<ThrottledBody*> sleepers = waiting;
+        std::stable_sort(sleepers.begin(), sleepers.end(), [](ThrottledBody* a, ThrottledBody* b) {
+            return a->priority < b->priority;
+        });
+        for (ThrottledBody* body : sleepers) {
+            body->wake();
+        }
+    }
+
+    if (active.isEmpty()) {
+        ticker.stop();
+        currentStats.bytesPerSecond = 0.0;
+    }
+    emit statsChanged(currentStats);
+}
+
+void UploadScheduler::updateCounts() {
+    currentStats.active = active.size();
+    currentStats.queued = queued.size();
+    emit statsChanged(currentStats);
+}
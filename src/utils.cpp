@@ -1,16 +1,25 @@
 #include "include/utils.h"
 #include "include/screenshotdisplay.h"
+#include "include/palette_quantizer.h"
+#include "include/frame_buffer_pool.h"
+#include "include/metrics_registry.h"
+#include <QElapsedTimer>
 #include <QDir>
 #include <QScreen>
 #include <QApplication>
 #include <QPixmap>
 #include <QDebug>
 #include <QFile>
+#include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QString>
 #include <QStandardPaths>
 #include <QSettings>
+#ifdef Q_OS_WIN
+#include <QtGui/qscreen_platform.h>
+#include <Windows.h>
+#endif
 
 QString getUniqueFilePath(const QString& folder, const QString& baseName, const QString& extension) {
     QDir dir(folder);
@@ -28,6 +37,26 @@ QString getUniqueFilePath(const QString& folder, const QString& baseName, const
     return filePath;
 }
 
+namespace {
+    // The "screenme_host" config key, as last applied
+    QString configuredHost;
+}
+
+void applyScreenMeHost(const QJsonObject& config) {
+    configuredHost = config["screenme_host"].toString();
+}
+
+QString screenMeHost() {
+    QString value = qEnvironmentVariable("SCREENME_HOST");
+    if (value.isEmpty()) {
+        value = configuredHost;
+    }
+    while (value.endsWith('/')) {
+        value.chop(1);
+    }
+    return value.isEmpty() ? SCREEN_ME_HOST : value;
+}
+
 QString getConfigFilePath(const QString& file) {
     QString configPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir dir(configPath);
@@ -37,20 +66,111 @@ QString getConfigFilePath(const QString& file) {
     return dir.filePath(file);
 }
 
+bool saveCapture(const QImage& image, const QString& filePath, int quality) {
+    static MetricsRegistry::Counter* saves = MetricsRegistry::instance()->counter("screenme_saves_total", "Captures saved to disk");
+    static MetricsRegistry::Counter* failures = MetricsRegistry::instance()->counter("screenme_save_failures_total", "Captures that failed to save");
+    static MetricsRegistry::Histogram* encodeTime = MetricsRegistry::instance()->histogram("screenme_encode_seconds",
+        "Time to encode a capture and write it out", "target=\"file\"");
+    QElapsedTimer timer;
+    timer.start();
+
+    bool saved = false;
+    // Interface captures rarely use more than 256 colours, an indexed png of them is lossless and much smaller
+    QImage indexed;
+    if (QFileInfo(filePath).suffix().compare("png", Qt::CaseInsensitive) == 0) {
+        indexed = PaletteQuantizer::quantizeExact(image);
+    }
+    if (!indexed.isNull()) {
+        saved = indexed.save(filePath, "png", quality);
+    }
+    else {
+        saved = image.save(filePath, nullptr, quality);
+    }
+
+    encodeTime->observe(timer.nsecsElapsed() / 1e9);
+    (saved ? saves : failures)->add();
+    return saved;
+}
+
 void CaptureScreenshot(const QString& savePath) {
     QScreen* screen = QGuiApplication::primaryScreen();
     if (!screen) {
         qDebug() << "No primary screen found";
         return;
     }
-    QPixmap originalPixmap = screen->grabWindow(0);
-    originalPixmap.save(savePath);
+    grabScreen(screen).save(savePath);
+}
+
+QImage grabScreen(QScreen* screen) {
+#ifdef Q_OS_WIN
+    // BitBlt into a DIB section and copy into a pooled frame, where grabWindow() would
+    // allocate a fresh image on the heap for every capture
+    QNativeInterface::QWindowsScreen* windowsScreen = screen->nativeInterface<QNativeInterface::QWindowsScreen>();
+    MONITORINFO monitor = { sizeof(MONITORINFO) };
+    if (windowsScreen && GetMonitorInfo(windowsScreen->handle(), &monitor)) {
+        const RECT& bounds = monitor.rcMonitor;
+        const int width = bounds.right - bounds.left;
+        const int height = bounds.bottom - bounds.top;
+
+        BITMAPINFO info = {};
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = width;
+        info.bmiHeader.biHeight = -height;
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+
+        HDC screenDc = GetDC(nullptr);
+        HDC memoryDc = CreateCompatibleDC(screenDc);
+        void* bits = nullptr;
+        HBITMAP bitmap = CreateDIBSection(screenDc, &info, DIB_RGB_COLORS, &bits, nullptr, 0);
+        QImage image;
+        if (bitmap) {
+            HGDIOBJ previous = SelectObject(memoryDc, bitmap);
+            if (BitBlt(memoryDc, 0, 0, width, height, screenDc, bounds.left, bounds.top, SRCCOPY | CAPTUREBLT)) {
+                GdiFlush();
+                image = FrameBufferPool::instance()->image(QSize(width, height), QImage::Format_RGB32);
+                // GDI leaves the alpha byte undefined, RGB32 wants it opaque
+                const quint32* source = static_cast<const quint32*>(bits);
+                for (int y = 0; y < height; ++y) {
+                    quint32* target = reinterpret_cast<quint32*>(image.scanLine(y));
+                    const quint32* row = source + size_t(y) * width;
+                    for (int x = 0; x < width; ++x) {
+                        target[x] = row[x] | 0xff000000u;
+                    }
+                }
+            }
+            SelectObject(memoryDc, previous);
+            DeleteObject(bitmap);
+        }
+        DeleteDC(memoryDc);
+        ReleaseDC(nullptr, screenDc);
+        if (!image.isNull()) {
+            return image;
+        }
+    }
+#endif
+    QImage image = screen->grabWindow(0).toImage();
+    image.setDevicePixelRatio(1.0);
+    return image;
+}
+
+QVector<ScreenGrab> grabDesktop(QRect* geometry) {
+    QVector<ScreenGrab> grabs;
+    QRect desktop;
+    for (QScreen* screen : QGuiApplication::screens()) {
+        // Not composed here: one image at a single ratio would resample every other screen
+        grabs.append({ screen, screen->geometry(), screen->devicePixelRatio(), grabScreen(screen) });
+        desktop |= screen->geometry();
+    }
+    *geometry = desktop;
+    return grabs;
 }
 
 void displayScreenshotOnScreen(const QPixmap& pixmap) {
-    ScreenshotDisplay* displayWidget = new ScreenshotDisplay(pixmap);
-    displayWidget->setGeometry(QApplication::primaryScreen()->geometry());
-    displayWidget->show();
+    // Shows itself, on the screens the primary one overlaps
+    QScreen* screen = QApplication::primaryScreen();
+    new ScreenshotDisplay({ { screen, screen->geometry(), pixmap.devicePixelRatio(), pixmap.toImage() } }, screen->geometry());
 }
 
 void saveLoginInfo(const QString& id, const QString& email, const QString& nickname, const QString& token) {
@@ -0,0 +1,222 @@
+#include "include/vector_export.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QFontInfo>
+#include <QFontMetrics>
+#include <QGuiApplication>
+#include <QImageWriter>
+#include <QPageSize>
+#include <QPainter>
+#include <QPdfWriter>
+#include <QScreen>
+#include <QStringList>
+
+namespace {
+    // Base64-encodes whatever is written to it straight into `target`, so the PNG encoder
+    // can stream the embedded raster into the SVG without a full encoded copy in memory
+    class Base64Writer : public QIODevice {
+    public:
+        explicit Base64Writer(QIODevice* target) : target(target) {
+            open(QIODevice::WriteOnly);
+        }
+
+        void finish() {
+            if (!pending.isEmpty()) {
+                target->write(pending.toBase64());
+                pending.clear();
+            }
+        }
+
+    protected:
+        qint64 readData(char*, qint64) override { return -1; }
+
+        qint64 writeData(const char* data, qint64 size) override {
+            pending.append(data, size);
+            // Only whole 3-byte groups can be encoded without padding in the middle of the stream
+            const qsizetype whole = pending.size() - pending.size() % 3;
+            if (target->write(pending.left(whole).toBase64()) < 0) {
+                return -1;
+            }
+            pending.remove(0, whole);
+            return size;
+        }
+
+    private:
+        QIODevice* target;
+        QByteArray pending;
+    };
+
+    QString number(qreal value) {
+        return QString::number(value, 'g', 6);
+    }
+
+    QString paintAttribute(const char* name, const QColor& color) {
+        QString attribute = QString(" %1=\"%2\"").arg(name, color.name());
+        if (color.alpha() < 255) {
+            attribute += QString(" %1-opacity=\"%2\"").arg(name, number(color.alphaF()));
+        }
+        return attribute;
+    }
+
+    QString strokeAttributes(const Annotation& annotation) {
+        return paintAttribute("stroke", annotation.color)
+            + QString(" stroke-width=\"%1\" stroke-linecap=\"round\" stroke-linejoin=\"round\" fill=\"none\"").arg(annotation.penWidth);
+    }
+
+    QString pathData(const QPainterPath& path) {
+        QString data;
+        for (int i = 0; i < path.elementCount(); ++i) {
+            const QPainterPath::Element element = path.elementAt(i);
+            switch (element.type) {
+            case QPainterPath::MoveToElement:
+                data += QString("M%1 %2 ").arg(number(element.x), number(element.y));
+                break;
+            case QPainterPath::LineToElement:
+                data += QString("L%1 %2 ").arg(number(element.x), number(element.y));
+                break;
+            case QPainterPath::CurveToElement:
+                data += QString("C%1 %2 ").arg(number(element.x), number(element.y));
+                break;
+            case QPainterPath::CurveToDataElement:
+                data += QString("%1 %2 ").arg(number(element.x), number(element.y));
+                break;
+            }
+        }
+        return data.trimmed();
+    }
+
+    QString svgElement(const Annotation& annotation) {
+        switch (annotation.kind) {
+        case Annotation::Stroke:
+            return QString("<path d=\"%1\"%2/>").arg(pathData(annotation.path), strokeAttributes(annotation));
+        case Annotation::Rectangle: {
+            const QRect r = annotation.rect.normalized();
+            return QString("<rect x=\"%1\" y=\"%2\" width=\"%3\" height=\"%4\"%5/>")
+                .arg(r.x()).arg(r.y()).arg(r.width()).arg(r.height()).arg(strokeAttributes(annotation));
+        }
+        case Annotation::Ellipse: {
+            const QRectF r = QRectF(annotation.rect.normalized());
+            return QString("<ellipse cx=\"%1\" cy=\"%2\" rx=\"%3\" ry=\"%4\"%5/>")
+                .arg(number(r.center().x()), number(r.center().y()), number(r.width() / 2), number(r.height() / 2), strokeAttributes(annotation));
+        }
+        case Annotation::Line:
+            return QString("<line x1=\"%1\" y1=\"%2\" x2=\"%3\" y2=\"%4\"%5/>")
+                .arg(annotation.start.x()).arg(annotation.start.y()).arg(annotation.end.x()).arg(annotation.end.y())
+                .arg(strokeAttributes(annotation));
+        case Annotation::Arrow: {
+            QString points;
+            for (const QPointF& point : Annotation::arrowHead(annotation.start, annotation.end, annotation.penWidth)) {
+                points += number(point.x()) + "," + number(point.y()) + " ";
+            }
+            return QString("<line x1=\"%1\" y1=\"%2\" x2=\"%3\" y2=\"%4\"%5/>")
+                .arg(annotation.start.x()).arg(annotation.start.y()).arg(annotation.end.x()).arg(annotation.end.y())
+                .arg(strokeAttributes(annotation))
+                + QString("<polygon points=\"%1\"%2%3 stroke-width=\"%4\" stroke-linejoin=\"round\"/>")
+                    .arg(points.trimmed(), paintAttribute("fill", annotation.color), paintAttribute("stroke", annotation.color))
+                    .arg(annotation.penWidth);
+        }
+        case Annotation::Highlight: {
+            const QRect r = annotation.rect.normalized();
+            return QString("<rect x=\"%1\" y=\"%2\" width=\"%3\" height=\"%4\"%5 style=\"mix-blend-mode:multiply\"/>")
+                .arg(r.x()).arg(r.y()).arg(r.width()).arg(r.height()).arg(paintAttribute("fill", annotation.color));
+        }
+        case Annotation::Text: {
+            const QFontInfo info(annotation.font);
+            const int ascent = QFontMetrics(annotation.font).ascent();
+            QString element = QString("<text xml:space=\"preserve\" font-family=\"%1\" font-size=\"%2\"%3%4%5>")
+                .arg(info.family().toHtmlEscaped()).arg(info.pixelSize())
+                .arg(info.bold() ? " font-weight=\"bold\"" : "")
+                .arg(info.italic() ? " font-style=\"italic\"" : "")
+                .arg(paintAttribute("fill", annotation.color));
+            const QStringList lines = annotation.text.split('\n');
+            for (int i = 0; i < lines.size(); ++i) {
+                element += QString("<tspan x=\"%1\" y=\"%2\">%3</tspan>")
+                    .arg(annotation.start.x()).arg(annotation.start.y() + ascent + i * annotation.lineHeight())
+                    .arg(lines.at(i).toHtmlEscaped());
+            }
+            return element + "</text>";
+        }
+        case Annotation::Redaction:
+            // Redactions are already part of the raster, a vector shape would only hint at them
+            break;
+        }
+        return QString();
+    }
+}
+
+bool VectorExport::isVectorFormat(const QString& filePath) {
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    return suffix == "svg" || suffix == "pdf";
+}
+
+bool VectorExport::write(const QString& filePath, const QImage& raster, const QVector<Annotation>& annotations, const QRect& area) {
+    if (QFileInfo(filePath).suffix().toLower() == "pdf") {
+        return writePdf(filePath, raster, annotations, area);
+    }
+    return writeSvg(filePath, raster, annotations, area);
+}
+
+bool VectorExport::writeSvg(const QString& filePath, const QImage& raster, const QVector<Annotation>& annotations, const QRect& area) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write" << filePath << file.errorString();
+        return false;
+    }
+
+    file.write(QString("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\"%1\" height=\"%2\" viewBox=\"%3 %4 %1 %2\">\n")
+        .arg(area.width()).arg(area.height()).arg(area.x()).arg(area.y()).toUtf8());
+
+    // The raster keeps its full pixel size and is only scaled down to the logical area.
+    // xlink:href is read by SVG 1.1 readers, Qt's own included, and still by SVG 2 ones.
+    file.write(QString("<image x=\"%1\" y=\"%2\" width=\"%3\" height=\"%4\" preserveAspectRatio=\"none\" xlink:href=\"data:image/png;base64,")
+        .arg(area.x()).arg(area.y()).arg(area.width()).arg(area.height()).toUtf8());
+    Base64Writer encoded(&file);
+    QImageWriter writer(&encoded, "png");
+    if (!writer.write(raster)) {
+        qWarning() << "Cannot encode capture for" << filePath << writer.errorString();
+        return false;
+    }
+    encoded.finish();
+    file.write("\"/>\n");
+
+    for (const Annotation& annotation : annotations) {
+        const QString element = svgElement(annotation);
+        if (!element.isEmpty()) {
+            file.write(element.toUtf8());
+            file.write("\n");
+        }
+    }
+    file.write("</svg>\n");
+    return file.error() == QFileDevice::NoError;
+}
+
+bool VectorExport::writePdf(const QString& filePath, const QImage& raster, const QVector<Annotation>& annotations, const QRect& area) {
+    QPdfWriter pdf(filePath);
+    // One page unit per logical pixel keeps the annotation coordinates and font sizes as on screen
+    const int dpi = qRound(QGuiApplication::primaryScreen()->logicalDotsPerInch());
+    pdf.setResolution(dpi);
+    pdf.setPageMargins(QMarginsF(0, 0, 0, 0));
+    // Exact, a size close to a standard one would otherwise be snapped to it
+    pdf.setPageSize(QPageSize(QSizeF(area.width() * 72.0 / dpi, area.height() * 72.0 / dpi), QPageSize::Point,
+        QString(), QPageSize::ExactMatch));
+    pdf.setCreator("ScreenMe");
+
+    QPainter painter;
+    if (!painter.begin(&pdf)) {
+        qWarning() << "Cannot write" << filePath;
+        return false;
+    }
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawImage(QRectF(0, 0, area.width(), area.height()), raster);
+    painter.translate(-area.topLeft());
+    for (const Annotation& annotation : annotations) {
+        if (annotation.kind == Annotation::Redaction) {
+            continue;
+        }
+        painter.setCompositionMode(annotation.kind == Annotation::Highlight ? QPainter::CompositionMode_Multiply : QPainter::CompositionMode_SourceOver);
+        annotation.paint(painter);
+    }
+    return painter.end();
+}